@@ -0,0 +1,31 @@
+#!/usr/bin/env bash
+
+# Run the helper startup benchmarks (benchmark/bench_helpers.py) inside the
+# base image built by build.sh. Results are written as JSON to
+# benchmark/results/<timestamp>.json. All arguments are passed to
+# bench_helpers.py, e.g.:
+#   ./benchmark.sh -n 2000 -j 64 --task --compare /bench/results/<old>.json
+
+set -e
+set -o pipefail
+
+cd "$(dirname "$0")"
+
+IMAGE="${IMAGE:-remote-exercises-framework-exercise-base:latest}"
+RESULTS_DIR="benchmark/results"
+mkdir -p "$RESULTS_DIR"
+output="/bench/$RESULTS_DIR/$(date +%Y%m%d-%H%M%S).json"
+
+# `task` needs a key and an instance ID to get past the _task startup, since
+# these are normally provided by the webapp when an instance is created.
+# The benchmark itself runs as the unprivileged user, just like students do.
+docker run --rm -v "$PWD:/bench" "$IMAGE" /bin/bash -c '
+    set -e
+    head -c 32 /dev/urandom > /etc/key
+    echo 0 > /etc/instance_id
+    out="$1"
+    shift
+    sudo -u user python3 /bench/benchmark/bench_helpers.py -o /tmp/report.json "$@"
+    cp /tmp/report.json "$out"
+    chown --reference=/bench "$out"
+' bench "$output" "$@"
@@ -0,0 +1,328 @@
+#!/usr/bin/env python3
+"""
+Startup-latency benchmarks for the container helper binaries.
+
+Builds `my-shell.c` (installed as `/bin/sh`) and `task-wrapper.c` (installed
+as `/usr/local/bin/task`) with the same compiler flags the Dockerfile uses and
+measures, for each of them and for a few reference binaries:
+
+  - exec-to-exit latency (min/mean/p50/p99/max) across N sequential runs
+  - throughput when W workers spawn the same command in parallel loops,
+    which mimics `make -j` hammering `/bin/sh`
+
+Results are written as JSON so runs can be diffed against an earlier
+baseline via `--compare`. This script only depends on the standard library
+and is meant to be run inside the base image (see `../benchmark.sh`).
+"""
+
+import argparse
+import json
+import multiprocessing
+import os
+import platform
+import shutil
+import subprocess
+import sys
+import tempfile
+import time
+import typing as ty
+from dataclasses import asdict, dataclass, field
+from pathlib import Path
+
+BASE_DIR = Path(__file__).resolve().parent.parent
+
+# Keep these in sync with the gcc invocations in the Dockerfile.
+HELPER_SOURCES = {
+    "my-shell": (BASE_DIR / "my-shell.c", []),
+    "task-wrapper": (
+        BASE_DIR / "task-wrapper.c",
+        [
+            "-O3",
+            "-Wall",
+            "-Werror",
+            "-Wl,-z,rel",
+            "-D_FORTIFY_SOURCE=2",
+            "-pie",
+            "-fPIE",
+            "-fstack-protector-strong",
+        ],
+    ),
+}
+
+
+@dataclass
+class LatencyResult:
+    name: str
+    argv: ty.List[str]
+    runs: int
+    failures: int
+    min_us: float
+    mean_us: float
+    p50_us: float
+    p99_us: float
+    max_us: float
+
+
+@dataclass
+class ThroughputResult:
+    name: str
+    argv: ty.List[str]
+    workers: int
+    duration_s: float
+    spawns: int
+    failures: int
+    spawns_per_sec: float
+
+
+@dataclass
+class Report:
+    meta: ty.Dict[str, ty.Any]
+    latency: ty.List[LatencyResult] = field(default_factory=list)
+    throughput: ty.List[ThroughputResult] = field(default_factory=list)
+
+
+def build_helpers(out_dir: Path, cc: str) -> ty.Dict[str, Path]:
+    """Compile all helpers into `out_dir` and return their paths by name."""
+    binaries = {}
+    for name, (source, flags) in HELPER_SOURCES.items():
+        binary = out_dir / name
+        cmd = [cc, *flags, str(source), "-o", str(binary)]
+        subprocess.run(cmd, check=True)
+        binaries[name] = binary
+    return binaries
+
+
+def spawn_and_wait(argv: ty.List[str]) -> ty.Tuple[int, bool]:
+    """Run `argv` once and return (elapsed_ns, success)."""
+    start = time.perf_counter_ns()
+    pid = os.posix_spawn(
+        argv[0],
+        argv,
+        os.environ,
+        file_actions=[
+            (os.POSIX_SPAWN_OPEN, 0, os.devnull, os.O_RDONLY, 0),
+            (os.POSIX_SPAWN_OPEN, 1, os.devnull, os.O_WRONLY, 0),
+            (os.POSIX_SPAWN_OPEN, 2, os.devnull, os.O_WRONLY, 0),
+        ],
+    )
+    _, status = os.waitpid(pid, 0)
+    elapsed = time.perf_counter_ns() - start
+    return elapsed, os.waitstatus_to_exitcode(status) == 0
+
+
+def percentile(sorted_values: ty.Sequence[float], pct: float) -> float:
+    """Nearest-rank percentile of an already sorted sequence."""
+    if not sorted_values:
+        return 0.0
+    rank = round(pct / 100 * len(sorted_values)) - 1
+    return sorted_values[max(0, min(len(sorted_values) - 1, rank))]
+
+
+def measure_latency(
+    name: str, argv: ty.List[str], runs: int, warmup: int
+) -> LatencyResult:
+    for _ in range(warmup):
+        spawn_and_wait(argv)
+
+    samples = []
+    failures = 0
+    for _ in range(runs):
+        elapsed, ok = spawn_and_wait(argv)
+        samples.append(elapsed / 1000)
+        failures += not ok
+
+    samples.sort()
+    return LatencyResult(
+        name=name,
+        argv=argv,
+        runs=runs,
+        failures=failures,
+        min_us=samples[0],
+        mean_us=sum(samples) / len(samples),
+        p50_us=percentile(samples, 50),
+        p99_us=percentile(samples, 99),
+        max_us=samples[-1],
+    )
+
+
+def _throughput_worker(
+    argv: ty.List[str], deadline: float, queue: "multiprocessing.Queue[ty.Any]"
+) -> None:
+    spawns = 0
+    failures = 0
+    while time.monotonic() < deadline:
+        _, ok = spawn_and_wait(argv)
+        spawns += 1
+        failures += not ok
+    queue.put((spawns, failures))
+
+
+def measure_throughput(
+    name: str, argv: ty.List[str], workers: int, duration: float
+) -> ThroughputResult:
+    ctx = multiprocessing.get_context("fork")
+    queue = ctx.Queue()
+    start = time.monotonic()
+    deadline = start + duration
+    procs = [
+        ctx.Process(target=_throughput_worker, args=(argv, deadline, queue))
+        for _ in range(workers)
+    ]
+    for p in procs:
+        p.start()
+    totals = [queue.get() for _ in procs]
+    for p in procs:
+        p.join()
+    elapsed = time.monotonic() - start
+
+    spawns = sum(t[0] for t in totals)
+    failures = sum(t[1] for t in totals)
+    return ThroughputResult(
+        name=name,
+        argv=argv,
+        workers=workers,
+        duration_s=elapsed,
+        spawns=spawns,
+        failures=failures,
+        spawns_per_sec=spawns / elapsed,
+    )
+
+
+def collect_targets(
+    binaries: ty.Dict[str, Path], include_task: bool
+) -> ty.Dict[str, ty.List[str]]:
+    """Return the commands to benchmark, keyed by a stable name."""
+    targets = {
+        "my-shell(built) -c true": [str(binaries["my-shell"]), "-c", "true"],
+    }
+
+    if Path("/bin/sh").exists():
+        targets["/bin/sh -c true"] = ["/bin/sh", "-c", "true"]
+
+    # Reference points to tell helper regressions apart from shell changes.
+    for ref in ("/bin/dash", "/bin/bash"):
+        if Path(ref).exists():
+            targets[f"{ref} -c true"] = [ref, "-c", "true"]
+    if Path("/bin/bash").exists():
+        targets["/bin/bash -p -c true"] = ["/bin/bash", "-p", "-c", "true"]
+
+    if include_task:
+        # `task --help` is handled by _task, which the wrapper runs via the task
+        # server or, if that is not running, via sudo. Thus, this measures the
+        # whole chain and only makes sense inside an instance container.
+        # `task id` is answered by the wrapper itself and measures its startup.
+        for name, path in (
+            ("task-wrapper(built)", binaries["task-wrapper"]),
+            ("/usr/local/bin/task", Path("/usr/local/bin/task")),
+        ):
+            if path.exists():
+                targets[f"{name} --help"] = [str(path), "--help"]
+                targets[f"{name} id"] = [str(path), "id"]
+
+    return targets
+
+
+def print_report(report: Report, baseline: ty.Optional[ty.Dict[str, ty.Any]]) -> None:
+    base_lat = {}
+    base_tp = {}
+    if baseline:
+        base_lat = {e["name"]: e for e in baseline.get("latency", [])}
+        base_tp = {e["name"]: e for e in baseline.get("throughput", [])}
+
+    def delta(new: float, old: ty.Optional[float]) -> str:
+        if not old:
+            return ""
+        return f" ({(new - old) / old * 100:+.1f}%)"
+
+    print(f"{'latency':<32} {'p50 [us]':>20} {'p99 [us]':>20} {'fail':>5}")
+    for lat in report.latency:
+        old = base_lat.get(lat.name, {})
+        p50 = f"{lat.p50_us:.0f}{delta(lat.p50_us, old.get('p50_us'))}"
+        p99 = f"{lat.p99_us:.0f}{delta(lat.p99_us, old.get('p99_us'))}"
+        print(f"{lat.name:<32} {p50:>20} {p99:>20} {lat.failures:>5}")
+
+    print()
+    print(f"{'throughput':<32} {'workers':>8} {'spawns/s':>20} {'fail':>5}")
+    for tp in report.throughput:
+        old = base_tp.get(tp.name, {})
+        rate = f"{tp.spawns_per_sec:.0f}"
+        rate += delta(tp.spawns_per_sec, old.get("spawns_per_sec"))
+        print(f"{tp.name:<32} {tp.workers:>8} {rate:>20} {tp.failures:>5}")
+
+
+def main() -> None:
+    parser = argparse.ArgumentParser(description=__doc__.split("\n\n")[0])
+    parser.add_argument("-n", "--runs", type=int, default=1000)
+    parser.add_argument("--warmup", type=int, default=50)
+    parser.add_argument(
+        "-j",
+        "--workers",
+        type=int,
+        default=64,
+        help="Number of parallel spawn loops for the throughput benchmark.",
+    )
+    parser.add_argument(
+        "-d",
+        "--duration",
+        type=float,
+        default=10.0,
+        help="Duration of each throughput benchmark in seconds.",
+    )
+    parser.add_argument(
+        "--task",
+        action="store_true",
+        help="Also benchmark `task` (needs sudo, /etc/key and /etc/instance_id).",
+    )
+    parser.add_argument("--cc", default=os.environ.get("CC", "gcc"))
+    parser.add_argument(
+        "-o", "--output", type=Path, help="Write the JSON report to this path."
+    )
+    parser.add_argument(
+        "--compare", type=Path, help="JSON report of an earlier run to diff against."
+    )
+    args = parser.parse_args()
+
+    if shutil.which(args.cc) is None:
+        print(f"[!] Compiler {args.cc} not found", file=sys.stderr)
+        sys.exit(1)
+
+    baseline = None
+    if args.compare:
+        baseline = json.loads(args.compare.read_text())
+
+    with tempfile.TemporaryDirectory(prefix="ref-bench-") as tmp:
+        binaries = build_helpers(Path(tmp), args.cc)
+        targets = collect_targets(binaries, args.task)
+
+        report = Report(
+            meta={
+                "timestamp": time.strftime("%Y-%m-%dT%H:%M:%S%z"),
+                "hostname": platform.node(),
+                "kernel": platform.release(),
+                "cpus": os.cpu_count(),
+                "cc": subprocess.run(
+                    [args.cc, "--version"], capture_output=True, text=True
+                ).stdout.splitlines()[0],
+                "runs": args.runs,
+                "workers": args.workers,
+                "duration_s": args.duration,
+            }
+        )
+
+        for name, argv in targets.items():
+            report.latency.append(measure_latency(name, argv, args.runs, args.warmup))
+        for name, argv in targets.items():
+            report.throughput.append(
+                measure_throughput(name, argv, args.workers, args.duration)
+            )
+
+    print_report(report, baseline)
+
+    if args.output:
+        args.output.parent.mkdir(parents=True, exist_ok=True)
+        args.output.write_text(json.dumps(asdict(report), indent=2) + "\n")
+        print(f"\n[+] Results written to {args.output}")
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,15 @@
+#!/bin/bash
+
+# Entrypoint of all images built on top of the base image.
+# If the container runs the SSH server (i.e., it is the entry service of an
+# instance), the task server is started next to it, thus `task` invocations
+# do not have to pay for sudo and the Python interpreter startup.
+# If the task server is not running, `task` falls back to `sudo _task`.
+
+case " $* " in
+    *" /usr/sbin/sshd "*)
+        /usr/local/bin/_task --serve &
+        ;;
+esac
+
+exec "$@"
@@ -1,14 +1,309 @@
+#include <ctype.h>
+#include <fcntl.h>
+#include <stdint.h>
 #include <stdlib.h>
 #include <unistd.h>
 #include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 
 /*
 This is a custom shell that calls /bin/bash with the -p flag.
 This flag prevents bash from dropping privileges in case euid != uid.
+
+If there are no privileges to preserve (euid == uid and egid == gid) and we
+are invoked non-interactively as `sh [-flags]c <script> [args...]`, we exec a
+lightweight POSIX shell instead, since this is what make, system(), popen()
+and friends use and bash startup dominates their cost. If the lightweight
+shell can not be executed, we fall back to bash.
+
+Before either, if the command string of `sh -c` is a single simple command
+without any shell syntax, it is executed directly (see DIRECT_EXEC_FLAGS).
+*/
+
+#define LIGHT_SHELL_PATH "/bin/dash"
+
+/*
+Option letters accepted in front of -c for the lightweight shell. Anything
+else (e.g., -i, -l, -o <option>, --login) is handled by bash.
+*/
+#define LIGHT_SHELL_FLAGS "aCefnuvx"
+
+/*
+Direct exec. If the command string is a single simple command, e.g.,
+`gcc -c foo.c -o foo.o`, it is split into words and executed via execvp(),
+thus no shell is started at all. Executing it this way preserves privileges
+just like `bash -p` does.
+
+Only unquoted words made of DIRECT_EXEC_WORD_CHARS, and single or double
+quoted strings without expansions in them are accepted. Anything else, e.g.,
+redirections, globs, variables, assignments, reserved words, or builtins as
+the command, is left to the shell. The same applies if execvp() fails, thus
+the shell reports the error as usual.
+
+Only the option letters below are accepted in front of -c, since they do not
+change the behavior of a simple command without expansions.
+*/
+#define DIRECT_EXEC_FLAGS "aCefu"
+#define DIRECT_EXEC_WORD_CHARS "%+,-./:=@_"
+
+/* Reserved words and builtins of bash and dash. */
+static const char *const shell_words[] = {
+    "!", "[[", "]]", "{", "}", "case", "coproc", "do", "done", "elif", "else",
+    "esac", "fi", "for", "function", "if", "in", "select", "then", "time",
+    "until", "while", ".", ":", "[", "alias", "bg", "bind", "break", "builtin",
+    "caller", "cd", "command", "compgen", "complete", "compopt", "continue",
+    "declare", "dirs", "disown", "echo", "enable", "eval", "exec", "exit",
+    "export", "false", "fc", "fg", "getopts", "hash", "help", "history",
+    "jobs", "kill", "let", "local", "logout", "mapfile", "popd", "printf",
+    "pushd", "pwd", "read", "readarray", "readonly", "return", "set",
+    "shift", "shopt", "source", "suspend", "test", "times", "trap", "true",
+    "type", "typeset", "ulimit", "umask", "unalias", "unset", "wait",
+};
+
+/*
+Exec tracing. If TRACE_PATH exists (created by `task trace on`), each
+invocation is recorded in the ring buffer it contains before the actual shell
+is executed. Otherwise, the only cost is a failed open().
+
+Layout: a struct trace_header followed by `capacity` (a power of two)
+struct trace_entry. Writers claim a slot by incrementing `head` and mark it
+as complete by storing its sequence number + 1 in `seq` last, thus readers
+can detect torn or overwritten entries by reading `seq` before and after
+the entry.
+
+Keep in sync with _TRACE_* in task.py.
+*/
+#define TRACE_PATH "/dev/shm/ref-shell-trace"
+#define TRACE_MAGIC 0x54485352u /* "RSHT" */
+#define TRACE_VERSION 1u
+
+struct trace_header {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t capacity;
+    uint32_t entry_size;
+    uint64_t head;
+    uint8_t reserved[40];
+};
+
+struct trace_entry {
+    uint64_t seq;
+    uint64_t start_ns; /* CLOCK_REALTIME */
+    uint32_t pid;
+    uint32_t ppid;
+    uint32_t uid;
+    uint32_t hash; /* FNV-1a of all arguments, including the truncated part */
+    uint32_t argc;
+    char args[92]; /* argv[1..] separated by spaces, truncated */
+};
+
+_Static_assert(sizeof(struct trace_header) == 64, "trace header size");
+_Static_assert(sizeof(struct trace_entry) == 128, "trace entry size");
+
+static void trace_invocation(int argc, char *argv[])
+{
+    int fd = open(TRACE_PATH, O_RDWR | O_CLOEXEC);
+    if (fd < 0)
+        return;
+
+    struct stat st;
+    struct trace_header hdr;
+    if (fstat(fd, &st) || pread(fd, &hdr, sizeof(hdr), 0) != sizeof(hdr)
+        || hdr.magic != TRACE_MAGIC || hdr.version != TRACE_VERSION
+        || hdr.entry_size != sizeof(struct trace_entry)
+        || hdr.capacity == 0 || (hdr.capacity & (hdr.capacity - 1))
+        || st.st_size != (off_t)(sizeof(hdr)
+                                 + (size_t)hdr.capacity * sizeof(struct trace_entry))) {
+        close(fd);
+        return;
+    }
+
+    void *map = mmap(NULL, st.st_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED)
+        return;
+
+    struct trace_header *h = map;
+    struct trace_entry *entries = (struct trace_entry *)(h + 1);
+    uint64_t n = __atomic_fetch_add(&h->head, 1, __ATOMIC_RELAXED);
+    struct trace_entry *e = &entries[n & (hdr.capacity - 1)];
+
+    __atomic_store_n(&e->seq, 0, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+
+    struct timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+    e->start_ns = (uint64_t)ts.tv_sec * 1000000000u + (uint64_t)ts.tv_nsec;
+    e->pid = (uint32_t)getpid();
+    e->ppid = (uint32_t)getppid();
+    e->uid = (uint32_t)getuid();
+    e->argc = (uint32_t)argc;
+
+    uint32_t hash = 2166136261u;
+    size_t len = 0;
+    for (int i = 1; i < argc; i++) {
+        for (const char *p = i > 1 ? " " : ""; *p; p++) {
+            hash = (hash ^ (uint8_t)*p) * 16777619u;
+            if (len < sizeof(e->args) - 1)
+                e->args[len++] = *p;
+        }
+        for (const char *p = argv[i]; *p; p++) {
+            hash = (hash ^ (uint8_t)*p) * 16777619u;
+            if (len < sizeof(e->args) - 1)
+                e->args[len++] = *p;
+        }
+    }
+    e->args[len] = '\0';
+    e->hash = hash;
+
+    __atomic_store_n(&e->seq, n + 1, __ATOMIC_RELEASE);
+    munmap(map, st.st_size);
+}
+
+/*
+Returns the index of the command string if we are invoked as
+`sh [-flags]c <command> [args...]` and all flags are in `allowed_flags`,
+otherwise 0. Options may also follow `-c` (e.g. `sh -c -x <command>` or
+`sh -c -- <command>`), these invocations are left to bash.
 */
+static int command_string_index(int argc, char *argv[], const char *allowed_flags)
+{
+    int saw_c = 0;
+
+    if (argc < 3)
+        return 0;
+
+    for (int i = 1; i < argc; i++) {
+        const char *arg = argv[i];
+
+        if (arg[0] != '-' && arg[0] != '+')
+            break;
+        if (arg[1] == '\0' || arg[1] == '-')
+            return 0;
+
+        for (const char *p = arg + 1; *p; p++) {
+            if (*p == 'c' && arg[0] == '-')
+                saw_c = 1;
+            else if (!strchr(allowed_flags, *p))
+                return 0;
+        }
+
+        // The command string must follow the options.
+        if (saw_c) {
+            if (i + 1 >= argc || argv[i + 1][0] == '-' || argv[i + 1][0] == '+')
+                return 0;
+            return i + 1;
+        }
+    }
+
+    return 0;
+}
+
+/*
+Split `cmd` into words if it is a simple command (see DIRECT_EXEC_FLAGS).
+Returns a NULL terminated array whose first element points to the buffer
+holding all words, or NULL.
+*/
+static char **split_simple_command(const char *cmd)
+{
+    size_t len = strlen(cmd);
+    char *buf = malloc(len + 1);
+    // Each word but the last is followed by at least one separator.
+    char **words = malloc((len / 2 + 2) * sizeof(*words));
+    size_t n = 0;
+    int in_word = 0;
+    char *out = buf;
+
+    if (!buf || !words)
+        goto fail;
+
+    for (const char *p = cmd;; p++) {
+        char c = *p;
+
+        if (c == '\0' || c == ' ' || c == '\t') {
+            if (in_word)
+                *out++ = '\0';
+            in_word = 0;
+            if (c == '\0')
+                break;
+            continue;
+        }
+
+        if (!in_word)
+            words[n++] = out;
+        in_word = 1;
+
+        if (c == '\'') {
+            const char *end = strchr(p + 1, '\'');
+            if (!end)
+                goto fail;
+            memcpy(out, p + 1, end - p - 1);
+            out += end - p - 1;
+            p = end;
+        } else if (c == '"') {
+            for (p++; *p != '"'; p++) {
+                if (*p == '\0' || *p == '$' || *p == '`' || *p == '\\')
+                    goto fail;
+                *out++ = *p;
+            }
+        } else if (isalnum((unsigned char)c) || strchr(DIRECT_EXEC_WORD_CHARS, c)) {
+            // An unquoted '=' in the first word makes it an assignment.
+            if (c == '=' && n == 1)
+                goto fail;
+            *out++ = c;
+        } else {
+            goto fail;
+        }
+    }
+
+    if (n == 0)
+        goto fail;
+    for (size_t i = 0; i < sizeof(shell_words) / sizeof(shell_words[0]); i++) {
+        if (!strcmp(words[0], shell_words[i]))
+            goto fail;
+    }
+
+    words[n] = NULL;
+    return words;
+
+fail:
+    free(buf);
+    free(words);
+    return NULL;
+}
+
+/* Execute `cmd` directly if possible. Only returns if it was not executed. */
+static void exec_simple_command(const char *cmd)
+{
+    char **words = split_simple_command(cmd);
+    if (!words)
+        return;
+
+    // Leave the shell's default search path to the shell.
+    if (strchr(words[0], '/') || getenv("PATH"))
+        execvp(words[0], words);
+
+    free(words[0]);
+    free(words);
+}
 
 int main(int argc, char *argv[])
 {
+    trace_invocation(argc, argv);
+
+    int cmd_idx = argc > 0 ? command_string_index(argc, argv, DIRECT_EXEC_FLAGS) : 0;
+    if (cmd_idx)
+        exec_simple_command(argv[cmd_idx]);
+
+    if (argc > 0 && geteuid() == getuid() && getegid() == getgid()
+        && command_string_index(argc, argv, LIGHT_SHELL_FLAGS)) {
+        execv(LIGHT_SHELL_PATH, argv);
+        // Fall through to bash if the lightweight shell is not available.
+    }
+
     //+1 for -p and +1 for NULL
     int new_argc = argc + 2;
 
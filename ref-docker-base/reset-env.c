@@ -0,0 +1,164 @@
+#define _GNU_SOURCE
+#include <errno.h>
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/personality.h>
+
+/*
+reset-env [-R] [-a <argv0>] [--] [<program> [<args>...]]
+
+Executes <program> with a fixed, known-good environment, such that a program
+run by gdb (`reset-env gdb ./vuln`) and a real run (`reset-env ./vuln`) see
+the same stack layout. Without <program>, a shell with that environment is
+started instead.
+
+The environment is built from env_table below, only PWD is set to the actual
+working directory. <program> is resolved to an absolute path (via the PATH
+of env_table if it contains no slash), which is used as argv[0] and as the
+filename passed to execve(), thus AT_EXECFN in the auxiliary vector is the
+same as well. This matches how gdb executes the program it debugs.
+
+Options:
+    -a <argv0>  Use <argv0> as argv[0] instead of the absolute path.
+    -R          Disable ASLR for <program>, as gdb does by default.
+*/
+
+#define SHELL_PATH "/bin/bash"
+#define SEARCH_PATH "/usr/local/sbin:/usr/local/bin:/usr/sbin:/usr/bin:/sbin:/bin"
+
+#define LS_COLORS \
+    "rs=0:di=01;34:ln=01;36:mh=00:pi=40;33:so=01;35:do=01;35:" \
+    "bd=40;33;01:cd=40;33;01:or=40;31;01:mi=00:su=37;41:sg=30;43:" \
+    "ca=30;41:tw=30;42:ow=34;42:st=37;44:ex=01;32:*.tar=01;31:" \
+    "*.tgz=01;31:*.arc=01;31:*.arj=01;31:*.taz=01;31:*.lha=01;31:" \
+    "*.lz4=01;31:*.lzh=01;31:*.lzma=01;31:*.tlz=01;31:*.txz=01;31:" \
+    "*.tzo=01;31:*.t7z=01;31:*.zip=01;31:*.z=01;31:*.Z=01;31:" \
+    "*.dz=01;31:*.gz=01;31:*.lrz=01;31:*.lz=01;31:*.lzo=01;31:" \
+    "*.xz=01;31:*.zst=01;31:*.tzst=01;31:*.bz2=01;31:*.bz=01;31:" \
+    "*.tbz=01;31:*.tbz2=01;31:*.tz=01;31:*.deb=01;31:*.rpm=01;31:" \
+    "*.jar=01;31:*.war=01;31:*.ear=01;31:*.sar=01;31:*.rar=01;31:" \
+    "*.alz=01;31:*.ace=01;31:*.zoo=01;31:*.cpio=01;31:*.7z=01;31:" \
+    "*.rz=01;31:*.cab=01;31:*.wim=01;31:*.swm=01;31:*.dwm=01;31:" \
+    "*.esd=01;31:*.jpg=01;35:*.jpeg=01;35:*.mjpg=01;35:*.mjpeg=01;35:" \
+    "*.gif=01;35:*.bmp=01;35:*.pbm=01;35:*.pgm=01;35:*.ppm=01;35:" \
+    "*.tga=01;35:*.xbm=01;35:*.xpm=01;35:*.tif=01;35:*.tiff=01;35:" \
+    "*.png=01;35:*.svg=01;35:*.svgz=01;35:*.mng=01;35:*.pcx=01;35:" \
+    "*.mov=01;35:*.mpg=01;35:*.mpeg=01;35:*.m2v=01;35:*.mkv=01;35:" \
+    "*.webm=01;35:*.ogm=01;35:*.mp4=01;35:*.m4v=01;35:*.mp4v=01;35:" \
+    "*.vob=01;35:*.qt=01;35:*.nuv=01;35:*.wmv=01;35:*.asf=01;35:" \
+    "*.rm=01;35:*.rmvb=01;35:*.flc=01;35:*.avi=01;35:*.fli=01;35:" \
+    "*.flv=01;35:*.gl=01;35:*.dl=01;35:*.xcf=01;35:*.xwd=01;35:" \
+    "*.yuv=01;35:*.cgm=01;35:*.emf=01;35:*.ogv=01;35:*.ogx=01;35:" \
+    "*.aac=00;36:*.au=00;36:*.flac=00;36:*.m4a=00;36:*.mid=00;36:" \
+    "*.midi=00;36:*.mka=00;36:*.mp3=00;36:*.mpc=00;36:*.ogg=00;36:" \
+    "*.ra=00;36:*.wav=00;36:*.oga=00;36:*.opus=00;36:*.spx=00;36:" \
+    "*.xspf=00;36:"
+
+/* The known-good environment, in this order. */
+static const char *const env_table[] = {
+    "LS_COLORS=" LS_COLORS,
+    "USER=user",
+    "PWD=/home/user",
+    "HOME=/home/user",
+    "LC_CTYPE=C.UTF-8",
+    "TERM=xterm-256color",
+    "SHELL=" SHELL_PATH,
+    "LOGNAME=user",
+    "PATH=" SEARCH_PATH,
+};
+
+#define ENV_TABLE_SIZE (sizeof(env_table) / sizeof(env_table[0]))
+
+static void usage(void)
+{
+    fprintf(stderr, "Usage: reset-env [-R] [-a <argv0>] [--] [<program> [<args>...]]\n");
+    exit(2);
+}
+
+/*
+Returns the absolute path of `program`, or NULL if it does not exist (errno
+is set accordingly).
+*/
+static char *resolve_program(const char *program)
+{
+    if (strchr(program, '/'))
+        return realpath(program, NULL);
+
+    char path[] = SEARCH_PATH;
+    char candidate[PATH_MAX];
+    int err = ENOENT;
+
+    for (char *save, *dir = strtok_r(path, ":", &save); dir; dir = strtok_r(NULL, ":", &save)) {
+        if (snprintf(candidate, sizeof(candidate), "%s/%s", dir, program) >= (int)sizeof(candidate))
+            continue;
+        if (access(candidate, X_OK) == 0)
+            return realpath(candidate, NULL);
+        if (errno == EACCES)
+            err = EACCES;
+    }
+
+    errno = err;
+    return NULL;
+}
+
+int main(int argc, char *argv[])
+{
+    const char *argv0 = NULL;
+    int no_aslr = 0;
+    int opt;
+
+    /* '+': Stop at the first non-option, it belongs to <program>. */
+    while ((opt = getopt(argc, argv, "+a:R")) != -1) {
+        switch (opt) {
+        case 'a':
+            argv0 = optarg;
+            break;
+        case 'R':
+            no_aslr = 1;
+            break;
+        default:
+            usage();
+        }
+    }
+
+    char *shell_argv[] = { SHELL_PATH, "--norc", "--noprofile", NULL };
+    char **prog_argv = &argv[optind];
+    if (optind == argc) {
+        if (argv0 || no_aslr)
+            usage();
+        fprintf(stderr, "[*] Starting a shell with a clean environment, exit it to return.\n");
+        prog_argv = shell_argv;
+    }
+
+    char *path = resolve_program(prog_argv[0]);
+    if (!path) {
+        fprintf(stderr, "reset-env: %s: %s\n", prog_argv[0], strerror(errno));
+        return errno == ENOENT ? 127 : 126;
+    }
+
+    const char *env[ENV_TABLE_SIZE + 1];
+    char cwd[PATH_MAX];
+    char pwd[sizeof("PWD=") + PATH_MAX];
+    for (size_t i = 0; i < ENV_TABLE_SIZE; i++) {
+        env[i] = env_table[i];
+        if (!strncmp(env[i], "PWD=", 4) && getcwd(cwd, sizeof(cwd))) {
+            snprintf(pwd, sizeof(pwd), "PWD=%s", cwd);
+            env[i] = pwd;
+        }
+    }
+    env[ENV_TABLE_SIZE] = NULL;
+
+    if (no_aslr && personality(personality(0xffffffff) | ADDR_NO_RANDOMIZE) == -1) {
+        perror("reset-env: personality");
+        return 1;
+    }
+
+    prog_argv[0] = argv0 ? (char *)argv0 : path;
+    execve(path, prog_argv, (char **)env);
+
+    fprintf(stderr, "reset-env: %s: %s\n", path, strerror(errno));
+    return errno == ENOENT ? 127 : 126;
+}
@@ -0,0 +1,17 @@
+#!/usr/bin/env python3
+#
+# Installed as /usr/local/bin/_task.
+#
+# Python never caches the bytecode of the script it is started with, thus
+# running task.py directly would compile it on every `task` invocation. This
+# launcher instead executes task.py from /usr/local/lib/ref, whose bytecode is
+# compiled during the image build (see the Dockerfile). The cached bytecode
+# embeds a hash of the source and is only used if the hash matches, otherwise
+# task.py is compiled from source.
+#
+# task.py runs in the globals of this script, i.e., it behaves exactly as if
+# it was started as /usr/local/bin/_task itself.
+
+from importlib.machinery import SourceFileLoader
+
+exec(SourceFileLoader("__main__", "/usr/local/lib/ref/task.py").get_code("__main__"))
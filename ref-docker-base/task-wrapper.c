@@ -1,43 +1,384 @@
+#define _GNU_SOURCE
 #include <stdlib.h>
 #include <stdio.h>
 #include <string.h>
 #include <unistd.h>
 #include <assert.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <time.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
 
 extern char **environ;
+const char *env_dump_dir = "/tmp";
 const char *env_dump_path = "/tmp/.user_environ";
+/* fd number the environment memfd is passed to _task as */
+const int env_fd = 3;
+/* Socket of the task server (`_task --serve`), see task.py */
+const char *task_server_path = "/run/ref-task.sock";
+/* Must match _SERVER_MAX_REQUEST_SIZE in task.py */
+#define TASK_SERVER_MAX_REQUEST_SIZE (64 * 1024)
+
+const char *instance_id_path = "/etc/instance_id";
+/* Rendered `task info` output, maintained by _task (see cmd_info in task.py) */
+const char *info_cache_path = "/run/ref-task/info";
+/* Must match _INFO_CACHE_TTL_S in task.py */
+#define INFO_CACHE_TTL_S 300
+#define INFO_CACHE_MAX_SIZE 4096
+
+/* Must match print_ok() of ref_utils */
+#define OK_COLOR "\033[32m"
+#define RESET_COLOR "\033[0m"
+
+/*
+ * CLOCK_MONOTONIC timestamps (ns) of our start and of the environment being
+ * ready. They are passed to _task as --wrapper-timing=<start>:<env>, which
+ * records the duration of each phase of a request (see _Timings in task.py).
+ */
+static unsigned long long started_ns, environ_ready_ns;
+static char wrapper_timing_arg[64];
+
+static unsigned long long monotonic_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (unsigned long long)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
 
 #define FATAL_ERROR() { printf("[!] ERROR: please contact your system administrator (code=%u)\n", __LINE__); exit(1); };
 
+/*
+ * Serialize `env` into a single buffer. Each variable is stored including
+ * its zero byte, which is used as delimiter if read back.
+ */
+static char *serialize_environ(char **env, size_t *len)
+{
+    size_t total = 0;
+    for (char **e = env; *e; e++)
+        total += strlen(*e) + 1;
+
+    /* +1 so that an empty environment does not result in malloc(0) */
+    char *buf = malloc(total + 1);
+    if (!buf)
+        return NULL;
+
+    char *p = buf;
+    for (char **e = env; *e; e++) {
+        size_t n = strlen(*e) + 1;
+        memcpy(p, *e, n);
+        p += n;
+    }
+
+    *len = total;
+    return buf;
+}
+
+static int write_all(int fd, const char *buf, size_t len)
+{
+    while (len > 0) {
+        ssize_t ret = write(fd, buf, len);
+        if (ret < 0) {
+            if (errno == EINTR)
+                continue;
+            return -1;
+        }
+        buf += ret;
+        len -= ret;
+    }
+    return 0;
+}
+
+/*
+ * Fallback if no memfd can be created: Atomically replace `env_dump_path` with the contents of `buf`.
+ * The data is written into an unnamed file (O_TMPFILE) that is linked under
+ * a unique name and then renamed over the destination. Hence, readers either
+ * see the old or the new dump, but never a partially written one, even if
+ * multiple `task` invocations race with each other.
+ */
+static int dump_environ(const char *buf, size_t len)
+{
+    char tmp_path[64];
+    char fd_path[64];
+    int fd;
+
+    snprintf(tmp_path, sizeof(tmp_path), "%s.%d", env_dump_path, getpid());
+
+    fd = open(env_dump_dir, O_TMPFILE | O_WRONLY | O_CLOEXEC, 0666);
+    if (fd >= 0) {
+        if (write_all(fd, buf, len) < 0)
+            goto err_close;
+
+        /* linkat() with AT_EMPTY_PATH requires CAP_DAC_READ_SEARCH */
+        snprintf(fd_path, sizeof(fd_path), "/proc/self/fd/%d", fd);
+        unlink(tmp_path);
+        if (linkat(AT_FDCWD, fd_path, AT_FDCWD, tmp_path, AT_SYMLINK_FOLLOW) < 0)
+            goto err_close;
+    } else {
+        /* The filesystem does not support O_TMPFILE */
+        unlink(tmp_path);
+        fd = open(tmp_path, O_CREAT | O_EXCL | O_WRONLY | O_CLOEXEC, 0666);
+        if (fd < 0)
+            return -1;
+        if (write_all(fd, buf, len) < 0)
+            goto err_unlink;
+    }
+
+    if (close(fd) < 0) {
+        fd = -1;
+        goto err_unlink;
+    }
+    fd = -1;
+
+    if (rename(tmp_path, env_dump_path) < 0)
+        goto err_unlink;
+
+    return 0;
+
+err_unlink:
+    unlink(tmp_path);
+err_close:
+    if (fd >= 0)
+        close(fd);
+    return -1;
+}
+
+/*
+ * Pass the environment to _task via a sealed memfd that is inherited as
+ * `env_fd`. Returns -1 if memfds are not available, in which case the caller
+ * falls back to dumping the environment to `env_dump_path`.
+ */
+static int create_environ_memfd(const char *buf, size_t len)
+{
+    int fd = memfd_create("user_environ", MFD_CLOEXEC | MFD_ALLOW_SEALING);
+    if (fd < 0)
+        return -1;
+
+    if (write_all(fd, buf, len) < 0)
+        goto err;
+
+    /* _task runs as root, make sure the user can not change the data under its feet */
+    if (fcntl(fd, F_ADD_SEALS, F_SEAL_SHRINK | F_SEAL_GROW | F_SEAL_WRITE | F_SEAL_SEAL) < 0)
+        goto err;
+
+    if (fd != env_fd) {
+        /* dup2() clears FD_CLOEXEC */
+        if (dup2(fd, env_fd) < 0)
+            goto err;
+        close(fd);
+    } else if (fcntl(fd, F_SETFD, 0) < 0) {
+        goto err;
+    }
+
+    return env_fd;
+
+err:
+    close(fd);
+    return -1;
+}
+
+/*
+ * Read at most `size - 1` bytes of the file at `path` into `buf`. Only files
+ * owned by root are accepted. Returns the number of bytes read or -1 on error.
+ */
+static ssize_t read_root_file(const char *path, char *buf, size_t size, struct stat *st)
+{
+    int fd = open(path, O_RDONLY | O_NOFOLLOW | O_CLOEXEC);
+    if (fd < 0)
+        return -1;
+
+    ssize_t len = -1;
+    if (fstat(fd, st) == 0 && S_ISREG(st->st_mode) && st->st_uid == 0
+        && st->st_size < (off_t)size)
+        len = read(fd, buf, size - 1);
+    close(fd);
+
+    if (len >= 0)
+        buf[len] = '\0';
+    return len;
+}
+
+/*
+ * `task id` only prints /etc/instance_id, thus we do not need _task for it.
+ * Returns if the ID is not readable (e.g., on instances provisioned before it
+ * was made world readable), in which case _task handles the request.
+ */
+static void try_native_id(void)
+{
+    char buf[32];
+    struct stat st;
+    char *end;
+
+    if (read_root_file(instance_id_path, buf, sizeof(buf), &st) <= 0)
+        return;
+
+    long id = strtol(buf, &end, 10);
+    if (end == buf || (*end != '\0' && *end != '\n'))
+        return;
+
+    printf(OK_COLOR "[+] If you need support, please provide this ID alongside your request." RESET_COLOR "\n");
+    printf(OK_COLOR "[+] Instance ID: %ld" RESET_COLOR "\n", id);
+    exit(0);
+}
+
+/*
+ * Serve `task info` from the cache maintained by _task, as long as it is not
+ * older than INFO_CACHE_TTL_S. Returns if the cache is missing or stale.
+ */
+static void try_cached_info(void)
+{
+    char buf[INFO_CACHE_MAX_SIZE];
+    struct stat st;
+    ssize_t len;
+
+    len = read_root_file(info_cache_path, buf, sizeof(buf), &st);
+    if (len <= 0)
+        return;
+
+    time_t age = time(NULL) - st.st_mtime;
+    if (age < 0 || age >= INFO_CACHE_TTL_S)
+        return;
+
+    if (write_all(STDOUT_FILENO, buf, len) < 0)
+        exit(1);
+    exit(0);
+}
+
+static int task_server_sock = -1;
+
+static void forward_signal(int sig)
+{
+    unsigned char signum = sig;
+    int saved_errno = errno;
+    send(task_server_sock, &signum, sizeof(signum), MSG_NOSIGNAL);
+    errno = saved_errno;
+}
+
+/*
+ * Let the task server execute _task on behalf of us, thus we do not pay for
+ * sudo and the Python startup. We pass argv and our stdio fds as well as the
+ * environment memfd, and forward terminal signals until the server reports
+ * the exit status. Returns -1 if the server is not available, in which case
+ * the caller falls back to sudo. Otherwise, this function does not return.
+ */
+static int run_via_task_server(int argc, char const *argv[], int memfd)
+{
+    struct sockaddr_un addr = { .sun_family = AF_UNIX };
+    size_t len = 0;
+    int sock;
+
+    /* argv[0] is replaced by "task", thus the server never sees an empty message */
+    len += sizeof("task");
+    len += strlen(wrapper_timing_arg) + 1;
+    for (int i = 1; i < argc; i++)
+        len += strlen(argv[i]) + 1;
+    if (len > TASK_SERVER_MAX_REQUEST_SIZE)
+        return -1;
+
+    char request[len];
+    char *p = request;
+    memcpy(p, "task", sizeof("task"));
+    p += sizeof("task");
+    memcpy(p, wrapper_timing_arg, strlen(wrapper_timing_arg) + 1);
+    p += strlen(wrapper_timing_arg) + 1;
+    for (int i = 1; i < argc; i++) {
+        size_t n = strlen(argv[i]) + 1;
+        memcpy(p, argv[i], n);
+        p += n;
+    }
+
+    sock = socket(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0);
+    if (sock < 0)
+        return -1;
+
+    strncpy(addr.sun_path, task_server_path, sizeof(addr.sun_path) - 1);
+    if (connect(sock, (struct sockaddr *)&addr, sizeof(addr)) < 0) {
+        close(sock);
+        return -1;
+    }
+
+    int fds[4] = { STDIN_FILENO, STDOUT_FILENO, STDERR_FILENO, memfd };
+    union {
+        char buf[CMSG_SPACE(sizeof(fds))];
+        struct cmsghdr align;
+    } control;
+    struct iovec iov = { .iov_base = request, .iov_len = len };
+    struct msghdr msg = {
+        .msg_iov = &iov,
+        .msg_iovlen = 1,
+        .msg_control = control.buf,
+        .msg_controllen = sizeof(control.buf),
+    };
+    struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msg);
+    cmsg->cmsg_level = SOL_SOCKET;
+    cmsg->cmsg_type = SCM_RIGHTS;
+    cmsg->cmsg_len = CMSG_LEN(sizeof(fds));
+    memcpy(CMSG_DATA(cmsg), fds, sizeof(fds));
+
+    if (sendmsg(sock, &msg, MSG_NOSIGNAL) < 0) {
+        close(sock);
+        return -1;
+    }
+    close(memfd);
+
+    /* From here on, the request is owned by the server */
+    task_server_sock = sock;
+    struct sigaction sa = { .sa_handler = forward_signal, .sa_flags = SA_RESTART };
+    sigemptyset(&sa.sa_mask);
+    sigaction(SIGHUP, &sa, NULL);
+    sigaction(SIGINT, &sa, NULL);
+    sigaction(SIGQUIT, &sa, NULL);
+    sigaction(SIGTERM, &sa, NULL);
+
+    int status;
+    ssize_t ret;
+    do {
+        ret = recv(sock, &status, sizeof(status), 0);
+    } while (ret < 0 && errno == EINTR);
+
+    if (ret != sizeof(status)) {
+        printf("[!] Lost connection to the task server\n");
+        FATAL_ERROR();
+    }
+
+    exit(status);
+}
+
 int main(int argc, char const *argv[])
 {
-    char **env = environ;
-    FILE *f;
+    char *env_buf;
+    size_t env_len;
+    int memfd;
+
+    started_ns = monotonic_ns();
+
+    /* Read-only subcommands that do not need _task at all */
+    if (argc == 2 && !strcmp(argv[1], "id"))
+        try_native_id();
+    if (argc == 2 && !strcmp(argv[1], "info"))
+        try_cached_info();
 
-    /* Open the file we are going to dump the users environ into */
-    f = fopen(env_dump_path, "w");
-    if (!f) {
+    env_buf = serialize_environ(environ, &env_len);
+    if (!env_buf) {
         printf("[!] Error while dumping environment\n");
         FATAL_ERROR();
         exit(1);
     }
 
-    /* Write all environments variables into the dump */
-    size_t elms_written;
-    while (*env) {
-        // We are writing the value including the zero byte which we will
-        // use as delimiter if read back.
-        elms_written = fwrite(*env, strlen(*env) + 1, 1, f);
-        if (elms_written != 1) {
-            printf("[!] Error while writing environment variable\n");
-            FATAL_ERROR();
-            exit(1);
-        }
-
-        env++;
+    memfd = create_environ_memfd(env_buf, env_len);
+    if (memfd < 0 && dump_environ(env_buf, env_len) < 0) {
+        printf("[!] Error while writing environment variable\n");
+        FATAL_ERROR();
+        exit(1);
     }
-    fclose(f);
+    free(env_buf);
 
+    environ_ready_ns = monotonic_ns();
+    snprintf(wrapper_timing_arg, sizeof(wrapper_timing_arg), "--wrapper-timing=%llu:%llu",
+             started_ns, environ_ready_ns);
 
     /* Execute the actual task script  */
 
@@ -48,23 +389,48 @@ int main(int argc, char const *argv[])
 
     assert(argc > 0);
 
+    /* Prefer the already running task server, if there is one */
+    if (memfd >= 0)
+        run_via_task_server(argc, argv, memfd);
+
     int new_argc = argc;
     new_argc -=1; /* We do not care about argv[0] */
     new_argc += 1; /* /usr/bin/sudo */
-    new_argc += 1; /* /bin/ls */
+    new_argc += 2; /* -C <env_fd + 1> */
+    new_argc += 1; /* /usr/local/bin/_task */
+    new_argc += 1; /* --environ-fd=<env_fd> */
+    new_argc += 1; /* --wrapper-timing=<start>:<env> */
     new_argc += 1; /* NULL */
 
     char *new_argv[new_argc];
-    new_argv[0] = "/usr/bin/sudo";
-    new_argv[1] = "/usr/local/bin/_task";
-    new_argv[new_argc-1] = NULL; /* Terminate the array with NULL */
+    char close_from[16];
+    char environ_fd_arg[32];
+    int idx = 0;
+
+    new_argv[idx++] = "/usr/bin/sudo";
+    if (memfd >= 0) {
+        /*
+         * sudo closes all fds >= 3 by default. The sudoers policy allows to
+         * override this for _task (closefrom_override).
+         */
+        snprintf(close_from, sizeof(close_from), "%d", env_fd + 1);
+        new_argv[idx++] = "-C";
+        new_argv[idx++] = close_from;
+    }
+    new_argv[idx++] = "/usr/local/bin/_task";
+    if (memfd >= 0) {
+        snprintf(environ_fd_arg, sizeof(environ_fd_arg), "--environ-fd=%d", env_fd);
+        new_argv[idx++] = environ_fd_arg;
+    }
+    new_argv[idx++] = wrapper_timing_arg;
 
     if (argc > 1) {
         for (int i = 0; i < argc-1; i++) {
             /* We are fine with discarding the const here */
-            new_argv[i+2] = (char*)argv[i+1];
+            new_argv[idx++] = (char*)argv[i+1];
         }
     }
+    new_argv[idx] = NULL; /* Terminate the array with NULL */
 
     return execv("/usr/bin/sudo", new_argv);
 
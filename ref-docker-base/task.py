@@ -1,20 +1,40 @@
 #!/usr/bin/env python3
 
 import argparse
+import ast
+import base64
+import collections
+import contextlib
+import ctypes
+import fcntl
+import hashlib
 import importlib.machinery
 import importlib.util
+import io
+import json
 import logging
 from logging.handlers import RotatingFileHandler
+import math
 import os
+import pickle
+import pwd
+import resource
+import selectors
+import signal
+import socket
+import stat
+import struct
 import sys
+import termios
+import time
 import traceback
 import typing as ty
-import shutil
 from pathlib import Path
-from dataclasses import asdict
+from dataclasses import asdict, dataclass, field
 
 import requests
-from itsdangerous import TimedSerializer
+import zstandard
+from itsdangerous import TimedSerializer, TimestampSigner
 
 from ref_utils import (
     InstanceInfoError,
@@ -26,17 +46,88 @@ from ref_utils import (
 )
 from ref_utils.decorator import run_tests, suppress_run_tests
 
-with open("/etc/key", "rb") as f:
-    KEY = f.read()
-
-with open("/etc/instance_id", "r") as f:  # type: ignore
-    INSTANCE_ID = int(f.read())
+# Set by _load_instance_identity(). These are provisioned by the webapp after
+# the container started, thus they are not read at import time to allow the
+# task server to be started early.
+KEY = b""
+INSTANCE_ID = 0
 
 IS_SUBMISSION = os.path.isfile("/etc/is_submission")
 MAX_TEST_OUTPUT_LENGTH = 1024 * 64
 
 _LOG_PATH = "/var/log/ref-task.log"
 
+# Format of compressed requests (submissions).
+# ! Keep in sync with webapp/ref/services_api/instance.py
+_COMPRESSED_REQUEST_CONTENT_TYPE = "application/zstd"
+_COMPRESSED_REQUEST_SIGNATURE_HEADER = "X-REF-Signature"
+_COMPRESSED_REQUEST_SALT = "from-container-to-web-compressed"
+# ! Keep in sync with webapp/ref/core/timing.py
+_TIMINGS_HEADER = "X-REF-Timings"
+
+# Interval in which the state of a queued submission is polled. The webapp allows
+# 60 requests per minute.
+_SUBMIT_POLL_INTERVAL_S = 1.5
+
+# Environment snapshot written by `task-wrapper.c` if no memfd could be passed.
+_ENVIRON_DUMP_PATH = Path("/tmp/.user_environ")
+# Copy of the snapshot for exercises that set EXPORT_USER_ENVIRON.
+_HOME_ENVIRON_PATH = Path("/home/user/.user_environ")
+
+# Raw environment snapshot (NUL separated) of the user that invoked `task`.
+_user_environ_raw = b""
+
+# Socket the task server (`_task --serve`) listens on. `task-wrapper.c` falls
+# back to `sudo _task` if it is not reachable.
+_SERVER_SOCKET_PATH = "/run/ref-task.sock"
+# Upper bound for the argv message sent by `task-wrapper.c`.
+_SERVER_MAX_REQUEST_SIZE = 64 * 1024
+# The only user besides root that is allowed to use the server (see sudoers).
+_SERVER_ALLOWED_USER = "user"
+# Signals `task-wrapper.c` forwards to the process group running the request.
+_SERVER_FORWARDED_SIGNALS = {
+    signal.SIGHUP,
+    signal.SIGINT,
+    signal.SIGQUIT,
+    signal.SIGTERM,
+}
+# Rendered output of `task info`, which `task-wrapper.c` prints without calling
+# _task as long as it is fresh.
+_INFO_CACHE_PATH = Path("/run/ref-task/info")
+# Keep in sync with INFO_CACHE_TTL_S in task-wrapper.c
+_INFO_CACHE_TTL_S = 300
+# Ring buffer my-shell records its invocations in while `task trace` is on.
+# ! Keep in sync with TRACE_* in my-shell.c
+_TRACE_PATH = Path("/dev/shm/ref-shell-trace")
+_TRACE_MAGIC = 0x54485352
+_TRACE_VERSION = 1
+_TRACE_CAPACITY = 4096
+# magic, version, capacity, entry_size, head
+_TRACE_HEADER = struct.Struct("=IIIIQ40x")
+# seq, start_ns, pid, ppid, uid, hash, argc, args
+_TRACE_ENTRY = struct.Struct("=QQIIIII92s")
+# Results of `task check` for tasks that declare their inputs via TASK_INPUTS.
+# Only accessible by root, such that students can not forge results.
+_CHECK_CACHE_DIR = Path("/var/cache/ref-task/check")
+_HOME_DIR = Path("/home/user")
+# Read-only ccache of the objects compiled while building the image of
+# exercises that enable compiler-cache (e.g., their harness).
+# ! Keep in sync with webapp/ref/core/image.py
+_COMPILER_CACHE_EXERCISE_DIR = Path("/var/cache/ref/ccache")
+# Writable ccache of the objects compiled by the tests of this instance.
+# Only accessible by root, such that students can not inject objects.
+_COMPILER_CACHE_DIR = Path("/var/cache/ref-task/ccache")
+_COMPILER_CACHE_MAX_SIZE = "1G"
+# Limits a task can declare via TASK_LIMITS.
+_TASK_LIMIT_KEYS = ("cpu_s", "memory_mb", "wall_s")
+# Usage of this process and of its children, see _accounted_task().
+_RUSAGE_WHO = (resource.RUSAGE_SELF, resource.RUSAGE_CHILDREN)
+# Interval in which the memory used by tasks with a memory limit is checked.
+_MEMORY_LIMIT_POLL_INTERVAL_S = 0.1
+
+# Variables of the user's environment that are passed like `sudo` does by default.
+_SERVER_ENV_KEEP = ("TERM", "COLORTERM", "LANG", "LANGUAGE", "COLUMNS", "LINES")
+
 
 class _SecureRotatingFileHandler(RotatingFileHandler):
     """RotatingFileHandler that enforces 0600 permissions on every file it creates."""
@@ -58,6 +149,79 @@ _log_handler.setFormatter(logging.Formatter("%(asctime)s %(levelname)s %(message
 _error_logger.addHandler(_log_handler)
 
 
+class _Timings:
+    """
+    Durations (ns) of the phases of the current command, measured with
+    CLOCK_MONOTONIC. They are sent along with a submission and aggregated by
+    the webapp (see webapp/ref/core/timing.py). The phases are:
+
+    wrapper_env: Snapshotting the environment in task-wrapper.c.
+    launch: sudo and the Python startup, or the task server forking the runner.
+    load_tests: Importing submission_tests.
+    tests: Running the tests, the duration of each task is recorded if tasks
+        are run by workers.
+    sign: Serializing, compressing, and signing the submission.
+    """
+
+    def __init__(self):
+        self.phases: ty.Dict[str, int] = {}
+        self.tasks: ty.Dict[str, int] = {}
+
+    @contextlib.contextmanager
+    def phase(self, name: str) -> ty.Iterator[None]:
+        start = time.monotonic_ns()
+        try:
+            yield
+        finally:
+            self.phases[name] = self.phases.get(name, 0) + time.monotonic_ns() - start
+
+    def record_launch(self, wrapper_timing: ty.Optional[str], main_started_ns: int):
+        """
+        Record the phases before main() from the --wrapper-timing=<start>:<env>
+        timestamps passed by task-wrapper.c.
+        """
+        if wrapper_timing is None:
+            return
+        try:
+            started_ns, environ_ready_ns = map(int, wrapper_timing.split(":"))
+        except ValueError:
+            return
+        if not started_ns <= environ_ready_ns <= main_started_ns:
+            return
+        self.phases["wrapper_env"] = environ_ready_ns - started_ns
+        self.phases["launch"] = main_started_ns - environ_ready_ns
+
+    def header(self) -> str:
+        """
+        Value of the timings header. `sent_ns` allows the webapp to compute
+        the time the request took to arrive, since all containers share the
+        host's monotonic clock.
+        """
+        return json.dumps(
+            {
+                "phases": self.phases,
+                "tasks": self.tasks,
+                "sent_ns": time.monotonic_ns(),
+            }
+        )
+
+
+_timings = _Timings()
+
+# Resources used by each task (see _task_resource_usage() and _accounted_task()).
+# They are sent along with a submission and shown in the grading view.
+_resource_usage: ty.Dict[str, ty.Dict[str, ty.Any]] = {}
+
+
+def _load_instance_identity() -> None:
+    global KEY, INSTANCE_ID
+    with open("/etc/key", "rb") as f:
+        KEY = f.read()
+
+    with open("/etc/instance_id", "r") as f:
+        INSTANCE_ID = int(f.read())
+
+
 def finalize_request(req):
     signer = TimedSerializer(KEY, salt="from-container-to-web")
     req["instance_id"] = INSTANCE_ID
@@ -65,6 +229,23 @@ def finalize_request(req):
     return req
 
 
+def finalize_compressed_request(req) -> ty.Tuple[bytes, ty.Dict[str, str]]:
+    """
+    Compress `req` with zstd and sign the digest of the compressed body.
+    Returns the body and the headers to send it with (see
+    _unwrap_compressed_container_request() in the webapp).
+    """
+    req["instance_id"] = INSTANCE_ID
+    body = zstandard.ZstdCompressor().compress(json.dumps(req).encode())
+    signer = TimestampSigner(KEY, salt=_COMPRESSED_REQUEST_SALT)
+    token = signer.sign(f"{INSTANCE_ID}:{hashlib.sha256(body).hexdigest()}")
+    headers = {
+        "Content-Type": _COMPRESSED_REQUEST_CONTENT_TYPE,
+        _COMPRESSED_REQUEST_SIGNATURE_HEADER: token.decode(),
+    }
+    return body, headers
+
+
 def server_post(url: str, **kwargs) -> requests.Response:
     """POST to the submission server, handling connection errors gracefully."""
     try:
@@ -143,8 +324,65 @@ def cmd_reset(_):
     handle_response(res)
 
 
+def _read_user_environ(fd: ty.Optional[int]) -> bytes:
+    """
+    Read the environment snapshot taken by `task-wrapper.c`. If the wrapper
+    passed a sealed memfd via --environ-fd, the snapshot is read from it,
+    else we fall back to the dump in /tmp.
+    """
+    if fd is None:
+        try:
+            return _ENVIRON_DUMP_PATH.read_bytes()
+        except OSError:
+            return b""
+
+    try:
+        # The fd is supplied by the user, only accept memfds that can not be
+        # modified anymore.
+        seals = fcntl.fcntl(fd, fcntl.F_GET_SEALS)
+        required = fcntl.F_SEAL_WRITE | fcntl.F_SEAL_GROW | fcntl.F_SEAL_SHRINK
+        if seals & required != required:
+            raise ValueError(f"fd {fd} is not sealed")
+        return os.pread(fd, os.fstat(fd).st_size, 0)
+    except (OSError, ValueError):
+        _error_logger.error("Invalid environment fd:\n%s", traceback.format_exc())
+        print_err("[!] Failed to read your environment.")
+        exit(1)
+    finally:
+        try:
+            os.close(fd)
+        except OSError:
+            pass
+
+
+def _parse_user_environ(raw: bytes) -> ty.Dict[str, str]:
+    environ = {}
+    for entry in raw.split(b"\0"):
+        if b"=" not in entry:
+            continue
+        key, value = entry.split(b"=", 1)
+        environ[os.fsdecode(key)] = os.fsdecode(value)
+    return environ
+
+
+def _export_user_environ(raw: bytes) -> None:
+    """Store the snapshot at _HOME_ENVIRON_PATH for exercises reading it from disk."""
+    # Do not follow symlinks, the user controls /home/user.
+    _HOME_ENVIRON_PATH.unlink(missing_ok=True)
+    fd = os.open(
+        _HOME_ENVIRON_PATH, os.O_WRONLY | os.O_CREAT | os.O_EXCL | os.O_NOFOLLOW, 0o644
+    )
+    with os.fdopen(fd, "wb") as f:
+        f.write(raw)
+
+
 def _load_submission_tests_module() -> ty.Any:
-    """Load the submission_tests script as a Python module."""
+    """
+    Load the submission_tests script as a Python module.
+    The user's environment snapshot is available to the script as the global
+    USER_ENVIRON. If the script sets EXPORT_USER_ENVIRON = True, the snapshot
+    is additionally stored at /home/user/.user_environ.
+    """
     test_path = Path("/usr/local/bin/submission_tests")
     if not test_path.exists():
         return None
@@ -157,71 +395,968 @@ def _load_submission_tests_module() -> ty.Any:
         return None
 
     module = importlib.util.module_from_spec(spec)
+    module.USER_ENVIRON = _parse_user_environ(_user_environ_raw)
     sys.modules["submission_tests"] = module
     spec.loader.exec_module(module)
+
+    if getattr(module, "EXPORT_USER_ENVIRON", False) and not IS_SUBMISSION:
+        _export_user_environ(_user_environ_raw)
+
     return module
 
 
+class _OutputLimitExceeded(BaseException):
+    """
+    Raised by _OutputCapture to stop testing. This is a BaseException, such
+    that it is not swallowed by `except Exception` handlers in tests.
+    """
+
+
+class _OutputCapture:
+    """
+    Bounded buffer for the test output that is submitted. If the output
+    exceeds `limit` characters, only its beginning and its end are kept
+    (about `limit` / 2 characters each) and `exceeded` is set. If `abort` is
+    set, writes beyond the limit raise _OutputLimitExceeded.
+    """
+
+    def __init__(self, limit: int = MAX_TEST_OUTPUT_LENGTH, abort: bool = False):
+        self.abort = abort
+        self.length = 0
+        self._head_limit = limit // 2
+        self._tail_limit = limit - self._head_limit
+        self._limit = limit
+        self._head: ty.List[str] = []
+        self._head_length = 0
+        self._tail: ty.Deque[str] = collections.deque()
+        self._tail_length = 0
+
+    @property
+    def exceeded(self) -> bool:
+        return self.length > self._limit
+
+    def write(self, text: str) -> int:
+        self._store(text)
+        self.length += len(text)
+        if self.abort and self.exceeded:
+            raise _OutputLimitExceeded()
+        return len(text)
+
+    def extend(self, text: str, length: int) -> None:
+        """Append the (possibly truncated) `text` of an output of `length`."""
+        self._store(text)
+        self.length += length
+        if self.abort and self.exceeded:
+            raise _OutputLimitExceeded()
+
+    def _store(self, text: str) -> None:
+        if self._head_length < self._head_limit:
+            head = text[: self._head_limit - self._head_length]
+            self._head.append(head)
+            self._head_length += len(head)
+            text = text[len(head) :]
+        if not text:
+            return
+
+        self._tail.append(text)
+        self._tail_length += len(text)
+        while self._tail_length - len(self._tail[0]) >= self._tail_limit:
+            self._tail_length -= len(self._tail.popleft())
+        if self._tail_length > self._tail_limit:
+            excess = self._tail_length - self._tail_limit
+            self._tail[0] = self._tail[0][excess:]
+            self._tail_length -= excess
+
+    def getvalue(self) -> str:
+        head = "".join(self._head)
+        tail = "".join(self._tail)
+        omitted = self.length - len(head) - len(tail)
+        if omitted > 0:
+            return f"{head}\n[... {omitted} characters omitted ...]\n{tail}"
+        return head + tail
+
+
+class _TeeWriter:
+    """Write to both stdout and a capture buffer."""
+
+    def __init__(self, original: ty.TextIO, capture: _OutputCapture):
+        self.original = original
+        self.capture = capture
+
+    def write(self, text: str) -> int:
+        self.original.write(text)
+        self.capture.write(text)
+        return len(text)
+
+    def flush(self) -> None:
+        self.original.flush()
+
+
+# Keep in sync with webapp/ref/core/task_discovery.py
+_TASK_DECORATORS = frozenset(
+    {
+        "submission_test",
+        "environment_test",
+        "extended_submission_test",
+        "add_submission_test",
+        "add_environment_test",
+        "add_extended_submission_test",
+    }
+)
+_DEFAULT_TASK_NAME = "default"
+
+
+def _discover_task_names(test_path: Path) -> ty.Optional[ty.List[str]]:
+    """
+    Return the task names registered by the submission_tests script in order
+    of their first declaration, or None if they can not be determined
+    statically (e.g., because a task_name is not a literal).
+    """
+    try:
+        tree = ast.parse(test_path.read_text(), filename=str(test_path))
+    except (OSError, SyntaxError):
+        return None
+
+    names: ty.Dict[str, None] = {}
+    functions = [
+        n
+        for n in ast.walk(tree)
+        if isinstance(n, (ast.FunctionDef, ast.AsyncFunctionDef))
+    ]
+    for node in sorted(functions, key=lambda n: n.lineno):
+        for decorator in node.decorator_list:
+            func = decorator.func if isinstance(decorator, ast.Call) else decorator
+            name = getattr(func, "id", None) or getattr(func, "attr", None)
+            if name not in _TASK_DECORATORS:
+                continue
+            if not isinstance(decorator, ast.Call):
+                names.setdefault(_DEFAULT_TASK_NAME)
+                continue
+            arg = decorator.args[0] if decorator.args else None
+            for kw in decorator.keywords:
+                if kw.arg == "task_name":
+                    arg = kw.value
+            if arg is None:
+                names.setdefault(_DEFAULT_TASK_NAME)
+            elif isinstance(arg, ast.Constant) and isinstance(arg.value, str):
+                names.setdefault(arg.value)
+            else:
+                return None
+    return list(names)
+
+
+def _default_jobs() -> int:
+    """Number of CPUs the container may use according to its cgroup CPU quota."""
+    try:
+        quota, period = Path("/sys/fs/cgroup/cpu.max").read_text().split()
+        if quota != "max":
+            return max(1, math.ceil(int(quota) / int(period)))
+    except (OSError, ValueError):
+        pass
+    return os.cpu_count() or 1
+
+
+def _task_limits(module: ty.Any) -> ty.Dict[str, ty.Dict[str, float]]:
+    """
+    The per-task limits declared via TASK_LIMITS, which maps task names to
+    {"cpu_s": .., "memory_mb": .., "wall_s": ..} (all optional). Invalid
+    entries are ignored.
+    """
+    declared = getattr(module, "TASK_LIMITS", None) or {}
+    if not isinstance(declared, dict):
+        print_warn("[!] Ignoring TASK_LIMITS, since it is not a dict")
+        return {}
+
+    limits = {}
+    for task_name, task_limits in declared.items():
+        if not isinstance(task_limits, dict):
+            print_warn(f"[!] Ignoring TASK_LIMITS of task {task_name}")
+            continue
+        limits[task_name] = {
+            k: float(v)
+            for k, v in task_limits.items()
+            if k in _TASK_LIMIT_KEYS
+            and isinstance(v, (int, float))
+            and not isinstance(v, bool)
+            and v > 0
+        }
+    return limits
+
+
+def _apply_task_limits(limits: ty.Dict[str, float]) -> None:
+    """
+    Apply the CPU time limit of a task to the calling worker. The limit is
+    inherited by every process started by the tests, but applies to each
+    process individually. The memory limit is enforced by the parent (see
+    _run_tests_parallel()).
+    """
+    if "cpu_s" in limits:
+        # SIGXCPU at the soft limit, SIGKILL at the hard limit.
+        cpu_s = math.ceil(limits["cpu_s"])
+        resource.setrlimit(resource.RLIMIT_CPU, (cpu_s, cpu_s + 1))
+
+
+def _process_group_rss_kb(pgid: int) -> int:
+    """
+    RSS of all processes in the process group `pgid`, except for its leader
+    (i.e., the processes started by a worker, but not the worker itself).
+    """
+    page_kb = os.sysconf("SC_PAGE_SIZE") // 1024
+    total = 0
+    for stat_path in Path("/proc").glob("[0-9]*/stat"):
+        try:
+            content = stat_path.read_text()
+        except OSError:
+            continue
+        # The name is enclosed in parentheses and may contain spaces.
+        fields = content[content.rindex(")") + 2 :].split()
+        # pgrp and rss are the 5th and 24th field of the full line.
+        if int(fields[2]) == pgid and int(stat_path.parent.name) != pgid:
+            total += int(fields[21]) * page_kb
+    return total
+
+
+def _memory_limit_description(memory_mb: float) -> str:
+    return f"the memory limit of {memory_mb:g} MiB"
+
+
+def _open_worker_output() -> ty.Tuple[int, int]:
+    """
+    Create the channel for the output of a worker, a pty if our stdout is a
+    terminal (thus tested programs behave as they do in-process), otherwise a
+    pipe. Returns (read end, worker end).
+    """
+    if not os.isatty(1):
+        return os.pipe()
+    master, slave = os.openpty()
+    # Pass newlines through unchanged, our terminal translates them.
+    attrs = termios.tcgetattr(slave)
+    attrs[1] &= ~termios.ONLCR
+    termios.tcsetattr(slave, termios.TCSANOW, attrs)
+    try:
+        size = fcntl.ioctl(1, termios.TIOCGWINSZ, bytes(8))
+        fcntl.ioctl(slave, termios.TIOCSWINSZ, size)
+    except OSError:
+        pass
+    return master, slave
+
+
+def _start_task_worker(
+    task_name: str,
+    result_will_be_submitted: bool,
+    abort_on_output_limit: bool,
+    limits: ty.Optional[ty.Dict[str, float]] = None,
+) -> ty.Tuple[int, int, int]:
+    """
+    Fork a worker that runs the tests of `task_name`. Everything the worker
+    writes to stdout/stderr (including output of its child processes) is
+    sent through a pty or pipe (see _open_worker_output()). The captured
+    Python-level output and the results are pickled into a memfd, just like
+    _run_tests() would have captured them, together with the peak RSS of the
+    processes the tests waited for. If the output limit is hit and
+    `abort_on_output_limit` is set, the results are None.
+    The worker runs in its own process group (with the worker's PID as ID),
+    thus it can be killed along with all processes it started.
+    Returns (pid, output_fd, result_fd), output_fd is non-blocking.
+    """
+    output_fd, worker_fd = _open_worker_output()
+    os.set_blocking(output_fd, False)
+    result_fd = os.memfd_create(f"task-{task_name}-result")
+
+    sys.stdout.flush()
+    sys.stderr.flush()
+    pid = os.fork()
+    if pid != 0:
+        os.close(worker_fd)
+        # Also done by the worker, whichever runs first.
+        try:
+            os.setpgid(pid, pid)
+        except OSError:
+            pass
+        return pid, output_fd, result_fd
+
+    code = 1
+    try:
+        os.setpgid(0, 0)
+        signal.set_wakeup_fd(-1)
+        signal.signal(signal.SIGCHLD, signal.SIG_DFL)
+        _apply_task_limits(limits or {})
+        os.close(output_fd)
+        devnull = os.open(os.devnull, os.O_RDONLY)
+        os.dup2(devnull, 0)
+        os.dup2(worker_fd, 1)
+        os.dup2(worker_fd, 2)
+        os.close(worker_fd)
+
+        capture = _OutputCapture(abort=abort_on_output_limit)
+        terminal = io.TextIOWrapper(
+            open(1, "wb", buffering=0, closefd=False), write_through=True
+        )
+        sys.stdout = _TeeWriter(terminal, capture)  # type: ignore[assignment]
+        sys.stderr = sys.stdout
+
+        test_results = None
+        try:
+            test_results = run_tests(
+                result_will_be_submitted=result_will_be_submitted,
+                only_run_these_tasks=[task_name],
+            )
+        except _OutputLimitExceeded:
+            pass
+        with open(result_fd, "wb", closefd=False) as f:
+            peak_rss_kb = resource.getrusage(resource.RUSAGE_CHILDREN).ru_maxrss
+            result = (capture.getvalue(), capture.length, test_results, peak_rss_kb)
+            pickle.dump(result, f)
+        code = 0
+    except BaseException:
+        traceback.print_exc(file=sys.__stderr__)
+    finally:
+        os._exit(code)
+
+
+@dataclass
+class _TaskRun:
+    """Outcome of running the tests of a single task in a worker."""
+
+    task_name: str
+    # The beginning of everything written to the terminal, including output of
+    # child processes (see _Worker).
+    output: bytes
+    # Python-level output, as captured by _run_tests(), and its full length.
+    captured_output: str
+    captured_length: int
+    results: ty.List[TaskTestResult]
+    from_cache: bool = False
+    output_limit_exceeded: bool = False
+
+
+def _replay_output(output: bytes) -> None:
+    sys.stdout.flush()
+    sys.stderr.flush()
+    sys.stdout.buffer.write(output)
+    sys.stdout.flush()
+
+
+@dataclass
+class _Worker:
+    """
+    A running worker (see _start_task_worker()). The output of the worker
+    whose task is next in order is streamed to the terminal. Output of the
+    other workers is buffered until it is their turn. Only the first
+    MAX_TEST_OUTPUT_LENGTH bytes are kept, the rest of the buffered output is
+    omitted. The kept output is also recorded in the check cache. Output
+    written after the worker exited (e.g., by daemons started by the tests)
+    is not shown.
+    """
+
+    idx: int
+    pid: int
+    output_fd: int
+    result_fd: int
+    started_ns: int
+    output: bytearray = field(default_factory=bytearray)
+    # Bytes of `output` that were written to the terminal.
+    streamed: int = 0
+    # Bytes that did not fit into `output`.
+    omitted: int = 0
+    live: bool = False
+    exit_code: ty.Optional[int] = None
+
+    def read(self) -> bool:
+        """Consume the available output. Returns False once it is closed."""
+        while True:
+            try:
+                data = os.read(self.output_fd, 64 * 1024)
+            except BlockingIOError:
+                return True
+            except OSError:
+                # EIO once all processes closed the pty.
+                return False
+            if not data:
+                return False
+            kept = data[: max(0, MAX_TEST_OUTPUT_LENGTH - len(self.output))]
+            self.output += kept
+            self.omitted += len(data) - len(kept)
+            if self.live:
+                _replay_output(data)
+                self.streamed = len(self.output)
+
+    def go_live(self) -> None:
+        """Write the buffered output and stream everything that follows."""
+        self.live = True
+        output = bytes(self.output[self.streamed :])
+        if self.omitted:
+            output += self.omitted_note()
+        _replay_output(output)
+        self.streamed = len(self.output)
+
+    def omitted_note(self) -> bytes:
+        return f"\n[... {self.omitted} bytes of output omitted ...]\n".encode()
+
+    def recorded_output(self) -> bytes:
+        if self.omitted:
+            return bytes(self.output) + self.omitted_note()
+        return bytes(self.output)
+
+
+def _task_resource_usage(rusage: ty.Any, wall_ns: int) -> ty.Dict[str, ty.Any]:
+    """
+    Resources used by a worker and all processes it waited for, as returned
+    by wait4(). I/O only covers block device I/O, reads served from the page
+    cache are not accounted.
+    """
+    return {
+        "cpu_ms": round((rusage.ru_utime + rusage.ru_stime) * 1000, 3),
+        "max_rss_kb": rusage.ru_maxrss,
+        "read_bytes": rusage.ru_inblock * 512,
+        "write_bytes": rusage.ru_oublock * 512,
+        "wall_ms": round(wall_ns / 1e6, 3),
+    }
+
+
+@contextlib.contextmanager
+def _accounted_task(task_name: str) -> ty.Iterator[None]:
+    """
+    Record the resources used by a task that runs in this process, i.e., the
+    difference of the usage of this process and all processes it waited for.
+    The peak RSS is only known if a process started by the task exceeded the
+    peak RSS of all processes waited for before, thus it is omitted otherwise.
+    """
+    before = [resource.getrusage(r) for r in _RUSAGE_WHO]
+    start_ns = time.monotonic_ns()
+    try:
+        yield
+    finally:
+        wall_ns = time.monotonic_ns() - start_ns
+        after = [resource.getrusage(r) for r in _RUSAGE_WHO]
+
+        def delta(counter: str) -> float:
+            return sum(
+                getattr(a, counter) - getattr(b, counter) for a, b in zip(after, before)
+            )
+
+        usage = {
+            "cpu_ms": round((delta("ru_utime") + delta("ru_stime")) * 1000, 3),
+            "read_bytes": int(delta("ru_inblock")) * 512,
+            "write_bytes": int(delta("ru_oublock")) * 512,
+            "wall_ms": round(wall_ns / 1e6, 3),
+        }
+        if after[1].ru_maxrss > before[1].ru_maxrss:
+            usage["max_rss_kb"] = after[1].ru_maxrss
+        _timings.tasks[task_name] = wall_ns
+        _resource_usage[task_name] = usage
+
+
+def _kill_worker(pid: int) -> None:
+    try:
+        os.killpg(pid, signal.SIGKILL)
+    except ProcessLookupError:
+        pass
+
+
+def _run_tests_parallel(
+    task_names: ty.List[str],
+    jobs: int,
+    result_will_be_submitted: bool,
+    cached: ty.Optional[ty.Dict[str, _TaskRun]] = None,
+    abort_on_output_limit: bool = False,
+    limits: ty.Optional[ty.Dict[str, ty.Dict[str, float]]] = None,
+) -> ty.List[_TaskRun]:
+    """
+    Run each task in its own worker process, at most `jobs` at a time.
+    Output and results are emitted in order of `task_names` (see _Worker),
+    thus the result does not depend on scheduling.
+    Tasks contained in `cached` are not run; their recorded output is
+    replayed instead. If `abort_on_output_limit` is set, no further tasks
+    are run once the captured output of all tasks exceeds the limit.
+    Tasks are subject to their `limits` (see _task_limits()) and the
+    resources used by each are recorded in _resource_usage.
+    """
+    cached = cached or {}
+    limits = limits or {}
+    pending = [(i, n) for i, n in enumerate(task_names) if n not in cached]
+    running: ty.Dict[int, _Worker] = {}
+    deadlines: ty.Dict[int, float] = {}
+    finished: ty.Dict[int, _Worker] = {}
+    # Index -> description of the limit a task exceeded.
+    exceeded_limits: ty.Dict[int, str] = {}
+    next_idx = 0
+    task_runs: ty.List[_TaskRun] = []
+    captured_length = 0
+    aborted = False
+    next_memory_check = 0.0
+
+    def emit_finished() -> None:
+        nonlocal next_idx, captured_length, aborted
+        while next_idx < len(task_names) and not aborted:
+            name = task_names[next_idx]
+            if name in cached:
+                print_ok(
+                    f"[+] Inputs of task {name} did not change, showing the previous"
+                    " result (use --full to rerun)"
+                )
+                _replay_output(cached[name].output)
+                task_runs.append(cached[name])
+                next_idx += 1
+                continue
+            if next_idx not in finished:
+                for worker in running.values():
+                    if worker.idx == next_idx and not worker.live:
+                        worker.go_live()
+                return
+
+            worker = finished.pop(next_idx)
+            next_idx += 1
+            if not worker.live:
+                worker.go_live()
+            output = worker.recorded_output()
+
+            with open(worker.result_fd, "rb") as f:
+                f.seek(0)
+                data = f.read()
+            result = None
+            if worker.exit_code == 0 and data:
+                result = pickle.loads(data)
+                memory_mb = limits.get(name, {}).get("memory_mb")
+                # Catches processes that exceeded the limit between two checks.
+                if memory_mb is not None and result[3] > memory_mb * 1024:
+                    exceeded_limits.setdefault(
+                        worker.idx, _memory_limit_description(memory_mb)
+                    )
+                    _resource_usage[name]["exceeded_limit"] = exceeded_limits[
+                        worker.idx
+                    ]
+
+            if worker.idx in exceeded_limits or result is None:
+                if worker.idx in exceeded_limits:
+                    msg = (
+                        f"[!] The tests of task {name} were stopped, since they"
+                        f" exceeded {exceeded_limits[worker.idx]}"
+                    )
+                else:
+                    _error_logger.error(
+                        "Worker for task %s exited with %d", name, worker.exit_code
+                    )
+                    msg = f"[!] Failed to run the tests of task {name}"
+                print_err(msg)
+                failed = TaskTestResult(task_name=name, success=False, score=None)
+                task_runs.append(
+                    _TaskRun(name, output, msg + "\n", len(msg) + 1, [failed])
+                )
+                continue
+
+            captured_output, length, results, _ = result
+            captured_length += length
+            exceeded = results is None
+            if exceeded:
+                results = [TaskTestResult(task_name=name, success=False, score=None)]
+            task_runs.append(
+                _TaskRun(
+                    name,
+                    output,
+                    captured_output,
+                    length,
+                    results,
+                    output_limit_exceeded=exceeded,
+                )
+            )
+            if abort_on_output_limit and (
+                exceeded or captured_length > MAX_TEST_OUTPUT_LENGTH
+            ):
+                aborted = True
+
+    # Exits of workers wake up the selector, like in _serve_connection().
+    sel = selectors.DefaultSelector()
+    wakeup_r, wakeup_w = os.pipe2(os.O_NONBLOCK | os.O_CLOEXEC)
+    sel.register(wakeup_r, selectors.EVENT_READ)
+    previous_handler = signal.signal(signal.SIGCHLD, lambda *_: None)
+    previous_wakeup_fd = signal.set_wakeup_fd(wakeup_w)
+
+    def close_output(worker: _Worker) -> None:
+        if worker.output_fd >= 0:
+            sel.unregister(worker.output_fd)
+            os.close(worker.output_fd)
+            worker.output_fd = -1
+
+    try:
+        emit_finished()
+        while (pending or running) and not aborted:
+            while pending and len(running) < jobs:
+                idx, name = pending.pop(0)
+                task_limits = limits.get(name, {})
+                pid, output_fd, result_fd = _start_task_worker(
+                    name, result_will_be_submitted, abort_on_output_limit, task_limits
+                )
+                worker = _Worker(idx, pid, output_fd, result_fd, time.monotonic_ns())
+                running[pid] = worker
+                sel.register(output_fd, selectors.EVENT_READ, worker)
+                if "wall_s" in task_limits:
+                    deadlines[pid] = time.monotonic() + task_limits["wall_s"]
+            emit_finished()
+
+            timeout = None
+            if deadlines:
+                timeout = max(0.0, min(deadlines.values()) - time.monotonic())
+            # PID -> memory limit of the workers that are still checked.
+            memory_limits = {}
+            for pid, worker in running.items():
+                task_limits = limits.get(task_names[worker.idx], {})
+                if "memory_mb" in task_limits and worker.idx not in exceeded_limits:
+                    memory_limits[pid] = task_limits["memory_mb"]
+            if memory_limits:
+                timeout = max(
+                    0.0,
+                    min(
+                        next_memory_check - time.monotonic(),
+                        math.inf if timeout is None else timeout,
+                    ),
+                )
+            for key, _ in sel.select(timeout):
+                if key.data is None:
+                    try:
+                        while os.read(wakeup_r, 64):
+                            pass
+                    except BlockingIOError:
+                        pass
+                elif not key.data.read():
+                    close_output(key.data)
+
+            now = time.monotonic()
+            for pid, deadline in list(deadlines.items()):
+                if deadline <= now:
+                    _kill_worker(pid)
+                    del deadlines[pid]
+                    wall_s = limits[task_names[running[pid].idx]]["wall_s"]
+                    exceeded_limits[running[pid].idx] = f"the time limit of {wall_s:g}s"
+
+            if memory_limits and now >= next_memory_check:
+                next_memory_check = now + _MEMORY_LIMIT_POLL_INTERVAL_S
+            else:
+                memory_limits = {}
+            for pid, memory_mb in memory_limits.items():
+                idx = running[pid].idx
+                if idx not in exceeded_limits and (
+                    _process_group_rss_kb(pid) > memory_mb * 1024
+                ):
+                    _kill_worker(pid)
+                    deadlines.pop(pid, None)
+                    exceeded_limits[idx] = _memory_limit_description(memory_mb)
+
+            while running:
+                pid, status, rusage = os.wait4(-1, os.WNOHANG)
+                if pid == 0:
+                    break
+                if pid not in running:
+                    continue
+                worker = running.pop(pid)
+                deadlines.pop(pid, None)
+                # Processes left running by the tests may keep the output open.
+                worker.read()
+                close_output(worker)
+                idx = worker.idx
+                name = task_names[idx]
+                # SIGXCPU is sent at the soft limit, SIGKILL at the hard limit.
+                if (
+                    os.WIFSIGNALED(status)
+                    and "cpu_s" in limits.get(name, {})
+                    and (
+                        os.WTERMSIG(status) == signal.SIGXCPU
+                        or os.WTERMSIG(status) == signal.SIGKILL
+                        and rusage.ru_utime + rusage.ru_stime >= limits[name]["cpu_s"]
+                    )
+                ):
+                    exceeded_limits.setdefault(
+                        idx, f"the CPU time limit of {limits[name]['cpu_s']:g}s"
+                    )
+                worker.exit_code = os.waitstatus_to_exitcode(status)
+                finished[idx] = worker
+                wall_ns = time.monotonic_ns() - worker.started_ns
+                _timings.tasks[name] = wall_ns
+                _resource_usage[name] = _task_resource_usage(rusage, wall_ns)
+                if idx in exceeded_limits:
+                    _resource_usage[name]["exceeded_limit"] = exceeded_limits[idx]
+            emit_finished()
+    finally:
+        signal.set_wakeup_fd(previous_wakeup_fd)
+        signal.signal(signal.SIGCHLD, previous_handler)
+        for pid, worker in running.items():
+            _kill_worker(pid)
+            os.waitpid(pid, 0)
+            close_output(worker)
+            os.close(worker.result_fd)
+        for worker in finished.values():
+            os.close(worker.result_fd)
+        sel.close()
+        os.close(wakeup_r)
+        os.close(wakeup_w)
+
+    return task_runs
+
+
+def _hash_task_inputs(
+    test_path: Path, task_name: str, patterns: ty.Union[str, ty.Sequence[str]]
+) -> str:
+    """
+    Hash the test script, the task name, and all files matched by
+    `patterns` (globs relative to /home/user). Only regular files inside
+    /home/user are considered, symlinks are resolved.
+    """
+    if isinstance(patterns, str):
+        patterns = [patterns]
+
+    h = hashlib.sha256()
+    h.update(test_path.read_bytes())
+    h.update(b"\0" + task_name.encode() + b"\0")
+    for pattern in sorted(patterns):
+        h.update(b"P" + pattern.encode() + b"\0")
+        for path in sorted(_HOME_DIR.glob(pattern)):
+            try:
+                resolved = path.resolve(strict=True)
+                st = resolved.stat()
+            except (OSError, RuntimeError):
+                h.update(b"M" + str(path).encode() + b"\0")
+                continue
+            if not resolved.is_relative_to(_HOME_DIR) or not stat.S_ISREG(st.st_mode):
+                continue
+            h.update(b"F" + str(path).encode() + b"\0")
+            h.update(struct.pack("<IQ", stat.S_IMODE(st.st_mode), st.st_size))
+            with resolved.open("rb") as f:
+                h.update(hashlib.file_digest(f, "sha256").digest())
+    return h.hexdigest()
+
+
+def _check_cache_path(task_name: str) -> Path:
+    return _CHECK_CACHE_DIR / hashlib.sha256(task_name.encode()).hexdigest()
+
+
+def _load_cached_task_run(task_name: str, inputs_hash: str) -> ty.Optional[_TaskRun]:
+    try:
+        entry = json.loads(_check_cache_path(task_name).read_text())
+        if entry["inputs_hash"] != inputs_hash:
+            return None
+        return _TaskRun(
+            task_name=task_name,
+            output=base64.b64decode(entry["output"]),
+            captured_output=entry["captured_output"],
+            captured_length=len(entry["captured_output"]),
+            results=[TaskTestResult(**r) for r in entry["results"]],
+            from_cache=True,
+        )
+    except FileNotFoundError:
+        return None
+    except (OSError, ValueError, KeyError, TypeError):
+        _error_logger.error("Invalid check cache entry:\n%s", traceback.format_exc())
+        return None
+
+
+def _store_cached_task_run(task_run: _TaskRun, inputs_hash: str) -> None:
+    entry = {
+        "inputs_hash": inputs_hash,
+        "output": base64.b64encode(task_run.output).decode(),
+        "captured_output": task_run.captured_output,
+        "results": [asdict(r) for r in task_run.results],
+    }
+    path = _check_cache_path(task_run.task_name)
+    try:
+        _CHECK_CACHE_DIR.mkdir(mode=0o700, parents=True, exist_ok=True)
+        tmp = path.with_name(f".{path.name}.{os.getpid()}")
+        tmp.write_text(json.dumps(entry))
+        os.replace(tmp, path)
+    except OSError:
+        _error_logger.error("Failed to write check cache:\n%s", traceback.format_exc())
+
+
+def _enable_compiler_cache() -> None:
+    """
+    Make compilers invoked by the tests (via PATH) use ccache, if the
+    exercise enables compiler-cache. Objects are looked up in the
+    exercise's cache first and stored in the cache of the instance.
+    """
+    if not _COMPILER_CACHE_EXERCISE_DIR.is_dir():
+        return
+    try:
+        _COMPILER_CACHE_DIR.mkdir(mode=0o700, parents=True, exist_ok=True)
+    except OSError:
+        _error_logger.error(
+            "Failed to create compiler cache:\n%s", traceback.format_exc()
+        )
+        return
+    os.environ["PATH"] = f"/usr/lib/ccache:{os.environ.get('PATH', os.defpath)}"
+    os.environ["CCACHE_DIR"] = str(_COMPILER_CACHE_DIR)
+    os.environ["CCACHE_MAXSIZE"] = _COMPILER_CACHE_MAX_SIZE
+    os.environ["CCACHE_REMOTE_STORAGE"] = (
+        f"file:{_COMPILER_CACHE_EXERCISE_DIR}|read-only"
+    )
+
+
 def _run_tests(
     *,
     result_will_be_submitted: bool = False,
     only_run_these_tasks: ty.Optional[ty.Sequence[str]] = None,
-) -> ty.Tuple[str, ty.List[TaskTestResult]]:
+    jobs: ty.Optional[int] = 1,
+    use_cache: bool = False,
+    abort_on_output_limit: bool = False,
+) -> ty.Tuple[_OutputCapture, ty.List[TaskTestResult]]:
+    """
+    Run the registered tests. If the test script sets PARALLEL_TASKS and
+    `jobs` > 1, independent tasks are executed in parallel by worker
+    processes (see _run_tests_parallel()). If `jobs` is None, it defaults to
+    the CPUs of the instance. Tasks are also run by workers if the test
+    script declares TASK_LIMITS. Otherwise, tests run in this process. If the
+    results will be submitted, they are run task by task, such that the
+    resources used by each task are known.
+    If `use_cache` is set and the test script declares the inputs of its
+    tasks via TASK_INPUTS, tasks whose inputs did not change since their last
+    run are not executed again and their previous results are reported.
+    The captured output is bounded by MAX_TEST_OUTPUT_LENGTH. If
+    `abort_on_output_limit` is set, testing stops as soon as it is exceeded.
+    """
+    captured_output = _OutputCapture()
+
     test_path = Path("/usr/local/bin/submission_tests")
     if not test_path.exists():
         print_warn("[+] No testsuite found! Skipping tests..")
-        return "No testsuite found! Skipping tests..", []
+        captured_output.write("No testsuite found! Skipping tests..")
+        return captured_output, []
+
+    _enable_compiler_cache()
 
     # Load submission_tests as a module (this registers tests via decorators).
     # Suppress run_tests() during import to prevent double execution, since
     # some scripts call rf.run_tests() at module level.
     suppress_run_tests(True)
-    _load_submission_tests_module()
+    with _timings.phase("load_tests"):
+        module = _load_submission_tests_module()
     suppress_run_tests(False)
 
-    # Capture stdout/stderr during test execution
-    from io import StringIO
-
-    captured_output = StringIO()
-
-    class TeeWriter:
-        """Write to both stdout and a capture buffer."""
-
-        def __init__(self, original: ty.TextIO, capture: StringIO):
-            self.original = original
-            self.capture = capture
+    task_inputs: ty.Dict[str, ty.Any] = {}
+    if use_cache and not IS_SUBMISSION:
+        task_inputs = getattr(module, "TASK_INPUTS", None) or {}
+
+    # Tasks might share build outputs, thus they only run concurrently if the
+    # exercise opts in.
+    if not getattr(module, "PARALLEL_TASKS", False):
+        jobs = 1
+    elif jobs is None:
+        jobs = _default_jobs()
+
+    # Limits are only available for tasks run by workers.
+    task_limits = _task_limits(module)
+
+    task_names = None
+    if jobs > 1 or task_inputs or task_limits or result_will_be_submitted:
+        task_names = _discover_task_names(test_path)
+        if task_names is not None and only_run_these_tasks:
+            if set(only_run_these_tasks) <= set(task_names):
+                task_names = [t for t in task_names if t in only_run_these_tasks]
+            else:
+                # Let run_tests() report unknown task names.
+                task_names = None
+
+    if task_names is not None:
+        # Inputs are hashed before running the tests, since these might
+        # modify them (e.g., by rebuilding binaries).
+        inputs_hashes = {
+            name: _hash_task_inputs(test_path, name, task_inputs[name])
+            for name in task_names
+            if name in task_inputs
+        }
+        cached = {}
+        for name, inputs_hash in inputs_hashes.items():
+            task_run = _load_cached_task_run(name, inputs_hash)
+            if task_run is not None:
+                cached[name] = task_run
+
+        if (jobs > 1 and len(task_names) > 1) or inputs_hashes or task_limits:
+            with _timings.phase("tests"):
+                task_runs = _run_tests_parallel(
+                    task_names,
+                    jobs,
+                    result_will_be_submitted=result_will_be_submitted,
+                    cached=cached,
+                    abort_on_output_limit=abort_on_output_limit,
+                    limits=task_limits,
+                )
+            test_results = []
+            for task_run in task_runs:
+                captured_output.extend(
+                    task_run.captured_output, task_run.captured_length
+                )
+                test_results.extend(task_run.results)
+                if (
+                    task_run.task_name in inputs_hashes
+                    and not task_run.from_cache
+                    and not task_run.output_limit_exceeded
+                ):
+                    _store_cached_task_run(
+                        task_run, inputs_hashes[task_run.task_name]
+                    )
+            return captured_output, test_results
 
-        def write(self, text: str) -> int:
-            self.original.write(text)
-            self.capture.write(text)
-            return len(text)
-
-        def flush(self) -> None:
-            self.original.flush()
+    # Capture stdout/stderr during test execution
+    captured_output.abort = abort_on_output_limit
 
     original_stdout = sys.stdout
     original_stderr = sys.stderr
-    sys.stdout = TeeWriter(original_stdout, captured_output)  # type: ignore[assignment]
-    sys.stderr = TeeWriter(original_stderr, captured_output)  # type: ignore[assignment]
+    sys.stdout = _TeeWriter(original_stdout, captured_output)  # type: ignore
+    sys.stderr = _TeeWriter(original_stderr, captured_output)  # type: ignore
 
+    test_results = []
     try:
-        test_results = run_tests(
-            result_will_be_submitted=result_will_be_submitted,
-            only_run_these_tasks=only_run_these_tasks,
-        )
+        with _timings.phase("tests"):
+            if task_names is None or not result_will_be_submitted:
+                test_results = run_tests(
+                    result_will_be_submitted=result_will_be_submitted,
+                    only_run_these_tasks=only_run_these_tasks,
+                )
+            else:
+                for task_name in task_names:
+                    with _accounted_task(task_name):
+                        test_results += run_tests(
+                            result_will_be_submitted=result_will_be_submitted,
+                            only_run_these_tasks=[task_name],
+                        )
+    except _OutputLimitExceeded:
+        pass
     finally:
         sys.stdout = original_stdout
         sys.stderr = original_stderr
 
-    return captured_output.getvalue(), test_results
+    return captured_output, test_results
 
 
 def cmd_submit(args: argparse.Namespace):
+    # Users reach _task via sudo or the task server, both set SUDO_USER.
+    if args.results_path and "SUDO_USER" in os.environ:
+        print_err("[!] --results-path can only be used by the webapp.")
+        exit(1)
+
     print_ok("[+] Submitting instance..", flush=True)
 
-    test_output, test_results = _run_tests(result_will_be_submitted=True)
+    test_output, test_results = _run_tests(
+        result_will_be_submitted=True,
+        jobs=args.jobs or 1,
+        abort_on_output_limit=True,
+    )
     any_test_failed = any([not t.success for t in test_results])
 
+    if args.results_path:
+        _write_results(args.results_path, test_output, test_results)
+        return
+
+    if test_output.exceeded:
+        print_err(
+            f"[!] Test output exceeded maximum length of {MAX_TEST_OUTPUT_LENGTH} characters."
+        )
+        print_err("[!] Testing was stopped as soon as the limit was reached.")
+        print_err(
+            "[!] Please remove or reduce any unnecessary output (e.g., debug prints) so that"
+        )
+        print_err(
+            "[!] all output of your solution stays within the allowed limit, and try submitting again."
+        )
+        exit(0)
+
     if not args.yes:
         if any_test_failed:
             print_warn(
@@ -235,26 +1370,72 @@ def cmd_submit(args: argparse.Namespace):
             if not user_answered_yes():
                 exit(0)
 
-    if len(test_output) > MAX_TEST_OUTPUT_LENGTH:
-        print_err(
-            f"[!] Test output exceeded maximum length of {MAX_TEST_OUTPUT_LENGTH} characters."
-        )
-        print_err(
-            "[!] Please remove or reduce any unnecessary output (e.g., debug prints) so that"
-        )
-        print_err(
-            "[!] all output of your solution stays within the allowed limit, and try submitting again."
-        )
-        exit(0)
-
     print_ok("[+] Submitting now...", flush=True)
 
-    req = {"output": test_output, "test_results": [asdict(e) for e in test_results]}
-
-    req = finalize_request(req)
-    res = server_post("http://ssh-reverse-proxy:8000/api/instance/submit", json=req)
+    req = {
+        "output": test_output.getvalue(),
+        "test_results": [asdict(e) for e in test_results],
+        "resource_usage": _resource_usage,
+    }
+
+    with _timings.phase("sign"):
+        body, headers = finalize_compressed_request(req)
+    headers[_TIMINGS_HEADER] = _timings.header()
+    res = server_post(
+        "http://ssh-reverse-proxy:8000/api/instance/submit", data=body, headers=headers
+    )
     _, ret = handle_response(res)
-    print_ok(ret)
+    print_ok(ret["message"], flush=True)
+    _wait_for_submission(ret["ticket"])
+
+
+def _write_results(
+    path: str, test_output: _OutputCapture, test_results: ty.List[TaskTestResult]
+) -> None:
+    """
+    Store the results of `task submit --results-path` instead of submitting
+    them. Used by the webapp to regrade submissions (see ref.core.regrade).
+    The file is only accessible by root, and must not exist yet, thus it can
+    not be prepared by the tested code.
+    """
+    results = {
+        "output": test_output.getvalue(),
+        "output_exceeded": test_output.exceeded,
+        "test_results": [asdict(e) for e in test_results],
+        "resource_usage": _resource_usage,
+    }
+    fd = os.open(path, os.O_WRONLY | os.O_CREAT | os.O_EXCL | os.O_NOFOLLOW, 0o600)
+    with os.fdopen(fd, "w") as f:
+        json.dump(results, f)
+
+
+def _wait_for_submission(ticket: int):
+    """
+    Poll the state of a queued submission until it was created (see
+    ref.core.submission_queue in the webapp).
+    """
+    while True:
+        time.sleep(_SUBMIT_POLL_INTERVAL_S)
+        req = finalize_request({"ticket": ticket})
+        try:
+            res = requests.post(
+                "http://ssh-reverse-proxy:8000/api/instance/submit/status", json=req
+            )
+        except requests.exceptions.RequestException:
+            _error_logger.error(
+                "Submit status request failed:\n%s", traceback.format_exc()
+            )
+            print_warn(
+                "[!] Failed to query the state of your submission. It was accepted and will be created nevertheless."
+            )
+            exit(0)
+        _, ret = handle_response(res)
+        if ret["state"] == "DONE":
+            print_ok(ret["message"])
+            return
+        if ret["state"] == "FAILED":
+            print_err(ret["message"])
+            exit(1)
 
 
 def cmd_check(args: argparse.Namespace):
@@ -262,7 +1443,11 @@ def cmd_check(args: argparse.Namespace):
     Run tests and exit with non-zero status if any test fails.
     """
     only_run_these_tasks = args.only_run_these_tasks
-    _, test_results = _run_tests(only_run_these_tasks=only_run_these_tasks)
+    _, test_results = _run_tests(
+        only_run_these_tasks=only_run_these_tasks,
+        jobs=args.jobs,
+        use_cache=not args.full,
+    )
     any_test_failed = any(not t.success for t in test_results)
     if any_test_failed:
         sys.exit(1)
@@ -273,35 +1458,150 @@ def cmd_id(_):
     print_ok(f"[+] Instance ID: {INSTANCE_ID}")
 
 
+def _read_info_cache() -> ty.Optional[str]:
+    try:
+        st = _INFO_CACHE_PATH.stat()
+        if not 0 <= time.time() - st.st_mtime < _INFO_CACHE_TTL_S:
+            return None
+        return _INFO_CACHE_PATH.read_text()
+    except OSError:
+        return None
+
+
+def _write_info_cache(text: str) -> None:
+    """Atomically replace the `task info` cache. The content is not secret."""
+    try:
+        _INFO_CACHE_PATH.parent.mkdir(mode=0o755, exist_ok=True)
+        tmp = _INFO_CACHE_PATH.with_name(f".{_INFO_CACHE_PATH.name}.{os.getpid()}")
+        tmp.write_text(text)
+        tmp.chmod(0o644)
+        os.replace(tmp, _INFO_CACHE_PATH)
+    except OSError:
+        _error_logger.error("Failed to write info cache:\n%s", traceback.format_exc())
+
+
 def cmd_info(_):
+    text = _read_info_cache()
+    if text is None:
+        try:
+            info = get_instance_info()
+        except InstanceInfoError as e:
+            print_err(f"[!] {e}")
+            exit(1)
+
+        type_ = "Submission" if info.is_submission else "Instance"
+        text = (
+            f"Type     : {type_}\n"
+            f"User     : {info.user_full_name}\n"
+            f"Exercise : {info.exercise_short_name}\n"
+            f"Version  : {info.exercise_version}\n"
+        )
+        _write_info_cache(text)
+
+    print(text, end="")
+
+
+def _trace_on() -> None:
+    if _TRACE_PATH.exists():
+        print_warn("[!] Tracing is already enabled.")
+        return
+    header = _TRACE_HEADER.pack(
+        _TRACE_MAGIC, _TRACE_VERSION, _TRACE_CAPACITY, _TRACE_ENTRY.size, 0
+    )
+    tmp = _TRACE_PATH.with_name(f".{_TRACE_PATH.name}.{os.getpid()}")
+    fd = os.open(tmp, os.O_RDWR | os.O_CREAT | os.O_EXCL, 0o600)
     try:
-        info = get_instance_info()
-    except InstanceInfoError as e:
-        print_err(f"[!] {e}")
+        os.ftruncate(fd, _TRACE_HEADER.size + _TRACE_CAPACITY * _TRACE_ENTRY.size)
+        os.pwrite(fd, header, 0)
+        # The shells of all users record into the buffer.
+        os.fchmod(fd, 0o666)
+    finally:
+        os.close(fd)
+    os.replace(tmp, _TRACE_PATH)
+    print_ok("[+] Tracing enabled, each /bin/sh invocation is recorded from now on.")
+    print_ok("[+] Run `task trace show` to list the most frequent commands.")
+
+
+def _read_trace() -> ty.Tuple[int, ty.List[ty.Tuple[int, int, int, int, int, str]]]:
+    """
+    Returns the number of recorded invocations and the (start_ns, pid, ppid,
+    uid, hash, args) of those still in the buffer, ordered by sequence number.
+    """
+    data = _TRACE_PATH.read_bytes()
+    magic, version, capacity, entry_size, head = _TRACE_HEADER.unpack_from(data)
+    if magic != _TRACE_MAGIC or version != _TRACE_VERSION:
+        raise ValueError("Unsupported trace buffer format")
+    assert entry_size == _TRACE_ENTRY.size
+
+    entries = []
+    for i in range(capacity):
+        seq, start_ns, pid, ppid, uid, hash_, _argc, args = _TRACE_ENTRY.unpack_from(
+            data, _TRACE_HEADER.size + i * entry_size
+        )
+        # Empty, or still being written.
+        if seq == 0:
+            continue
+        args_str = args.split(b"\0", 1)[0].decode(errors="replace")
+        entries.append((seq, (start_ns, pid, ppid, uid, hash_, args_str)))
+    entries.sort()
+    return head, [e for _, e in entries]
+
+
+def _trace_show(limit: int, recent: bool) -> None:
+    if not _TRACE_PATH.exists():
+        print_err("[!] Tracing is not enabled, run `task trace on` first.")
         exit(1)
+    total, entries = _read_trace()
+    if not entries:
+        print_ok("[+] No shell invocations recorded yet.")
+        return
+
+    print_ok(f"[+] {total} shell invocations recorded, {len(entries)} in the buffer.")
+    if recent:
+        for start_ns, pid, ppid, uid, _, args in entries[-limit:]:
+            ts = time.strftime("%H:%M:%S", time.localtime(start_ns / 1e9))
+            ms = (start_ns // 1_000_000) % 1000
+            print(f"{ts}.{ms:03d} pid={pid:<7} ppid={ppid:<7} uid={uid:<5} sh {args}")
+        return
+
+    counts: ty.Counter[int] = collections.Counter(e[4] for e in entries)
+    args_by_hash = {e[4]: e[5] for e in entries}
+    print(f"{'count':>7}  command")
+    for hash_, count in counts.most_common(limit):
+        print(f"{count:>7}  sh {args_by_hash[hash_]}")
+
+
+def cmd_trace(args: argparse.Namespace):
+    if args.action == "on":
+        _trace_on()
+    elif args.action == "off":
+        _TRACE_PATH.unlink(missing_ok=True)
+        print_ok("[+] Tracing disabled.")
+    else:
+        _trace_show(args.n, args.recent)
 
-    type_ = "Submission" if info.is_submission else "Instance"
-    print(f"Type     : {type_}")
-    print(f"User     : {info.user_full_name}")
-    print(f"Exercise : {info.exercise_short_name}")
-    print(f"Version  : {info.exercise_version}")
 
+def main(
+    argv: ty.Optional[ty.Sequence[str]] = None,
+    user_environ: ty.Optional[bytes] = None,
+):
+    """
+    Args:
+        argv: The arguments to parse, defaults to sys.argv[1:].
+        user_environ: The user's environment snapshot. If None, it is read
+            from --environ-fd or the fallback dump.
+    """
+    main_started_ns = time.monotonic_ns()
+    _load_instance_identity()
 
-def main():
     parser = argparse.ArgumentParser(prog="task")
     subparsers = parser.add_subparsers(dest="command")
     subparsers.required = True
 
-    if not IS_SUBMISSION:
-        # Copy the 'snapshotted' user environment stored at /tmp/.user_environ.
-        # The `/tmp/.user_environ` file is created by `task-wrapper.c`
-        # just before this script is executed.
-        p = Path("/home/user/.user_environ")
-        if p.exists():
-            # Grant permission in case the user messed with `.user_environ`.
-            p.chmod(0o777)
-            p.unlink()
-        shutil.copy("/tmp/.user_environ", "/home/user/.user_environ")
+    # Set by `task-wrapper.c` to pass the 'snapshotted' user environment.
+    parser.add_argument("--environ-fd", type=int, help=argparse.SUPPRESS)
+    # Set by `task-wrapper.c`, see _Timings.record_launch().
+    parser.add_argument("--wrapper-timing", help=argparse.SUPPRESS)
 
     reset_parser = subparsers.add_parser(
         "reset",
@@ -319,6 +1619,14 @@ def main():
         action="store_true",
         help="Skip confirmation prompt and submit immediately.",
     )
+    submit_parser.add_argument(
+        "-j",
+        "--jobs",
+        type=int,
+        help="Number of tasks to test in parallel, if the exercise supports it (default: 1).",
+    )
+    # Set by the webapp when regrading, see _write_results().
+    submit_parser.add_argument("--results-path", help=argparse.SUPPRESS)
     submit_parser.set_defaults(func=cmd_submit)
 
     check_parser = subparsers.add_parser(
@@ -331,6 +1639,17 @@ def main():
         nargs="*",
         help="Only run the checks for the passed `task-name`s",
     )
+    check_parser.add_argument(
+        "-j",
+        "--jobs",
+        type=int,
+        help="Number of tasks to test in parallel, if the exercise supports it (default: CPUs of this instance).",
+    )
+    check_parser.add_argument(
+        "--full",
+        action="store_true",
+        help="Rerun all checks, even those whose input files did not change.",
+    )
     check_parser.set_defaults(func=cmd_check)
 
     id_parser = subparsers.add_parser(
@@ -343,17 +1662,254 @@ def main():
     )
     info_parser.set_defaults(func=cmd_info)
 
+    trace_parser = subparsers.add_parser(
+        "trace",
+        help="Record the shell commands (e.g., those run by make) executed in this instance, to find out what slows down a build.",
+    )
+    trace_parser.add_argument(
+        "action",
+        choices=("on", "off", "show"),
+        help="Start or stop recording, or show the most frequent commands.",
+    )
+    trace_parser.add_argument(
+        "-n",
+        type=int,
+        default=20,
+        help="Number of commands to show (default: 20).",
+    )
+    trace_parser.add_argument(
+        "--recent",
+        action="store_true",
+        help="Show the most recent invocations instead of the most frequent commands.",
+    )
+    trace_parser.set_defaults(func=cmd_trace)
+
     # diff_parser = subparsers.add_parser('diff',
     #     help='Get your instance ID. This ID is needed for all support requests.'
     #     )
     # diff_parser.set_defaults(func=cmd_diff)
 
-    args = parser.parse_args()
+    args = parser.parse_args(argv)
+    _timings.record_launch(args.wrapper_timing, main_started_ns)
+
+    global _user_environ_raw
+    if user_environ is None:
+        user_environ = _read_user_environ(args.environ_fd)
+    _user_environ_raw = user_environ
+
     args.func(args)
 
 
+###
+# Task server
+#
+# `_task --serve` is started by the container entrypoint and keeps the
+# interpreter and all modules warm. `task-wrapper.c` connects to it and sends
+# a single SOCK_SEQPACKET message containing argv (NUL separated, argv[0]
+# included) and, via SCM_RIGHTS, its stdin, stdout, stderr and the sealed
+# environment memfd. Each request is served by a forked monitor process that
+# forks the runner executing main(). The monitor forwards signals received
+# from the wrapper (one byte per signal number) to the runner's process group
+# and finally replies with the runner's exit status (native int).
+###
+
+
+def _libc() -> ctypes.CDLL:
+    return ctypes.CDLL(None, use_errno=True)
+
+
+def _adopt_personality(pid: int) -> None:
+    """
+    Inherit the execution domain of the client, e.g., if ASLR was disabled via
+    `setarch -R` for the SSH server. `sudo` would inherit it implicitly.
+    """
+    try:
+        persona = int(Path(f"/proc/{pid}/personality").read_text(), 16)
+    except (OSError, ValueError):
+        return
+
+    libc = _libc()
+    current = libc.personality(0xFFFFFFFF)
+    if current != persona and libc.personality(persona) == -1:
+        err = ctypes.get_errno()
+        raise OSError(err, f"personality: {os.strerror(err)}")
+
+
+def _run_request(
+    args: ty.List[str], fds: ty.List[int], pid: int, uid: int, gid: int
+) -> ty.NoReturn:
+    """Execute a single request in the runner process. Never returns."""
+    code = 1
+    try:
+        # Own process group, thus the monitor can signal everything we spawn.
+        os.setsid()
+
+        stdin, stdout, stderr, environ_fd = fds
+        for target, fd in enumerate((stdin, stdout, stderr)):
+            os.dup2(fd, target)
+            os.close(fd)
+        sys.stdout.reconfigure(line_buffering=os.isatty(1))  # type: ignore[union-attr]
+        sys.stderr.reconfigure(line_buffering=True)  # type: ignore[union-attr]
+
+        _adopt_personality(pid)
+        try:
+            os.chdir(f"/proc/{pid}/cwd")
+        except OSError:
+            os.chdir("/home/user")
+
+        user_environ = _read_user_environ(environ_fd)
+        parsed = _parse_user_environ(user_environ)
+        for key, value in parsed.items():
+            if key in _SERVER_ENV_KEEP or key.startswith("LC_"):
+                os.environ[key] = value
+        user = pwd.getpwuid(uid).pw_name
+        os.environ["SUDO_USER"] = user
+        os.environ["SUDO_UID"] = str(uid)
+        os.environ["SUDO_GID"] = str(gid)
+        os.environ["SUDO_COMMAND"] = " ".join(["/usr/local/bin/_task", *args])
+
+        sys.argv = ["/usr/local/bin/_task", *args]
+        try:
+            main(args, user_environ=user_environ)
+            code = 0
+        except SystemExit as e:
+            if e.code is None:
+                code = 0
+            elif isinstance(e.code, int):
+                code = e.code
+            else:
+                print(e.code, file=sys.stderr)
+                code = 1
+        except KeyboardInterrupt:
+            code = 0
+    except BaseException:
+        _error_logger.error("Task server request failed:\n%s", traceback.format_exc())
+        print_err("[!] Internal error, please contact your system administrator.")
+    finally:
+        try:
+            sys.stdout.flush()
+            sys.stderr.flush()
+        finally:
+            os._exit(code)
+
+
+def _serve_connection(conn: socket.socket, allowed_uids: ty.Set[int]) -> None:
+    """Handle a single client connection (runs in the monitor process)."""
+    creds = conn.getsockopt(
+        socket.SOL_SOCKET, socket.SO_PEERCRED, struct.calcsize("3i")
+    )
+    pid, uid, gid = struct.unpack("3i", creds)
+    if uid not in allowed_uids:
+        _error_logger.error("Rejected task server client with uid=%d", uid)
+        return
+
+    msg, fds, flags, _ = socket.recv_fds(conn, _SERVER_MAX_REQUEST_SIZE, 4)
+    if flags & (socket.MSG_TRUNC | socket.MSG_CTRUNC) or len(fds) != 4:
+        for fd in fds:
+            os.close(fd)
+        _error_logger.error("Malformed task server request (flags=%d)", flags)
+        return
+
+    # Drop argv[0] and the terminating NUL.
+    args = [os.fsdecode(a) for a in msg.split(b"\0")[1:-1]]
+
+    wakeup_r, wakeup_w = os.pipe2(os.O_NONBLOCK | os.O_CLOEXEC)
+    signal.signal(signal.SIGCHLD, lambda *_: None)
+    signal.set_wakeup_fd(wakeup_w)
+
+    runner = os.fork()
+    if runner == 0:
+        conn.close()
+        signal.set_wakeup_fd(-1)
+        signal.signal(signal.SIGCHLD, signal.SIG_DFL)
+        _run_request(args, fds, pid, uid, gid)
+
+    for fd in fds:
+        os.close(fd)
+
+    sel = selectors.DefaultSelector()
+    sel.register(conn, selectors.EVENT_READ)
+    sel.register(wakeup_r, selectors.EVENT_READ)
+    while True:
+        for key, _ in sel.select():
+            if key.fileobj is conn:
+                data = conn.recv(64)
+                if not data:
+                    # The client is gone, behave like a hangup of the terminal.
+                    data = bytes([signal.SIGHUP])
+                    sel.unregister(conn)
+                for signum in data:
+                    if signum in _SERVER_FORWARDED_SIGNALS:
+                        try:
+                            os.killpg(runner, signum)
+                        except ProcessLookupError:
+                            pass
+            else:
+                try:
+                    while os.read(wakeup_r, 64):
+                        pass
+                except BlockingIOError:
+                    pass
+
+        done, status = os.waitpid(runner, os.WNOHANG)
+        if done:
+            break
+
+    code = os.waitstatus_to_exitcode(status)
+    if code < 0:
+        code = 128 - code
+    try:
+        conn.send(struct.pack("i", code))
+    except OSError:
+        pass
+
+
+def serve() -> ty.NoReturn:
+    """Run the task server. Must be started as root, but not via `sudo`."""
+    if os.geteuid() != 0 or "SUDO_USER" in os.environ:
+        print_err("[!] The task server can only be started by the container init.")
+        exit(1)
+
+    allowed_uids = {0, pwd.getpwnam(_SERVER_ALLOWED_USER).pw_uid}
+
+    # Monitor processes are reaped automatically.
+    signal.signal(signal.SIGCHLD, signal.SIG_IGN)
+
+    if os.path.exists(_SERVER_SOCKET_PATH):
+        os.unlink(_SERVER_SOCKET_PATH)
+    server = socket.socket(socket.AF_UNIX, socket.SOCK_SEQPACKET)
+    server.bind(_SERVER_SOCKET_PATH)
+    # Everybody may connect, clients are authenticated via SO_PEERCRED.
+    os.chmod(_SERVER_SOCKET_PATH, 0o666)
+    server.listen(64)
+
+    while True:
+        try:
+            conn, _ = server.accept()
+        except InterruptedError:
+            continue
+
+        sys.stdout.flush()
+        sys.stderr.flush()
+        pid = os.fork()
+        if pid == 0:
+            server.close()
+            signal.signal(signal.SIGCHLD, signal.SIG_DFL)
+            try:
+                _serve_connection(conn, allowed_uids)
+            except BaseException:
+                _error_logger.error(
+                    "Task server connection failed:\n%s", traceback.format_exc()
+                )
+            finally:
+                os._exit(0)
+        conn.close()
+
+
 if __name__ == "__main__":
     try:
+        if sys.argv[1:] == ["--serve"]:
+            serve()
         main()
     except KeyboardInterrupt:
         pass
@@ -18,7 +18,18 @@ pub struct ApiClient {
 /// Response from /api/getkeys
 #[derive(Debug, Deserialize)]
 pub struct GetKeysResponse {
-    pub keys: Vec<String>,
+    /// ID of the latest key change known to the web server
+    #[serde(default)]
+    pub version: i64,
+    /// The full key set (if no or an unknown version was requested)
+    #[serde(default)]
+    pub keys: Option<Vec<String>>,
+    /// Keys that became valid since the requested version
+    #[serde(default)]
+    pub added: Vec<String>,
+    /// Keys that became invalid since the requested version
+    #[serde(default)]
+    pub removed: Vec<String>,
 }
 
 /// Response from /api/ssh-authenticated
@@ -46,6 +57,8 @@ pub struct ProvisionResponse {
 #[derive(Serialize)]
 struct GetKeysRequest {
     username: String,
+    #[serde(skip_serializing_if = "Option::is_none")]
+    since: Option<i64>,
 }
 
 /// Request body for /api/ssh-authenticated
@@ -112,19 +125,19 @@ impl ApiClient {
         format!("{}.{}", payload, encoded_sig)
     }
 
-    /// Fetch all valid public keys from the API.
+    /// Fetch the public keys that changed since version `since`, or all
+    /// valid public keys if `since` is None.
     #[instrument(skip(self))]
-    pub async fn get_keys(&self) -> Result<Vec<String>> {
+    pub async fn get_keys(&self, since: Option<i64>) -> Result<GetKeysResponse> {
         let request = GetKeysRequest {
             username: "NotUsed".to_string(),
+            since,
         };
         let payload = serde_json::to_string(&request)?;
-        info!("[API] get_keys payload: {}", payload);
         let signed = self.sign_payload(&payload);
-        info!("[API] get_keys signed (first 100 chars): {}...", &signed[..std::cmp::min(100, signed.len())]);
 
         let url = format!("{}/api/getkeys", self.base_url);
-        info!("[API] Fetching keys from {}", url);
+        debug!("Fetching keys from {} (since={:?})", url, since);
 
         // Send signed string as JSON (Python: requests.post(..., json=signed_string))
         let response = self
@@ -135,8 +148,6 @@ impl ApiClient {
             .await?;
 
         let status = response.status();
-        info!("[API] get_keys response status: {}", status);
-
         if !status.is_success() {
             let body = response.text().await.unwrap_or_default();
             error!("[API] get_keys failed: status={}, body={}", status, body);
@@ -146,15 +157,15 @@ impl ApiClient {
             ));
         }
 
-        let body_text = response.text().await?;
-        info!("[API] get_keys response body (first 500 chars): {}...", &body_text[..std::cmp::min(500, body_text.len())]);
-
-        let keys_response: GetKeysResponse = serde_json::from_str(&body_text)?;
-        info!("[API] Received {} keys", keys_response.keys.len());
-        for (i, key) in keys_response.keys.iter().enumerate() {
-            info!("[API] Key {}: {} chars, first 60: {}...", i, key.len(), &key[..std::cmp::min(60, key.len())]);
-        }
-        Ok(keys_response.keys)
+        let keys_response: GetKeysResponse = response.json().await?;
+        debug!(
+            "Received key version {} (full={}, +{}, -{})",
+            keys_response.version,
+            keys_response.keys.is_some(),
+            keys_response.added.len(),
+            keys_response.removed.len()
+        );
+        Ok(keys_response)
     }
 
     /// Authenticate an SSH connection and get user permissions.
@@ -266,6 +277,27 @@ mod tests {
         assert!(!parts[1].is_empty());
     }
 
+    #[test]
+    fn test_get_keys_request_omits_missing_version() {
+        let request = GetKeysRequest {
+            username: "NotUsed".to_string(),
+            since: None,
+        };
+        assert_eq!(
+            serde_json::to_string(&request).unwrap(),
+            r#"{"username":"NotUsed"}"#
+        );
+    }
+
+    #[test]
+    fn test_get_keys_response_delta() {
+        let response: GetKeysResponse =
+            serde_json::from_str(r#"{"version": 3, "added": ["a"], "removed": []}"#).unwrap();
+        assert_eq!(response.version, 3);
+        assert!(response.keys.is_none());
+        assert_eq!(response.added, vec!["a".to_string()]);
+    }
+
     #[test]
     fn test_sign_payload_deterministic() {
         // itsdangerous signing is deterministic - same input produces same output
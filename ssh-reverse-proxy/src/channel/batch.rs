@@ -0,0 +1,131 @@
+//! Batched reading of container channels.
+//!
+//! Data received from a container is handed to the client session in the
+//! `CryptoVec` russh allocated for it, i.e., it is not copied on its way
+//! through the proxy. If more data messages are already queued when one is
+//! read (e.g., because the previous write had to wait for the client's
+//! window), they are appended to the first one, so that many small writes of
+//! a chatty process result in a single packet of up to `MAX_BATCH_SIZE` bytes.
+
+use crate::channel::forwarder::ContainerEvent;
+use crate::channel::shell::channel_msg_to_event;
+use futures::FutureExt;
+use russh::{ChannelReadHalf, CryptoVec};
+
+/// Upper bound for coalesced data (russh's default maximum packet size).
+pub const MAX_BATCH_SIZE: usize = 32 * 1024;
+
+/// Reads events from a container channel and coalesces queued data.
+pub struct BatchReader {
+    read_half: ChannelReadHalf,
+    /// Event that was read while coalescing but could not be appended.
+    pending: Option<ContainerEvent>,
+}
+
+impl BatchReader {
+    pub fn new(read_half: ChannelReadHalf) -> Self {
+        Self {
+            read_half,
+            pending: None,
+        }
+    }
+
+    /// Wait for the next event. Returns None once the channel is closed.
+    pub async fn next(&mut self) -> Option<ContainerEvent> {
+        let mut event = match self.pending.take() {
+            Some(event) => event,
+            None => loop {
+                if let Some(event) = channel_msg_to_event(self.read_half.wait().await?) {
+                    break event;
+                }
+            },
+        };
+
+        match &mut event {
+            ContainerEvent::Data(data) => self.coalesce(data, None),
+            ContainerEvent::ExtendedData { ext_type, data } => {
+                let ext_type = *ext_type;
+                self.coalesce(data, Some(ext_type))
+            }
+            _ => {}
+        }
+        Some(event)
+    }
+
+    /// Append all data that is already queued on the channel without waiting.
+    fn coalesce(&mut self, data: &mut CryptoVec, ext_type: Option<u32>) {
+        while data.len() < MAX_BATCH_SIZE {
+            let msg = match self.read_half.wait().now_or_never() {
+                Some(Some(msg)) => msg,
+                // Nothing queued, or the channel was closed, which the next call
+                // to next() reports.
+                _ => return,
+            };
+            let Some(event) = channel_msg_to_event(msg) else {
+                continue;
+            };
+            if !append(data, ext_type, &event) {
+                self.pending = Some(event);
+                return;
+            }
+        }
+    }
+}
+
+/// Append the payload of `event` to `data` if it is of the same kind and
+/// the result does not exceed `MAX_BATCH_SIZE`. Returns whether it was appended.
+fn append(data: &mut CryptoVec, ext_type: Option<u32>, event: &ContainerEvent) -> bool {
+    let other = match (event, ext_type) {
+        (ContainerEvent::Data(other), None) => other,
+        (
+            ContainerEvent::ExtendedData {
+                ext_type: t,
+                data: other,
+            },
+            Some(ext),
+        ) if *t == ext => other,
+        _ => return false,
+    };
+    if data.len() + other.len() > MAX_BATCH_SIZE {
+        return false;
+    }
+    data.extend(other);
+    true
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+
+    #[test]
+    fn test_append_data() {
+        let mut data = CryptoVec::from_slice(b"foo");
+        let event = ContainerEvent::Data(CryptoVec::from_slice(b"bar"));
+        assert!(append(&mut data, None, &event));
+        assert_eq!(&data[..], b"foobar");
+    }
+
+    #[test]
+    fn test_append_keeps_streams_apart() {
+        let mut data = CryptoVec::from_slice(b"out");
+        let stderr = ContainerEvent::ExtendedData {
+            ext_type: 1,
+            data: CryptoVec::from_slice(b"err"),
+        };
+        assert!(!append(&mut data, None, &stderr));
+        assert!(!append(&mut data, Some(2), &stderr));
+        assert!(append(&mut data, Some(1), &stderr));
+        assert!(!append(&mut data, None, &ContainerEvent::Eof));
+        assert_eq!(&data[..], b"outerr");
+    }
+
+    #[test]
+    fn test_append_respects_batch_size() {
+        let mut data = CryptoVec::from_slice(&[0u8; MAX_BATCH_SIZE - 1]);
+        let event = ContainerEvent::Data(CryptoVec::from_slice(b"ab"));
+        assert!(!append(&mut data, None, &event));
+        let event = ContainerEvent::Data(CryptoVec::from_slice(b"a"));
+        assert!(append(&mut data, None, &event));
+        assert_eq!(data.len(), MAX_BATCH_SIZE);
+    }
+}
@@ -3,13 +3,14 @@
 //! This module handles the forwarding of TCP connections from the client
 //! through the SSH proxy to a target host:port via the container SSH.
 
-use crate::channel::forwarder::ChannelForwarder;
+use crate::channel::batch::BatchReader;
+use crate::channel::forwarder::{ChannelForwarder, ContainerEvent};
 use anyhow::{anyhow, Result};
 use async_trait::async_trait;
 use russh::client::{self, Msg};
 use russh::keys::{PrivateKey, PrivateKeyWithHashAlg};
 use russh::server::Handle;
-use russh::{ChannelId, ChannelMsg, ChannelWriteHalf, CryptoVec};
+use russh::{ChannelId, ChannelWriteHalf};
 use std::sync::Arc;
 use tokio::io::AsyncWriteExt;
 use tracing::{debug, info};
@@ -114,29 +115,30 @@ impl DirectTcpIpForwarder {
 
     /// Spawn a task to read from the container channel and forward to the client.
     fn spawn_channel_forwarder(
-        mut read_half: russh::ChannelReadHalf,
+        read_half: russh::ChannelReadHalf,
         session_handle: Handle,
         client_channel_id: ChannelId,
     ) {
         tokio::spawn(async move {
-            while let Some(msg) = read_half.wait().await {
-                let should_break = match msg {
-                    ChannelMsg::Data { data } => {
+            let mut reader = BatchReader::new(read_half);
+            while let Some(event) = reader.next().await {
+                let should_break = match event {
+                    ContainerEvent::Data(data) => {
                         session_handle
-                            .data(client_channel_id, CryptoVec::from_slice(&data))
+                            .data(client_channel_id, data)
                             .await
                             .is_err()
                     }
-                    ChannelMsg::Eof => {
+                    ContainerEvent::Eof => {
                         let _ = session_handle.eof(client_channel_id).await;
                         false
                     }
-                    ChannelMsg::Close => {
+                    ContainerEvent::Close => {
                         let _ = session_handle.close(client_channel_id).await;
                         true
                     }
                     _ => {
-                        debug!("Ignoring message in direct-tcpip channel: {:?}", msg);
+                        debug!("Ignoring event in direct-tcpip channel: {:?}", event);
                         false
                     }
                 };
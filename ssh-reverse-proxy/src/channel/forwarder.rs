@@ -6,16 +6,19 @@
 
 use anyhow::Result;
 use async_trait::async_trait;
-use russh::ChannelId;
+use russh::{ChannelId, CryptoVec};
 
 /// Events from a container that need to be forwarded to the client.
+///
+/// Data is kept in the `CryptoVec` it was received in, thus it can be passed
+/// to the client session without copying.
 #[derive(Debug, Clone)]
 pub enum ContainerEvent {
     /// Data received from container stdout
-    Data(Vec<u8>),
+    Data(CryptoVec),
 
     /// Extended data (e.g., stderr) with type code
-    ExtendedData { ext_type: u32, data: Vec<u8> },
+    ExtendedData { ext_type: u32, data: CryptoVec },
 
     /// End of file on the channel
     Eof,
@@ -3,14 +3,16 @@
 //! This module handles forwarding SSH channels between the client
 //! and container SSH servers.
 
+pub mod batch;
 pub mod direct_tcpip;
 pub mod forwarder;
 pub mod remote_forward;
 pub mod shell;
 pub mod x11;
 
+pub use batch::BatchReader;
 pub use direct_tcpip::DirectTcpIpForwarder;
 pub use forwarder::{ChannelForwarder, ContainerEvent};
 pub use remote_forward::RemoteForwardManager;
-pub use shell::{ShellForwarder, channel_msg_to_event};
+pub use shell::{ShellForwarder, channel_msg_to_event, container_instance_id};
 pub use x11::X11ForwardState;
@@ -2,11 +2,13 @@
 //!
 //! Handles forwarding connections from the container back to the client.
 
+use crate::channel::batch::BatchReader;
+use crate::channel::forwarder::ContainerEvent;
 use anyhow::{anyhow, Result};
 use russh::client::{self, Session as ClientSession};
 use russh::keys::{PrivateKey, PrivateKeyWithHashAlg};
 use russh::server::Handle as ServerHandle;
-use russh::{Channel, ChannelId, ChannelMsg, CryptoVec};
+use russh::{Channel, ChannelId, ChannelMsg};
 use std::collections::HashMap;
 use std::sync::Arc;
 use tokio::io::AsyncWriteExt;
@@ -198,7 +200,7 @@ impl client::Handler for ContainerForwardHandler {
 
 /// Spawn bidirectional forwarding between container and client channels.
 fn spawn_bidirectional_forwarder(
-    mut container_read: russh::ChannelReadHalf,
+    container_read: russh::ChannelReadHalf,
     mut container_write: russh::ChannelWriteHalf<russh::client::Msg>,
     mut client_read: russh::ChannelReadHalf,
     _client_write: russh::ChannelWriteHalf<russh::server::Msg>,
@@ -207,19 +209,20 @@ fn spawn_bidirectional_forwarder(
 ) {
     // Container -> Client
     tokio::spawn(async move {
-        while let Some(msg) = container_read.wait().await {
-            let should_break = match msg {
-                ChannelMsg::Data { data } => {
+        let mut reader = BatchReader::new(container_read);
+        while let Some(event) = reader.next().await {
+            let should_break = match event {
+                ContainerEvent::Data(data) => {
                     server_handle
-                        .data(client_channel_id, CryptoVec::from_slice(&data))
+                        .data(client_channel_id, data)
                         .await
                         .is_err()
                 }
-                ChannelMsg::Eof => {
+                ContainerEvent::Eof => {
                     let _ = server_handle.eof(client_channel_id).await;
                     false
                 }
-                ChannelMsg::Close => {
+                ContainerEvent::Close => {
                     let _ = server_handle.close(client_channel_id).await;
                     true
                 }
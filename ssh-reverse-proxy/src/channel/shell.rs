@@ -4,7 +4,7 @@
 //! between the client and a container's SSH server.
 
 use crate::channel::forwarder::{ChannelForwarder, ContainerEvent};
-use anyhow::{anyhow, Result};
+use anyhow::{anyhow, Context, Result};
 use async_trait::async_trait;
 use russh::client::{self, Msg};
 use russh::keys::{PrivateKey, PrivateKeyWithHashAlg};
@@ -152,16 +152,45 @@ impl ShellForwarder {
     }
 }
 
+/// Read the ID of the instance the container belongs to (`/etc/instance_id`).
+pub async fn container_instance_id(
+    container_ip: &str,
+    container_port: u16,
+    auth_key: Arc<PrivateKey>,
+    username: &str,
+) -> Result<i64> {
+    let mut forwarder =
+        ShellForwarder::connect(container_ip, container_port, auth_key, username).await?;
+    forwarder.exec(b"cat /etc/instance_id").await?;
+    let mut read_half = forwarder
+        .take_read_half()
+        .context("Channel read half already taken")?;
+
+    let mut output = Vec::new();
+    while let Some(msg) = read_half.wait().await {
+        match msg {
+            ChannelMsg::Data { data } => output.extend_from_slice(&data),
+            ChannelMsg::Eof | ChannelMsg::Close => break,
+            _ => {}
+        }
+    }
+    let output = String::from_utf8_lossy(&output);
+    output
+        .trim()
+        .parse()
+        .with_context(|| format!("Invalid instance ID {:?}", output))
+}
+
 /// Convert ChannelMsg to ContainerEvent.
 pub fn channel_msg_to_event(msg: ChannelMsg) -> Option<ContainerEvent> {
     match msg {
         ChannelMsg::Data { data } => {
-            Some(ContainerEvent::Data(data.to_vec()))
+            Some(ContainerEvent::Data(data))
         }
         ChannelMsg::ExtendedData { ext, data } => {
             Some(ContainerEvent::ExtendedData {
                 ext_type: ext,
-                data: data.to_vec(),
+                data,
             })
         }
         ChannelMsg::Eof => {
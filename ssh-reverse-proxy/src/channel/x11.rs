@@ -2,9 +2,11 @@
 //!
 //! Handles X11 display forwarding from container to client.
 
+use crate::channel::batch::BatchReader;
+use crate::channel::forwarder::ContainerEvent;
 use anyhow::Result;
 use russh::server::Handle as ServerHandle;
-use russh::{ChannelId, ChannelMsg, CryptoVec};
+use russh::{ChannelId, ChannelMsg};
 use tokio::io::AsyncWriteExt;
 use tracing::{debug, info};
 
@@ -79,7 +81,7 @@ pub async fn handle_x11_channel(
 
 /// Spawn bidirectional X11 forwarding between container and client.
 fn spawn_x11_forwarder(
-    mut container_read: russh::ChannelReadHalf,
+    container_read: russh::ChannelReadHalf,
     mut container_write: russh::ChannelWriteHalf<russh::client::Msg>,
     mut client_read: russh::ChannelReadHalf,
     _client_write: russh::ChannelWriteHalf<russh::server::Msg>,
@@ -88,19 +90,20 @@ fn spawn_x11_forwarder(
 ) {
     // Container -> Client (X11 data from app to display)
     tokio::spawn(async move {
-        while let Some(msg) = container_read.wait().await {
-            let should_break = match msg {
-                ChannelMsg::Data { data } => {
+        let mut reader = BatchReader::new(container_read);
+        while let Some(event) = reader.next().await {
+            let should_break = match event {
+                ContainerEvent::Data(data) => {
                     server_handle
-                        .data(client_channel_id, CryptoVec::from_slice(&data))
+                        .data(client_channel_id, data)
                         .await
                         .is_err()
                 }
-                ChannelMsg::Eof => {
+                ContainerEvent::Eof => {
                     let _ = server_handle.eof(client_channel_id).await;
                     false
                 }
-                ChannelMsg::Close => {
+                ContainerEvent::Close => {
                     let _ = server_handle.close(client_channel_id).await;
                     true
                 }
@@ -45,6 +45,10 @@ pub struct ContainerConfig {
     /// Keepalive interval in seconds
     #[serde(default = "default_keepalive_interval")]
     pub keepalive_interval_secs: u64,
+
+    /// How long resolved container endpoints are cached in seconds (0 disables the cache)
+    #[serde(default = "default_endpoint_cache_ttl")]
+    pub endpoint_cache_ttl_secs: u64,
 }
 
 fn default_signing_key_env() -> String {
@@ -63,6 +67,10 @@ fn default_keepalive_interval() -> u64 {
     60
 }
 
+fn default_endpoint_cache_ttl() -> u64 {
+    30
+}
+
 impl Config {
     /// Load configuration from a TOML file.
     pub fn load(path: &str) -> anyhow::Result<Self> {
@@ -96,6 +104,10 @@ impl Config {
                     .unwrap_or_else(|_| PathBuf::from("/keys")),
                 connection_timeout_secs: 10,
                 keepalive_interval_secs: 60,
+                endpoint_cache_ttl_secs: std::env::var("ENDPOINT_CACHE_TTL_SECS")
+                    .ok()
+                    .and_then(|s| s.parse().ok())
+                    .unwrap_or(30),
             },
         })
     }
@@ -0,0 +1,331 @@
+//! Cache of the container endpoints resolved by the web API.
+//!
+//! Resolving an endpoint (`/api/ssh-authenticated` and `/api/provision`) makes
+//! the web server look up the user, exercise and instance, and possibly start
+//! the instance. The result is cached per (key, exercise) for a short time, thus
+//! reconnects (e.g. `scp` after `ssh`, or an IDE opening several sessions) are
+//! forwarded to the running container without asking the web server again.
+//! Concurrent resolutions of the same entry are coalesced into one request.
+//!
+//! Entries are dropped once they expire, when the key sync reports a change of
+//! their key (the web server logs the owner's key whenever the container of an
+//! instance is stopped) or fails, and when connecting to the cached container
+//! fails. Before a cached endpoint is used, the server checks that the
+//! container still belongs to the endpoint's instance (see crate::server).
+
+use crate::keys::key_data;
+use std::collections::HashMap;
+use std::future::Future;
+use std::sync::{Arc, Mutex};
+use std::time::{Duration, Instant};
+use tokio::sync::OnceCell;
+use tracing::debug;
+
+/// Where to forward the connections of a key for an exercise.
+#[derive(Debug, Clone, PartialEq)]
+pub struct Endpoint {
+    pub instance_id: i64,
+    pub ip: String,
+    pub as_root: bool,
+    pub welcome_message: Option<String>,
+}
+
+/// Key data of the public key and the exercise name.
+type CacheKey = (String, String);
+
+type Resolution = Arc<OnceCell<Result<Arc<Endpoint>, String>>>;
+
+struct Entry {
+    endpoint: Arc<Endpoint>,
+    expires_at: Instant,
+}
+
+#[derive(Default)]
+struct Entries {
+    map: HashMap<CacheKey, Entry>,
+    /// Incremented by each invalidation. Resolutions that started before an
+    /// invalidation may have returned an outdated endpoint and are not cached.
+    generation: u64,
+}
+
+pub struct EndpointCache {
+    ttl: Duration,
+    entries: Mutex<Entries>,
+    /// Resolutions in progress, callers of the same entry share one cell.
+    pending: Mutex<HashMap<CacheKey, Resolution>>,
+}
+
+impl EndpointCache {
+    /// Create a cache whose entries are valid for `ttl`. A zero `ttl` disables
+    /// caching, but concurrent resolutions are still coalesced.
+    pub fn new(ttl: Duration) -> Self {
+        Self {
+            ttl,
+            entries: Mutex::new(Entries::default()),
+            pending: Mutex::new(HashMap::new()),
+        }
+    }
+
+    fn cache_key(pubkey: &str, exercise: &str) -> CacheKey {
+        (
+            key_data(pubkey).unwrap_or(pubkey).to_owned(),
+            exercise.to_owned(),
+        )
+    }
+
+    /// Return the cached endpoint of `pubkey` for `exercise`, or resolve it by
+    /// calling `resolve`. The returned flag is true if the endpoint was cached.
+    pub async fn get_or_resolve<F, Fut>(
+        &self,
+        pubkey: &str,
+        exercise: &str,
+        resolve: F,
+    ) -> Result<(Arc<Endpoint>, bool), String>
+    where
+        F: FnOnce() -> Fut,
+        Fut: Future<Output = Result<Endpoint, String>>,
+    {
+        let key = Self::cache_key(pubkey, exercise);
+        if let Some(endpoint) = self.lookup(&key, Instant::now()) {
+            debug!("Endpoint cache hit for exercise {}", exercise);
+            return Ok((endpoint, true));
+        }
+
+        let cell = Arc::clone(
+            self.pending
+                .lock()
+                .unwrap()
+                .entry(key.clone())
+                .or_default(),
+        );
+        // If the caller that runs the resolution is cancelled (e.g. the client
+        // disconnected), one of the waiting callers takes over.
+        let result = cell
+            .get_or_init(|| async {
+                let generation = self.entries.lock().unwrap().generation;
+                let result = resolve().await.map(Arc::new);
+                if let Ok(endpoint) = &result {
+                    self.insert(&key, endpoint, generation);
+                }
+                result
+            })
+            .await
+            .clone();
+
+        let mut pending = self.pending.lock().unwrap();
+        if pending.get(&key).is_some_and(|c| Arc::ptr_eq(c, &cell)) {
+            pending.remove(&key);
+        }
+        result.map(|endpoint| (endpoint, false))
+    }
+
+    fn lookup(&self, key: &CacheKey, now: Instant) -> Option<Arc<Endpoint>> {
+        let mut entries = self.entries.lock().unwrap();
+        match entries.map.get(key) {
+            Some(entry) if entry.expires_at > now => {
+                Some(Arc::clone(&entry.endpoint))
+            }
+            Some(_) => {
+                entries.map.remove(key);
+                None
+            }
+            None => None,
+        }
+    }
+
+    fn insert(&self, key: &CacheKey, endpoint: &Arc<Endpoint>, generation: u64) {
+        if self.ttl.is_zero() {
+            return;
+        }
+        let mut entries = self.entries.lock().unwrap();
+        if entries.generation != generation {
+            return;
+        }
+        let now = Instant::now();
+        entries.map.retain(|_, e| e.expires_at > now);
+        entries.map.insert(
+            key.clone(),
+            Entry {
+                endpoint: Arc::clone(endpoint),
+                expires_at: now + self.ttl,
+            },
+        );
+    }
+
+    /// Drop the entry of `pubkey` for `exercise`.
+    pub fn invalidate(&self, pubkey: &str, exercise: &str) {
+        let key = Self::cache_key(pubkey, exercise);
+        self.invalidate_where(|k| *k == key);
+    }
+
+    /// Drop all entries of the given key data.
+    pub fn invalidate_key_data(&self, data: &str) {
+        self.invalidate_where(|(k, _)| k == data);
+    }
+
+    /// Drop all entries.
+    pub fn clear(&self) {
+        self.invalidate_where(|_| true);
+    }
+
+    fn invalidate_where(&self, pred: impl Fn(&CacheKey) -> bool) {
+        let mut entries = self.entries.lock().unwrap();
+        entries.generation += 1;
+        entries.map.retain(|k, _| !pred(k));
+        drop(entries);
+        // Later callers must not join resolutions that started before.
+        self.pending.lock().unwrap().retain(|k, _| !pred(k));
+    }
+
+    pub fn len(&self) -> usize {
+        self.entries.lock().unwrap().map.len()
+    }
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+    use std::sync::atomic::{AtomicUsize, Ordering};
+
+    const KEY_A: &str = "ssh-ed25519 AAAAC3NzaC1lZDI1NTE5AAAAIA a@host";
+    const KEY_B: &str = "ssh-rsa AAAAB3NzaC1yc2EAAAADAQABAAABAQ b@host";
+
+    fn endpoint(ip: &str) -> Endpoint {
+        Endpoint {
+            instance_id: 1,
+            ip: ip.to_string(),
+            as_root: false,
+            welcome_message: None,
+        }
+    }
+
+    async fn resolve(
+        cache: &EndpointCache,
+        pubkey: &str,
+        exercise: &str,
+        calls: &AtomicUsize,
+    ) -> (Arc<Endpoint>, bool) {
+        cache
+            .get_or_resolve(pubkey, exercise, || async {
+                calls.fetch_add(1, Ordering::SeqCst);
+                Ok(endpoint("10.0.0.2"))
+            })
+            .await
+            .unwrap()
+    }
+
+    #[tokio::test]
+    async fn test_repeated_lookups_are_cached() {
+        let cache = EndpointCache::new(Duration::from_secs(60));
+        let calls = AtomicUsize::new(0);
+        assert!(!resolve(&cache, KEY_A, "ex", &calls).await.1);
+        let (endpoint, cached) = resolve(&cache, KEY_A, "ex", &calls).await;
+        assert!(cached);
+        assert_eq!(endpoint.ip, "10.0.0.2");
+        assert_eq!(calls.load(Ordering::SeqCst), 1);
+
+        // Entries are per key and exercise, the key comment is ignored.
+        resolve(&cache, KEY_A, "other", &calls).await;
+        resolve(&cache, KEY_B, "ex", &calls).await;
+        assert_eq!(calls.load(Ordering::SeqCst), 3);
+        assert!(resolve(&cache, "ssh-ed25519 AAAAC3NzaC1lZDI1NTE5AAAAIA", "ex", &calls).await.1);
+    }
+
+    #[tokio::test]
+    async fn test_zero_ttl_disables_caching() {
+        let cache = EndpointCache::new(Duration::ZERO);
+        let calls = AtomicUsize::new(0);
+        resolve(&cache, KEY_A, "ex", &calls).await;
+        assert!(!resolve(&cache, KEY_A, "ex", &calls).await.1);
+        assert_eq!(calls.load(Ordering::SeqCst), 2);
+        assert_eq!(cache.len(), 0);
+    }
+
+    #[tokio::test]
+    async fn test_entries_expire() {
+        let ttl = Duration::from_secs(60);
+        let cache = EndpointCache::new(ttl);
+        let calls = AtomicUsize::new(0);
+        resolve(&cache, KEY_A, "ex", &calls).await;
+        let key = EndpointCache::cache_key(KEY_A, "ex");
+        assert!(cache.lookup(&key, Instant::now()).is_some());
+        assert!(cache.lookup(&key, Instant::now() + ttl).is_none());
+        assert_eq!(cache.len(), 0);
+    }
+
+    #[tokio::test]
+    async fn test_errors_are_not_cached() {
+        let cache = EndpointCache::new(Duration::from_secs(60));
+        let result = cache
+            .get_or_resolve(KEY_A, "ex", || async { Err("failed".to_string()) })
+            .await;
+        assert_eq!(result.unwrap_err(), "failed");
+        let calls = AtomicUsize::new(0);
+        assert!(!resolve(&cache, KEY_A, "ex", &calls).await.1);
+    }
+
+    #[tokio::test]
+    async fn test_invalidation() {
+        let cache = EndpointCache::new(Duration::from_secs(60));
+        let calls = AtomicUsize::new(0);
+        for exercise in ["a", "b"] {
+            resolve(&cache, KEY_A, exercise, &calls).await;
+            resolve(&cache, KEY_B, exercise, &calls).await;
+        }
+
+        cache.invalidate(KEY_A, "a");
+        assert_eq!(cache.len(), 3);
+        cache.invalidate_key_data(key_data(KEY_B).unwrap());
+        assert_eq!(cache.len(), 1);
+        assert!(resolve(&cache, KEY_A, "b", &calls).await.1);
+        cache.clear();
+        assert_eq!(cache.len(), 0);
+    }
+
+    #[tokio::test]
+    async fn test_concurrent_resolutions_are_coalesced() {
+        let cache = EndpointCache::new(Duration::from_secs(60));
+        let calls = AtomicUsize::new(0);
+        let (tx, rx) = tokio::sync::watch::channel(false);
+
+        let lookups = (0..8).map(|_| {
+            let mut rx = rx.clone();
+            let calls = &calls;
+            cache.get_or_resolve(KEY_A, "ex", move || async move {
+                calls.fetch_add(1, Ordering::SeqCst);
+                rx.wait_for(|started| *started).await.unwrap();
+                Ok(endpoint("10.0.0.2"))
+            })
+        });
+        let lookups = futures::future::join_all(lookups);
+        tokio::pin!(lookups);
+
+        // Let all lookups reach the pending resolution before it completes.
+        tokio::select! {
+            biased;
+            _ = &mut lookups => panic!("resolution completed early"),
+            _ = tokio::task::yield_now() => {}
+        }
+        tx.send(true).unwrap();
+
+        for result in lookups.await {
+            assert_eq!(result.unwrap().0.ip, "10.0.0.2");
+        }
+        assert_eq!(calls.load(Ordering::SeqCst), 1);
+    }
+
+    #[tokio::test]
+    async fn test_invalidation_during_resolution_is_not_cached() {
+        let cache = EndpointCache::new(Duration::from_secs(60));
+        let (endpoint, _) = cache
+            .get_or_resolve(KEY_A, "ex", || async {
+                // E.g. the key sync reports the instance was stopped meanwhile.
+                cache.invalidate_key_data(key_data(KEY_A).unwrap());
+                Ok(endpoint("10.0.0.2"))
+            })
+            .await
+            .unwrap();
+        assert_eq!(endpoint.ip, "10.0.0.2");
+        assert_eq!(cache.len(), 0);
+    }
+}
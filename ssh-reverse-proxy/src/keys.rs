@@ -0,0 +1,203 @@
+//! Set of public keys that are allowed to authenticate.
+//!
+//! The set is kept in sync with the web API by polling `/api/getkeys` with the
+//! version of the last applied change, thus only keys that changed since then
+//! are transferred. Lookups read the current set via `ArcSwap` without taking
+//! a lock; updates build a new set and swap it in. Cached container endpoints
+//! of changed keys are dropped (see crate::endpoints).
+
+use crate::api::{ApiClient, GetKeysResponse};
+use crate::endpoints::EndpointCache;
+use anyhow::Result;
+use arc_swap::ArcSwap;
+use std::collections::HashSet;
+use std::sync::Arc;
+use std::time::Duration;
+use tokio::sync::Mutex;
+use tracing::{debug, info, warn};
+
+/// Returns the base64 encoded key data of an OpenSSH public key line.
+/// The key type and comment are not compared.
+pub fn key_data(key: &str) -> Option<&str> {
+    key.split_whitespace().nth(1)
+}
+
+/// Valid public keys, indexed by their key data.
+pub struct KeyStore {
+    api_client: ApiClient,
+    keys: ArcSwap<HashSet<String>>,
+    endpoints: Arc<EndpointCache>,
+    /// Version of the last applied change. The lock also serializes syncs.
+    version: Mutex<Option<i64>>,
+}
+
+impl KeyStore {
+    pub fn new(api_client: ApiClient, endpoints: Arc<EndpointCache>) -> Self {
+        Self {
+            api_client,
+            keys: ArcSwap::from_pointee(HashSet::new()),
+            endpoints,
+            version: Mutex::new(None),
+        }
+    }
+
+    /// Check whether the given OpenSSH public key is valid.
+    pub fn contains(&self, key: &str) -> bool {
+        match key_data(key) {
+            Some(data) => self.keys.load().contains(data),
+            None => false,
+        }
+    }
+
+    pub fn len(&self) -> usize {
+        self.keys.load().len()
+    }
+
+    /// Fetch and apply all changes since the last sync.
+    pub async fn sync(&self) -> Result<()> {
+        let mut version = self.version.lock().await;
+        let changes = self.api_client.get_keys(*version).await?;
+        self.apply(&changes);
+        *version = Some(changes.version);
+        Ok(())
+    }
+
+    fn apply(&self, changes: &GetKeysResponse) {
+        if let Some(keys) = &changes.keys {
+            let keys: HashSet<String> = keys
+                .iter()
+                .filter_map(|k| key_data(k))
+                .map(str::to_owned)
+                .collect();
+            info!(
+                "Loaded {} public keys (version {})",
+                keys.len(),
+                changes.version
+            );
+            self.keys.store(Arc::new(keys));
+            self.endpoints.clear();
+            return;
+        }
+
+        if changes.added.is_empty() && changes.removed.is_empty() {
+            return;
+        }
+
+        let mut keys = HashSet::clone(&self.keys.load());
+        for key in changes.removed.iter().filter_map(|k| key_data(k)) {
+            keys.remove(key);
+            self.endpoints.invalidate_key_data(key);
+        }
+        for key in changes.added.iter().filter_map(|k| key_data(k)) {
+            keys.insert(key.to_owned());
+            self.endpoints.invalidate_key_data(key);
+        }
+        info!(
+            "Applied key changes (+{}, -{}), {} keys (version {})",
+            changes.added.len(),
+            changes.removed.len(),
+            keys.len(),
+            changes.version
+        );
+        self.keys.store(Arc::new(keys));
+    }
+}
+
+/// Spawn a background task that syncs the key store every `interval`.
+pub fn spawn_key_sync_task(store: Arc<KeyStore>, interval: Duration) {
+    tokio::spawn(async move {
+        loop {
+            tokio::time::sleep(interval).await;
+            match store.sync().await {
+                Ok(()) => debug!(
+                    "Key store synced, {} keys, {} cached endpoints",
+                    store.len(),
+                    store.endpoints.len()
+                ),
+                Err(e) => {
+                    warn!("Failed to sync keys: {}", e);
+                    // Changes are unknown until the next successful sync, thus
+                    // the cached endpoints might be outdated.
+                    store.endpoints.clear();
+                }
+            }
+        }
+    });
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+    use crate::endpoints::Endpoint;
+
+    const KEY_A: &str = "ssh-ed25519 AAAAC3NzaC1lZDI1NTE5AAAAIA a@host";
+    const KEY_B: &str = "ssh-rsa AAAAB3NzaC1yc2EAAAADAQABAAABAQ b@host";
+
+    fn store() -> KeyStore {
+        KeyStore::new(
+            ApiClient::new("http://test".to_string(), b"test_secret".to_vec()),
+            Arc::new(EndpointCache::new(Duration::from_secs(60))),
+        )
+    }
+
+    fn response(keys: Option<&[&str]>, added: &[&str], removed: &[&str]) -> GetKeysResponse {
+        let owned = |keys: &[&str]| -> Vec<String> { keys.iter().map(|k| k.to_string()).collect() };
+        GetKeysResponse {
+            version: 1,
+            keys: keys.map(owned),
+            added: owned(added),
+            removed: owned(removed),
+        }
+    }
+
+    #[test]
+    fn test_full_set_replaces_keys() {
+        let store = store();
+        store.apply(&response(Some(&[KEY_A]), &[], &[]));
+        assert!(store.contains(KEY_A));
+        store.apply(&response(Some(&[KEY_B]), &[], &[]));
+        assert!(!store.contains(KEY_A));
+        assert!(store.contains(KEY_B));
+    }
+
+    #[test]
+    fn test_changes_are_applied() {
+        let store = store();
+        store.apply(&response(Some(&[KEY_A]), &[], &[]));
+        store.apply(&response(None, &[KEY_B], &[KEY_A]));
+        assert!(!store.contains(KEY_A));
+        assert!(store.contains(KEY_B));
+        assert_eq!(store.len(), 1);
+    }
+
+    #[tokio::test]
+    async fn test_changes_invalidate_endpoints() {
+        let store = store();
+        for key in [KEY_A, KEY_B] {
+            store
+                .endpoints
+                .get_or_resolve(key, "ex", || async {
+                    Ok(Endpoint {
+                        instance_id: 1,
+                        ip: "10.0.0.2".to_string(),
+                        as_root: false,
+                        welcome_message: None,
+                    })
+                })
+                .await
+                .unwrap();
+        }
+        store.apply(&response(None, &[KEY_A], &[]));
+        assert_eq!(store.endpoints.len(), 1);
+        store.apply(&response(Some(&[KEY_B]), &[], &[]));
+        assert_eq!(store.endpoints.len(), 0);
+    }
+
+    #[test]
+    fn test_comment_and_type_are_ignored() {
+        let store = store();
+        store.apply(&response(Some(&[KEY_A]), &[], &[]));
+        assert!(store.contains("ssh-ed25519 AAAAC3NzaC1lZDI1NTE5AAAAIA"));
+        assert!(!store.contains("ssh-ed25519"));
+    }
+}
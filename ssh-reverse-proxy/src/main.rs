@@ -6,6 +6,8 @@
 mod api;
 mod channel;
 mod config;
+mod endpoints;
+mod keys;
 mod server;
 
 use anyhow::Result;
@@ -1,9 +1,11 @@
 //! SSH server implementation using russh.
 
 use crate::api::ApiClient;
-use crate::channel::{ChannelForwarder, ContainerEvent, DirectTcpIpForwarder, RemoteForwardManager, ShellForwarder, X11ForwardState, channel_msg_to_event};
+use crate::channel::{container_instance_id, BatchReader, ChannelForwarder, ContainerEvent, DirectTcpIpForwarder, RemoteForwardManager, ShellForwarder, X11ForwardState};
 use russh::ChannelReadHalf;
 use crate::config::Config;
+use crate::endpoints::{Endpoint, EndpointCache};
+use crate::keys::{spawn_key_sync_task, KeyStore};
 use anyhow::{Context, Result};
 use russh::keys::PrivateKey;
 use russh::server::{self, Auth, Handle, Msg, Server, Session};
@@ -11,7 +13,6 @@ use russh::{Channel, ChannelId, CryptoVec};
 use std::collections::HashMap;
 use std::path::Path;
 use std::sync::Arc;
-use tokio::sync::Mutex;
 use tracing::{debug, error, info, warn};
 use uuid::Uuid;
 
@@ -23,6 +24,8 @@ pub struct ConnectionState {
     pub pubkey: Option<String>,
     /// Container IP after provisioning
     pub container_ip: Option<String>,
+    /// Whether the container IP was taken from the endpoint cache
+    pub endpoint_cached: bool,
     /// Whether to connect as root
     pub as_root: bool,
     /// Whether TCP forwarding is allowed
@@ -71,6 +74,7 @@ impl Default for ConnectionState {
             exercise_name: String::new(),
             pubkey: None,
             container_ip: None,
+            endpoint_cached: false,
             as_root: false,
             tcp_forwarding_allowed: false,
             x11_forwarding_allowed: false,
@@ -121,28 +125,32 @@ impl ContainerKeys {
 pub struct SshServer {
     api_client: ApiClient,
     config: Config,
-    /// Cache of valid public keys (refreshed periodically)
-    valid_keys: Arc<Mutex<Vec<String>>>,
+    /// Valid public keys (synced with the web API)
+    valid_keys: Arc<KeyStore>,
+    /// Resolved container endpoints (invalidated by the key sync)
+    endpoints: Arc<EndpointCache>,
     /// Container authentication keys
     container_keys: Arc<ContainerKeys>,
 }
 
 impl SshServer {
     pub fn new(config: Config, api_client: ApiClient, container_keys: ContainerKeys) -> Self {
+        let endpoints = Arc::new(EndpointCache::new(std::time::Duration::from_secs(
+            config.container.endpoint_cache_ttl_secs,
+        )));
         Self {
+            valid_keys: Arc::new(KeyStore::new(api_client.clone(), Arc::clone(&endpoints))),
+            endpoints,
             api_client,
             config,
-            valid_keys: Arc::new(Mutex::new(Vec::new())),
             container_keys: Arc::new(container_keys),
         }
     }
 
     /// Refresh the cache of valid public keys.
     pub async fn refresh_keys(&self) -> Result<()> {
-        let keys = self.api_client.get_keys().await?;
-        let mut cache = self.valid_keys.lock().await;
-        *cache = keys;
-        info!("Refreshed {} public keys", cache.len());
+        self.valid_keys.sync().await?;
+        info!("Refreshed {} public keys", self.valid_keys.len());
         Ok(())
     }
 }
@@ -156,6 +164,7 @@ impl server::Server for SshServer {
             api_client: self.api_client.clone(),
             config: self.config.clone(),
             valid_keys: Arc::clone(&self.valid_keys),
+            endpoints: Arc::clone(&self.endpoints),
             container_keys: Arc::clone(&self.container_keys),
         }
     }
@@ -166,7 +175,8 @@ pub struct SshConnection {
     state: ConnectionState,
     api_client: ApiClient,
     config: Config,
-    valid_keys: Arc<Mutex<Vec<String>>>,
+    valid_keys: Arc<KeyStore>,
+    endpoints: Arc<EndpointCache>,
     container_keys: Arc<ContainerKeys>,
 }
 
@@ -177,29 +187,141 @@ impl SshConnection {
         key.to_string()
     }
 
+    /// Ask the web API for the container of the given key and exercise. This
+    /// starts the instance if it is not running yet.
+    async fn fetch_endpoint(
+        api_client: &ApiClient,
+        exercise_name: &str,
+        key_str: &str,
+    ) -> Result<Endpoint, String> {
+        use std::io::Write;
+        eprintln!("[SSH-PROXY] Calling ssh_authenticated API...");
+        std::io::stderr().flush().ok();
+        let auth_response = api_client
+            .ssh_authenticated(exercise_name, key_str)
+            .await
+            .map_err(|e| format!("Failed to get user permissions: {}", e))?;
+        debug!("User authenticated: instance_id={}", auth_response.instance_id);
+
+        eprintln!("[SSH-PROXY] Calling provision API...");
+        std::io::stderr().flush().ok();
+        let provision = api_client
+            .provision(exercise_name, key_str)
+            .await
+            .map_err(|e| format!("Failed to provision container: {}", e))?;
+        Ok(Endpoint {
+            instance_id: auth_response.instance_id,
+            ip: provision.ip,
+            as_root: provision.as_root,
+            welcome_message: provision.welcome_message,
+        })
+    }
+
+    async fn lookup_endpoint(&self, key_str: &str) -> Result<(Arc<Endpoint>, bool), String> {
+        let exercise_name = &self.state.exercise_name;
+        let api_client = &self.api_client;
+        self.endpoints
+            .get_or_resolve(key_str, exercise_name, || {
+                Self::fetch_endpoint(api_client, exercise_name, key_str)
+            })
+            .await
+    }
+
+    /// Check whether the container at the endpoint still belongs to the
+    /// instance the endpoint was resolved for. All containers accept the
+    /// proxy's key, thus an IP that was reassigned to the container of another
+    /// instance must not be used.
+    async fn is_same_instance(&self, endpoint: &Endpoint) -> bool {
+        let username = if endpoint.as_root { "root" } else { "user" };
+        let auth_key = self.container_keys.get_key(endpoint.as_root);
+        let port = self.config.container.ssh_port;
+        match container_instance_id(&endpoint.ip, port, auth_key, username).await {
+            Ok(instance_id) => instance_id == endpoint.instance_id,
+            Err(e) => {
+                debug!("Failed to read the instance ID of {}: {}", endpoint.ip, e);
+                false
+            }
+        }
+    }
+
+    /// Resolve the container of the authenticated key, see crate::endpoints.
+    async fn resolve_endpoint(&mut self) -> Result<(), String> {
+        let key_str = self.state.pubkey.clone().ok_or("Not authenticated")?;
+        let (mut endpoint, mut cached) = self.lookup_endpoint(&key_str).await?;
+        if cached && !self.is_same_instance(&endpoint).await {
+            warn!("Cached container endpoint {} is outdated, resolving it again", endpoint.ip);
+            self.endpoints.invalidate(&key_str, &self.state.exercise_name);
+            (endpoint, cached) = self.lookup_endpoint(&key_str).await?;
+        }
+
+        info!(
+            "{} container at {} for exercise {} (as_root={})",
+            if cached { "Cached" } else { "Provisioned" },
+            endpoint.ip, self.state.exercise_name, endpoint.as_root
+        );
+        self.state.container_ip = Some(endpoint.ip.clone());
+        self.state.as_root = endpoint.as_root;
+        self.state.welcome_message = endpoint.welcome_message.clone();
+        self.state.endpoint_cached = cached;
+        Ok(())
+    }
+
+    /// Connect to the SSH server of the container. If connecting fails, the
+    /// endpoint is dropped from the cache. If it was taken from the cache, the
+    /// container may have been stopped meanwhile, thus the endpoint is resolved
+    /// again and connecting is retried once.
+    async fn connect_container(&mut self) -> Result<ShellForwarder> {
+        let result = self.try_connect_container().await;
+        if result.is_ok() {
+            return result;
+        }
+        if let Some(key_str) = &self.state.pubkey {
+            self.endpoints.invalidate(key_str, &self.state.exercise_name);
+        }
+        if !self.state.endpoint_cached {
+            return result;
+        }
+        warn!("Failed to connect to cached container endpoint, resolving it again");
+        self.resolve_endpoint().await.map_err(anyhow::Error::msg)?;
+        self.try_connect_container().await
+    }
+
+    async fn try_connect_container(&self) -> Result<ShellForwarder> {
+        let container_ip = self
+            .state
+            .container_ip
+            .as_deref()
+            .context("No container IP available")?;
+        let container_port = self.config.container.ssh_port;
+        let username = if self.state.as_root { "root" } else { "user" };
+        let auth_key = self.container_keys.get_key(self.state.as_root);
+
+        info!(
+            "Connecting to container {}:{} as {}",
+            container_ip, container_port, username
+        );
+        ShellForwarder::connect(container_ip, container_port, auth_key, username).await
+    }
+
     /// Spawn a task to forward events from container to client.
     fn spawn_event_forwarder(
-        mut read_half: ChannelReadHalf,
+        read_half: ChannelReadHalf,
         session_handle: Handle,
         client_channel_id: ChannelId,
     ) {
         tokio::spawn(async move {
-            while let Some(msg) = read_half.wait().await {
-                let event = match channel_msg_to_event(msg) {
-                    Some(e) => e,
-                    None => continue, // Skip ignored messages
-                };
-
+            let mut reader = BatchReader::new(read_half);
+            while let Some(event) = reader.next().await {
                 let result: Result<(), String> = match event {
                     ContainerEvent::Data(data) => {
                         session_handle
-                            .data(client_channel_id, CryptoVec::from_slice(&data))
+                            .data(client_channel_id, data)
                             .await
                             .map_err(|e| format!("data: {:?}", e))
                     }
                     ContainerEvent::ExtendedData { ext_type, data } => {
                         session_handle
-                            .extended_data(client_channel_id, ext_type, CryptoVec::from_slice(&data))
+                            .extended_data(client_channel_id, ext_type, data)
                             .await
                             .map_err(|e| format!("extended_data: {:?}", e))
                     }
@@ -292,69 +414,25 @@ impl server::Handler for SshConnection {
         std::io::stderr().flush().ok();
         info!("[AUTH] Client public key: {}", key_str);
 
-        // Helper to check if key is in cache
-        let check_key_in_cache = |cache: &[String], key: &str| -> bool {
-            let key_parts: Vec<&str> = key.split_whitespace().collect();
-            eprintln!("[SSH-PROXY] Client key parts count: {}", key_parts.len());
-            std::io::stderr().flush().ok();
-            if key_parts.len() >= 2 {
-                eprintln!("[SSH-PROXY] Client key type: {}, data (first 40): {}...",
-                    key_parts[0],
-                    &key_parts[1][..std::cmp::min(40, key_parts[1].len())]);
-                std::io::stderr().flush().ok();
-            }
-
-            for (i, k) in cache.iter().enumerate() {
-                let cached_parts: Vec<&str> = k.split_whitespace().collect();
-                if cached_parts.len() >= 2 {
-                    eprintln!("[SSH-PROXY] Cached key {}: type={}, data (first 40): {}...",
-                        i, cached_parts[0],
-                        &cached_parts[1][..std::cmp::min(40, cached_parts[1].len())]);
-                    std::io::stderr().flush().ok();
-                    if key_parts.len() >= 2 && key_parts[1] == cached_parts[1] {
-                        eprintln!("[SSH-PROXY] Found matching key at index {}", i);
-                        std::io::stderr().flush().ok();
-                        return true;
-                    }
-                } else {
-                    eprintln!("[SSH-PROXY] Cached key {} has {} parts: {:?}", i, cached_parts.len(), k);
-                    std::io::stderr().flush().ok();
-                }
-            }
-            eprintln!("[SSH-PROXY] No matching key found in cache");
-            std::io::stderr().flush().ok();
-            false
-        };
-
         // Check if the key is in our valid keys cache
         eprintln!("[SSH-PROXY] Checking key against cache...");
         std::io::stderr().flush().ok();
-        let mut is_valid = {
-            let cache = self.valid_keys.lock().await;
-            eprintln!("[SSH-PROXY] Cache has {} keys", cache.len());
-            std::io::stderr().flush().ok();
-            info!("[AUTH] Checking key against {} cached keys", cache.len());
-            check_key_in_cache(&cache, &key_str)
-        };
+        info!("[AUTH] Checking key against {} cached keys", self.valid_keys.len());
+        let mut is_valid = self.valid_keys.contains(&key_str);
 
-        // If not found, refresh keys and try again (for newly registered users)
+        // If not found, fetch the latest key changes and try again (for newly registered users)
         if !is_valid {
-            eprintln!("[SSH-PROXY] Key not in cache, refreshing on-demand...");
+            eprintln!("[SSH-PROXY] Key not in cache, syncing on-demand...");
             std::io::stderr().flush().ok();
-            info!("[AUTH] Key not in cache, refreshing keys on-demand");
-            match self.api_client.get_keys().await {
-                Ok(keys) => {
-                    let mut cache = self.valid_keys.lock().await;
-                    eprintln!("[SSH-PROXY] On-demand refresh got {} keys", keys.len());
-                    std::io::stderr().flush().ok();
-                    info!("[AUTH] On-demand refresh got {} keys", keys.len());
-                    *cache = keys;
-                    is_valid = check_key_in_cache(&cache, &key_str);
+            info!("[AUTH] Key not in cache, syncing keys on-demand");
+            match self.valid_keys.sync().await {
+                Ok(()) => {
+                    is_valid = self.valid_keys.contains(&key_str);
                 }
                 Err(e) => {
-                    eprintln!("[SSH-PROXY] Failed to refresh keys: {}", e);
+                    eprintln!("[SSH-PROXY] Failed to sync keys: {}", e);
                     std::io::stderr().flush().ok();
-                    error!("[AUTH] Failed to refresh keys on-demand: {}", e);
+                    error!("[AUTH] Failed to sync keys on-demand: {}", e);
                 }
             }
         }
@@ -375,66 +453,21 @@ impl server::Handler for SshConnection {
         // Store the authenticated key
         self.state.pubkey = Some(key_str.clone());
 
-        // Get user permissions from API
-        eprintln!("[SSH-PROXY] Calling ssh_authenticated API...");
-        std::io::stderr().flush().ok();
-        match self
-            .api_client
-            .ssh_authenticated(&self.state.exercise_name, &key_str)
-            .await
-        {
-            Ok(auth_response) => {
-                eprintln!("[SSH-PROXY] ssh_authenticated succeeded: instance_id={}", auth_response.instance_id);
-                std::io::stderr().flush().ok();
-                // TODO: Use API response for permissions when webapp supports it
-                // For now, mock all permissions as allowed (per user request)
-                self.state.tcp_forwarding_allowed = true;  // Mocked: always allow
-                self.state.x11_forwarding_allowed = true;  // Mocked: always allow
-                debug!(
-                    "User authenticated: instance_id={}, forwarding={}, x11={} (mocked: always allowed)",
-                    auth_response.instance_id, self.state.tcp_forwarding_allowed, self.state.x11_forwarding_allowed
-                );
-            }
-            Err(e) => {
-                eprintln!("[SSH-PROXY] ssh_authenticated FAILED: {}", e);
-                std::io::stderr().flush().ok();
-                error!("Failed to get user permissions: {}", e);
-                return Ok(Auth::Reject {
-                    proceed_with_methods: None,
-                    partial_success: false,
-                });
-            }
+        // Resolve the container, skipping the web API if it is cached
+        if let Err(e) = self.resolve_endpoint().await {
+            eprintln!("[SSH-PROXY] Resolving the container FAILED: {}", e);
+            std::io::stderr().flush().ok();
+            error!("Failed to provision container: {}", e);
+            return Ok(Auth::Reject {
+                proceed_with_methods: None,
+                partial_success: false,
+            });
         }
 
-        // Provision the container
-        eprintln!("[SSH-PROXY] Calling provision API...");
-        std::io::stderr().flush().ok();
-        match self
-            .api_client
-            .provision(&self.state.exercise_name, &key_str)
-            .await
-        {
-            Ok(provision) => {
-                eprintln!("[SSH-PROXY] Provisioned container at {} (as_root={})", provision.ip, provision.as_root);
-                std::io::stderr().flush().ok();
-                self.state.container_ip = Some(provision.ip.clone());
-                self.state.as_root = provision.as_root;
-                self.state.welcome_message = provision.welcome_message;
-                info!(
-                    "Provisioned container at {} for exercise {} (as_root={})",
-                    provision.ip, self.state.exercise_name, provision.as_root
-                );
-            }
-            Err(e) => {
-                eprintln!("[SSH-PROXY] Provision FAILED: {}", e);
-                std::io::stderr().flush().ok();
-                error!("Failed to provision container: {}", e);
-                return Ok(Auth::Reject {
-                    proceed_with_methods: None,
-                    partial_success: false,
-                });
-            }
-        }
+        // TODO: Use API response for permissions when webapp supports it
+        // For now, mock all permissions as allowed (per user request)
+        self.state.tcp_forwarding_allowed = true;  // Mocked: always allow
+        self.state.x11_forwarding_allowed = true;  // Mocked: always allow
 
         eprintln!("[SSH-PROXY] Auth complete - returning Accept");
         std::io::stderr().flush().ok();
@@ -501,33 +534,8 @@ impl server::Handler for SshConnection {
     ) -> Result<(), Self::Error> {
         debug!("Shell requested on channel {:?}", channel_id);
 
-        let container_ip = match &self.state.container_ip {
-            Some(ip) => ip.clone(),
-            None => {
-                error!("No container IP available");
-                return Ok(());
-            }
-        };
-
-        // Get container SSH port from config
-        let container_port = self.config.container.ssh_port;
-        let username = if self.state.as_root { "root" } else { "user" };
-        let auth_key = self.container_keys.get_key(self.state.as_root);
-
         // Connect to container SSH
-        info!(
-            "Connecting to container {}:{} as {}",
-            container_ip, container_port, username
-        );
-
-        let mut forwarder = match ShellForwarder::connect(
-            &container_ip,
-            container_port,
-            auth_key,
-            username,
-        )
-        .await
-        {
+        let mut forwarder = match self.connect_container().await {
             Ok(f) => f,
             Err(e) => {
                 let error_id = Uuid::new_v4();
@@ -541,6 +549,7 @@ impl server::Handler for SshConnection {
                 return Ok(());
             }
         };
+        let container_ip = self.state.container_ip.clone().unwrap_or_default();
 
         // Request PTY on container if we have params
         if let Some(ctx) = self.state.channels.get(&channel_id) {
@@ -601,29 +610,8 @@ impl server::Handler for SshConnection {
     ) -> Result<(), Self::Error> {
         debug!("Exec requested on channel {:?}: {:?}", channel_id, String::from_utf8_lossy(data));
 
-        let container_ip = match &self.state.container_ip {
-            Some(ip) => ip.clone(),
-            None => {
-                error!("No container IP available");
-                session.channel_failure(channel_id)?;
-                return Ok(());
-            }
-        };
-
-        // Get container SSH port from config
-        let container_port = self.config.container.ssh_port;
-        let username = if self.state.as_root { "root" } else { "user" };
-        let auth_key = self.container_keys.get_key(self.state.as_root);
-
         // Connect to container SSH
-        let mut forwarder = match ShellForwarder::connect(
-            &container_ip,
-            container_port,
-            auth_key,
-            username,
-        )
-        .await
-        {
+        let mut forwarder = match self.connect_container().await {
             Ok(f) => f,
             Err(e) => {
                 let error_id = Uuid::new_v4();
@@ -633,6 +621,7 @@ impl server::Handler for SshConnection {
                 return Ok(());
             }
         };
+        let container_ip = self.state.container_ip.clone().unwrap_or_default();
 
         // Execute command on container
         if let Err(e) = forwarder.exec(data).await {
@@ -672,29 +661,8 @@ impl server::Handler for SshConnection {
     ) -> Result<(), Self::Error> {
         debug!("Subsystem '{}' requested on channel {:?}", name, channel_id);
 
-        let container_ip = match &self.state.container_ip {
-            Some(ip) => ip.clone(),
-            None => {
-                error!("No container IP available");
-                session.channel_failure(channel_id)?;
-                return Ok(());
-            }
-        };
-
-        // Get container SSH port from config
-        let container_port = self.config.container.ssh_port;
-        let username = if self.state.as_root { "root" } else { "user" };
-        let auth_key = self.container_keys.get_key(self.state.as_root);
-
         // Connect to container SSH
-        let mut forwarder = match ShellForwarder::connect(
-            &container_ip,
-            container_port,
-            auth_key,
-            username,
-        )
-        .await
-        {
+        let mut forwarder = match self.connect_container().await {
             Ok(f) => f,
             Err(e) => {
                 let error_id = Uuid::new_v4();
@@ -704,6 +672,7 @@ impl server::Handler for SshConnection {
                 return Ok(());
             }
         };
+        let container_ip = self.state.container_ip.clone().unwrap_or_default();
 
         // Request subsystem on container
         if let Err(e) = forwarder.request_subsystem(name).await {
@@ -1017,36 +986,6 @@ impl server::Handler for SshConnection {
     }
 }
 
-/// Spawn a background task that periodically refreshes the key cache.
-fn spawn_key_refresh_task(
-    api_client: ApiClient,
-    valid_keys: Arc<Mutex<Vec<String>>>,
-    refresh_interval_secs: u64,
-) {
-    tokio::spawn(async move {
-        let interval = std::time::Duration::from_secs(refresh_interval_secs);
-        loop {
-            tokio::time::sleep(interval).await;
-            match api_client.get_keys().await {
-                Ok(keys) => {
-                    let mut cache = valid_keys.lock().await;
-                    if *cache != keys {
-                        info!(
-                            "Key cache updated: {} -> {} keys",
-                            cache.len(),
-                            keys.len()
-                        );
-                        *cache = keys;
-                    }
-                }
-                Err(e) => {
-                    warn!("Failed to refresh keys: {}", e);
-                }
-            }
-        }
-    });
-}
-
 /// Run the SSH server.
 pub async fn run_server(config: Config) -> Result<()> {
     use std::io::Write;
@@ -1067,7 +1006,7 @@ pub async fn run_server(config: Config) -> Result<()> {
     eprintln!("[SSH-PROXY] run_server: Creating server...");
     std::io::stderr().flush().ok();
 
-    let mut server = SshServer::new(config.clone(), api_client.clone(), container_keys);
+    let mut server = SshServer::new(config.clone(), api_client, container_keys);
 
     // Initial key refresh with retries (web server may not be ready yet)
     eprintln!("[SSH-PROXY] run_server: Initial key refresh...");
@@ -1104,10 +1043,13 @@ pub async fn run_server(config: Config) -> Result<()> {
         }
     }
 
-    // Spawn background task to periodically refresh keys (every 60 seconds)
-    eprintln!("[SSH-PROXY] run_server: Spawning key refresh task...");
+    // Spawn background task that applies key changes (every second)
+    eprintln!("[SSH-PROXY] run_server: Spawning key sync task...");
     std::io::stderr().flush().ok();
-    spawn_key_refresh_task(api_client, Arc::clone(&server.valid_keys), 60);
+    spawn_key_sync_task(
+        Arc::clone(&server.valid_keys),
+        std::time::Duration::from_secs(1),
+    );
 
     // Load or generate host key (persisted across restarts)
     let key_path = &config.server.host_key_path;
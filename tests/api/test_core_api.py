@@ -20,6 +20,8 @@ import httpx
 import pytest
 
 if TYPE_CHECKING:
+    from helpers.ref_instance import REFInstance
+
     from .conftest import StudentCredentials
 
 
@@ -191,6 +193,41 @@ class TestApiGetkeys:
         response = raw_client.get("/api/getkeys")
         assert response.status_code == 400
 
+    def test_signed_key_changes(
+        self,
+        raw_client: httpx.Client,
+        ref_instance: REFInstance,
+        registered_student: StudentCredentials,
+    ) -> None:
+        """Signed requests with `since` only return the changed keys."""
+        from itsdangerous import Serializer
+
+        signer = Serializer(ref_instance.config.ssh_to_web_key)
+
+        def getkeys(**kwargs):
+            payload = signer.dumps({"username": "NotUsed", **kwargs})
+            response = raw_client.post("/api/getkeys", json=payload)
+            assert response.status_code == 200
+            return response.json()
+
+        pubkey = registered_student.public_key.strip()
+
+        full = getkeys()
+        assert pubkey in [k.strip() for k in full["keys"]]
+        assert full["version"] > 0
+
+        delta = getkeys(since=full["version"])
+        assert "keys" not in delta
+        assert delta["version"] >= full["version"]
+
+        delta = getkeys(since=0)
+        assert "keys" not in delta
+        assert pubkey in [k.strip() for k in delta["added"]]
+        assert pubkey not in [k.strip() for k in delta["removed"]]
+
+        # Versions from the future (e.g., after a DB reset) yield the full set.
+        assert "keys" in getkeys(since=full["version"] + 10**9)
+
 
 @pytest.mark.api
 @pytest.mark.security
@@ -301,6 +338,50 @@ class TestApiInstanceSubmit:
         )
         assert response.status_code == 400
 
+    def test_compressed_missing_signature(self, raw_client: httpx.Client) -> None:
+        """Compressed request without signature header should be rejected."""
+        response = raw_client.post(
+            "/api/instance/submit",
+            content=b"\x28\xb5\x2f\xfd",
+            headers={"Content-Type": "application/zstd"},
+        )
+        assert response.status_code == 400
+
+    def test_compressed_invalid_signature(self, raw_client: httpx.Client) -> None:
+        """Compressed request with forged signature should be rejected."""
+        response = raw_client.post(
+            "/api/instance/submit",
+            content=b"\x28\xb5\x2f\xfd",
+            headers={
+                "Content-Type": "application/zstd",
+                "X-REF-Signature": "1:" + "0" * 64 + ".invalid.invalid",
+            },
+        )
+        assert response.status_code == 400
+
+
+@pytest.mark.api
+@pytest.mark.security
+class TestApiInstanceSubmitStatus:
+    """
+    Tests for /api/instance/submit/status endpoint.
+
+    This endpoint requires signed container request.
+    """
+
+    def test_missing_json_body(self, raw_client: httpx.Client) -> None:
+        """Request without JSON body should return error."""
+        response = raw_client.post("/api/instance/submit/status")
+        assert response.status_code == 400
+
+    def test_invalid_signature(self, raw_client: httpx.Client) -> None:
+        """Invalid signature should be rejected."""
+        response = raw_client.post(
+            "/api/instance/submit/status",
+            json={"instance_id": 1, "ticket": 1},
+        )
+        assert response.status_code == 400
+
 
 @pytest.mark.api
 @pytest.mark.security
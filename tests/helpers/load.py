@@ -0,0 +1,278 @@
+"""
+REF Load Test Helpers
+
+Building blocks of the cohort load test (see ../load_test.py): the session a
+synthetic student runs through the SSH reverse proxy, latency statistics, and
+sampling of the CPU time used by the web container and the Docker daemon.
+"""
+
+import os
+import threading
+import time
+from dataclasses import dataclass, field
+from pathlib import Path
+from typing import Callable, Dict, List, Optional, Sequence, Tuple
+
+from .ssh_client import REFSSHClient
+
+# Phases of a student session, in the order they are run.
+PHASES = ("login", "shell", "check", "submit", "reset")
+
+
+@dataclass
+class Sample:
+    phase: str
+    duration_s: float
+    ok: bool
+    error: Optional[str] = None
+
+
+@dataclass
+class PhaseStats:
+    phase: str
+    runs: int
+    failures: int
+    mean_s: float
+    p50_s: float
+    p90_s: float
+    p99_s: float
+    max_s: float
+    errors: List[str] = field(default_factory=list)
+
+
+@dataclass
+class CpuUsage:
+    """CPU used by a process or container, in cores (1.0 = one busy CPU)."""
+
+    mean_cores: float
+    max_cores: float
+
+
+def percentile(sorted_values: Sequence[float], pct: float) -> float:
+    """Nearest-rank percentile of an already sorted sequence."""
+    if not sorted_values:
+        return 0.0
+    rank = round(pct / 100 * len(sorted_values)) - 1
+    return sorted_values[max(0, min(len(sorted_values) - 1, rank))]
+
+
+def summarize(phase: str, samples: Sequence[Sample], max_errors: int = 5) -> PhaseStats:
+    """
+    Latency statistics of the successful runs of a phase. Failed runs are only
+    counted, since their duration is mostly the time until the failure.
+    """
+    runs = [s for s in samples if s.phase == phase]
+    durations = sorted(s.duration_s for s in runs if s.ok)
+    failed = [s for s in runs if not s.ok]
+    errors: List[str] = []
+    for s in failed:
+        if s.error and s.error not in errors and len(errors) < max_errors:
+            errors.append(s.error)
+    return PhaseStats(
+        phase=phase,
+        runs=len(runs),
+        failures=len(failed),
+        mean_s=sum(durations) / len(durations) if durations else 0.0,
+        p50_s=percentile(durations, 50),
+        p90_s=percentile(durations, 90),
+        p99_s=percentile(durations, 99),
+        max_s=durations[-1] if durations else 0.0,
+        errors=errors,
+    )
+
+
+def cpu_usage(samples: Sequence[Tuple[float, float]]) -> Optional[CpuUsage]:
+    """
+    Convert (wall time, cumulative CPU seconds) samples into the mean and the
+    peak CPU usage between two consecutive samples.
+    """
+    if len(samples) < 2:
+        return None
+    rates = [
+        (cpu1 - cpu0) / (t1 - t0)
+        for (t0, cpu0), (t1, cpu1) in zip(samples, samples[1:])
+        if t1 > t0
+    ]
+    if not rates:
+        return None
+    (t_first, cpu_first), (t_last, cpu_last) = samples[0], samples[-1]
+    return CpuUsage(
+        mean_cores=(cpu_last - cpu_first) / (t_last - t_first),
+        max_cores=max(rates),
+    )
+
+
+def process_cpu_seconds(comm: str) -> Optional[float]:
+    """
+    CPU seconds (user + system) used so far by all processes named `comm`, or
+    None if there is no such process (e.g. Docker runs on another host).
+    """
+    ticks = os.sysconf("SC_CLK_TCK")
+    total = None
+    for stat in Path("/proc").glob("[0-9]*/stat"):
+        try:
+            content = stat.read_text()
+        except OSError:
+            continue
+        # The name is enclosed in parentheses and may contain spaces.
+        name = content[content.index("(") + 1 : content.rindex(")")]
+        if name != comm:
+            continue
+        fields = content[content.rindex(")") + 2 :].split()
+        # utime and stime are the 14th and 15th field of the full line.
+        total = (total or 0.0) + (int(fields[11]) + int(fields[12])) / ticks
+    return total
+
+
+def container_cpu_seconds(container) -> Optional[float]:
+    """CPU seconds used so far by a container (docker SDK object)."""
+    try:
+        stats = container.stats(stream=False, one_shot=True)
+        return stats["cpu_stats"]["cpu_usage"]["total_usage"] / 1e9
+    except Exception:
+        return None
+
+
+class CpuSampler:
+    """
+    Samples the cumulative CPU time of several sources in a background thread.
+
+    Each source is a callable returning the CPU seconds used so far, or None if
+    the value is not available.
+    """
+
+    def __init__(
+        self,
+        sources: Dict[str, Callable[[], Optional[float]]],
+        interval: float = 1.0,
+    ):
+        self.sources = sources
+        self.interval = interval
+        self.samples: Dict[str, List[Tuple[float, float]]] = {n: [] for n in sources}
+        self._stop = threading.Event()
+        self._thread: Optional[threading.Thread] = None
+
+    def _sample(self) -> None:
+        for name, source in self.sources.items():
+            value = source()
+            if value is not None:
+                self.samples[name].append((time.monotonic(), value))
+
+    def _run(self) -> None:
+        while not self._stop.wait(self.interval):
+            self._sample()
+
+    def __enter__(self) -> "CpuSampler":
+        self._sample()
+        self._thread = threading.Thread(target=self._run, daemon=True)
+        self._thread.start()
+        return self
+
+    def __exit__(self, *exc) -> None:
+        self._stop.set()
+        if self._thread is not None:
+            self._thread.join()
+        self._sample()
+
+    def usage(self) -> Dict[str, Optional[CpuUsage]]:
+        return {name: cpu_usage(samples) for name, samples in self.samples.items()}
+
+
+@dataclass
+class StudentWorkload:
+    """What each synthetic student does after logging in."""
+
+    exercise_name: str
+    # Number of `/bin/sh -c :` spawns of the shell phase.
+    shell_spawns: int = 200
+    # Files (remote path -> content) uploaded before `task check`.
+    files: Dict[str, str] = field(default_factory=dict)
+    connect_timeout: float = 120.0
+    task_timeout: float = 300.0
+
+
+class StudentSession:
+    """
+    One synthetic student: log in through the SSH reverse proxy (which provisions
+    the instance), spawn `/bin/sh` in a loop, run `task check` and `task submit`,
+    and finally `task reset`. Each phase is recorded as a Sample; once a phase
+    failed, the remaining phases are skipped.
+    """
+
+    def __init__(
+        self,
+        host: str,
+        port: int,
+        private_key: str,
+        workload: StudentWorkload,
+    ):
+        self.host = host
+        self.port = port
+        self.private_key = private_key
+        self.workload = workload
+        self.samples: List[Sample] = []
+        self.client: Optional[REFSSHClient] = None
+
+    def _phase(self, phase: str, fn: Callable[[], Tuple[bool, str]]) -> bool:
+        start = time.monotonic()
+        try:
+            ok, error = fn()
+        except Exception as e:
+            ok, error = False, f"{type(e).__name__}: {e}"
+        self.samples.append(
+            Sample(phase, time.monotonic() - start, ok, None if ok else error)
+        )
+        return ok
+
+    def _login(self) -> Tuple[bool, str]:
+        self.client = REFSSHClient(
+            self.host, self.port, timeout=self.workload.connect_timeout
+        )
+        self.client.connect(self.private_key, self.workload.exercise_name)
+        # The login is complete once the container runs commands.
+        exit_code, _, stderr = self.client.execute(
+            "true", timeout=self.workload.connect_timeout
+        )
+        return exit_code == 0, stderr.strip()
+
+    def _shell(self) -> Tuple[bool, str]:
+        assert self.client is not None
+        spawns = self.workload.shell_spawns
+        exit_code, _, stderr = self.client.execute(
+            f"for i in $(seq {spawns}); do /bin/sh -c : || exit 1; done",
+            timeout=self.workload.task_timeout,
+        )
+        return exit_code == 0, stderr.strip() or f"exit code {exit_code}"
+
+    def _check(self) -> Tuple[bool, str]:
+        assert self.client is not None
+        for path, content in self.workload.files.items():
+            self.client.write_file(path, content)
+        ok, output = self.client.check(timeout=self.workload.task_timeout)
+        return ok, _last_line(output)
+
+    def _submit(self) -> Tuple[bool, str]:
+        assert self.client is not None
+        ok, output = self.client.submit(timeout=self.workload.task_timeout)
+        return ok, _last_line(output)
+
+    def _reset(self) -> Tuple[bool, str]:
+        assert self.client is not None
+        ok, output = self.client.reset(timeout=self.workload.task_timeout)
+        return ok, _last_line(output)
+
+    def run(self) -> List[Sample]:
+        steps = (self._login, self._shell, self._check, self._submit, self._reset)
+        try:
+            for phase, step in zip(PHASES, steps):
+                if not self._phase(phase, step):
+                    break
+        finally:
+            if self.client is not None:
+                self.client.close()
+        return self.samples
+
+
+def _last_line(output: str) -> str:
+    lines = [line for line in output.strip().splitlines() if line.strip()]
+    return lines[-1][:200] if lines else "no output"
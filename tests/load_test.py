@@ -0,0 +1,349 @@
+#!/usr/bin/env python3
+"""
+Cohort load test: drive synthetic students through the SSH reverse proxy.
+
+For each concurrency level, that many students start at the same time. Each
+of them logs in (which provisions the instance), spawns `/bin/sh` in a loop,
+runs `task check` and `task submit`, and finally `task reset` (see
+helpers/load.py). Every level uses freshly registered students, thus each
+login creates a new instance, as at the start of an exam. Instances of
+earlier levels keep running.
+
+Reported per level are the latency percentiles and failure rates of each
+phase, and the CPU used by the web container and the Docker daemon (the
+latter only if Docker runs on this host).
+
+By default, a dedicated REF instance with a sample exercise is started, just
+like the e2e tests do. Use --web-url, --ssh-host, --ssh-port and --exercise
+to target a running deployment instead, e.g. the host that should serve the
+next semester. Results are written as JSON to load_reports/<timestamp>.json
+so runs can be diffed against an earlier baseline via `--compare`.
+
+Usage:
+    cd tests && uv run python load_test.py --levels 1,10,25,50
+"""
+
+import argparse
+import json
+import os
+import platform
+import sys
+import threading
+import time
+import uuid
+from concurrent.futures import ThreadPoolExecutor
+from contextlib import ExitStack
+from dataclasses import asdict, dataclass, field
+from pathlib import Path
+from typing import Any, Callable, Dict, List, Optional
+
+from helpers.exercise_factory import create_correct_solution, create_sample_exercise
+from helpers.load import (
+    PHASES,
+    CpuSampler,
+    CpuUsage,
+    PhaseStats,
+    Sample,
+    StudentSession,
+    StudentWorkload,
+    container_cpu_seconds,
+    process_cpu_seconds,
+    summarize,
+)
+from helpers.ref_instance import REFInstance
+from helpers.web_client import REFWebClient
+
+REPORTS_DIR = Path(__file__).parent / "load_reports"
+
+
+@dataclass
+class LevelResult:
+    concurrency: int
+    duration_s: float
+    phases: List[PhaseStats]
+    cpu: Dict[str, Optional[CpuUsage]]
+
+
+@dataclass
+class Report:
+    meta: Dict[str, Any]
+    levels: List[LevelResult] = field(default_factory=list)
+
+
+@dataclass
+class Target:
+    web_url: str
+    ssh_host: str
+    ssh_port: int
+    exercise_name: str
+    compose_project: Optional[str]
+
+
+def setup_exercise(instance: REFInstance) -> str:
+    """Import, build and enable the sample exercise used by the e2e tests."""
+    exercise_name = f"load_test_{uuid.uuid4().hex[:6]}"
+    create_sample_exercise(
+        instance.exercises_dir / exercise_name,
+        short_name=exercise_name,
+        category="Load Test",
+    )
+
+    admin = REFWebClient(instance.web_url)
+    try:
+        if not admin.login("0", instance.admin_password):
+            raise RuntimeError("Admin login failed")
+        if not admin.import_exercise(str(instance.exercises_dir / exercise_name)):
+            raise RuntimeError("Failed to import the exercise")
+        exercise_id = admin.get_exercise_id_by_name(exercise_name)
+        if exercise_id is None or not admin.build_exercise(exercise_id):
+            raise RuntimeError("Failed to build the exercise")
+        if not admin.wait_for_build(exercise_id, timeout=600.0):
+            raise RuntimeError("The exercise build did not complete")
+        if not admin.toggle_exercise_default(exercise_id):
+            raise RuntimeError("Failed to enable the exercise")
+    finally:
+        admin.close()
+    return exercise_name
+
+
+def register_students(web_url: str, count: int) -> List[str]:
+    """Register `count` students and return their private keys."""
+    keys = []
+    client = REFWebClient(web_url)
+    try:
+        for i in range(count):
+            mat_num = str(uuid.uuid4().int)[:8]
+            ok, private_key, _ = client.register_student(
+                mat_num=mat_num,
+                firstname="Load",
+                surname=f"Student{i}",
+                password=f"Load-{uuid.uuid4().hex}",
+            )
+            if not ok or private_key is None:
+                raise RuntimeError(f"Failed to register student {mat_num}")
+            keys.append(private_key)
+    finally:
+        client.close()
+    return keys
+
+
+def cpu_sources(
+    compose_project: Optional[str],
+) -> Dict[str, Callable[[], Optional[float]]]:
+    sources: Dict[str, Callable[[], Optional[float]]] = {
+        "dockerd": lambda: process_cpu_seconds("dockerd"),
+        "containerd": lambda: process_cpu_seconds("containerd"),
+    }
+    if compose_project is None:
+        return sources
+
+    import docker
+
+    containers = docker.from_env().containers.list(
+        filters={
+            "label": [
+                f"com.docker.compose.project={compose_project}",
+                "com.docker.compose.service=web",
+            ]
+        }
+    )
+    if containers:
+        sources["web"] = lambda: container_cpu_seconds(containers[0])
+    else:
+        print(f"[!] No web container of project {compose_project}", file=sys.stderr)
+    return sources
+
+
+def run_level(
+    target: Target,
+    keys: List[str],
+    workload: StudentWorkload,
+    ramp_s: float,
+) -> LevelResult:
+    concurrency = len(keys)
+    start_barrier = threading.Barrier(concurrency)
+
+    def student(index: int) -> List[Sample]:
+        start_barrier.wait()
+        if ramp_s:
+            # Spread the logins evenly over the ramp-up period.
+            time.sleep(ramp_s * index / concurrency)
+        session = StudentSession(
+            target.ssh_host, target.ssh_port, keys[index], workload
+        )
+        return session.run()
+
+    samples: List[Sample] = []
+    with CpuSampler(cpu_sources(target.compose_project)) as sampler:
+        start = time.monotonic()
+        with ThreadPoolExecutor(max_workers=concurrency) as pool:
+            for result in pool.map(student, range(concurrency)):
+                samples.extend(result)
+        duration = time.monotonic() - start
+
+    return LevelResult(
+        concurrency=concurrency,
+        duration_s=duration,
+        phases=[summarize(phase, samples) for phase in PHASES],
+        cpu=sampler.usage(),
+    )
+
+
+def print_level(level: LevelResult, baseline: Optional[Dict[str, Any]]) -> None:
+    base_phases: Dict[str, Dict[str, Any]] = {}
+    if baseline:
+        for base_level in baseline.get("levels", []):
+            if base_level["concurrency"] == level.concurrency:
+                base_phases = {p["phase"]: p for p in base_level["phases"]}
+
+    def delta(new: float, old: Optional[float]) -> str:
+        if not old:
+            return ""
+        return f" ({(new - old) / old * 100:+.1f}%)"
+
+    print(f"\n== {level.concurrency} students, {level.duration_s:.1f}s ==")
+    print(f"{'phase':<8} {'p50 [s]':>18} {'p90 [s]':>18} {'p99 [s]':>18} {'fail':>9}")
+    for stats in level.phases:
+        old = base_phases.get(stats.phase, {})
+        p50 = f"{stats.p50_s:.2f}{delta(stats.p50_s, old.get('p50_s'))}"
+        p90 = f"{stats.p90_s:.2f}{delta(stats.p90_s, old.get('p90_s'))}"
+        p99 = f"{stats.p99_s:.2f}{delta(stats.p99_s, old.get('p99_s'))}"
+        fail = f"{stats.failures}/{stats.runs}"
+        print(f"{stats.phase:<8} {p50:>18} {p90:>18} {p99:>18} {fail:>9}")
+        for error in stats.errors:
+            print(f"         ! {error}")
+
+    for name, usage in level.cpu.items():
+        if usage is not None:
+            print(
+                f"cpu {name:<10} mean {usage.mean_cores:.2f} cores,"
+                f" max {usage.max_cores:.2f} cores"
+            )
+
+
+def main() -> None:
+    parser = argparse.ArgumentParser(description=__doc__.split("\n\n")[0])
+    parser.add_argument(
+        "--levels",
+        default="1,5,10,25",
+        help="Comma separated numbers of concurrent students (default: %(default)s).",
+    )
+    parser.add_argument(
+        "--shell-spawns",
+        type=int,
+        default=200,
+        help="Number of `/bin/sh -c :` spawns per student (default: %(default)s).",
+    )
+    parser.add_argument(
+        "--ramp",
+        type=float,
+        default=0.0,
+        help="Spread the logins of a level over this many seconds (default: at once).",
+    )
+    parser.add_argument(
+        "--timeout",
+        type=float,
+        default=300.0,
+        help="Timeout of each phase in seconds (default: %(default)s).",
+    )
+    parser.add_argument("--no-build", action="store_true", help="Do not build images.")
+    parser.add_argument("--web-url", help="Web interface of a running deployment.")
+    parser.add_argument("--ssh-host", help="SSH host of a running deployment.")
+    parser.add_argument("--ssh-port", type=int, default=2222)
+    parser.add_argument(
+        "--exercise", help="Enabled exercise of the running deployment to use."
+    )
+    parser.add_argument(
+        "--solution",
+        type=Path,
+        help="File uploaded to /home/user/ before `task check`.",
+    )
+    parser.add_argument(
+        "--compose-project",
+        help="Compose project of the running deployment, to sample the web CPU.",
+    )
+    parser.add_argument(
+        "-o", "--output", type=Path, help="Write the JSON report to this path."
+    )
+    parser.add_argument(
+        "--compare", type=Path, help="JSON report of an earlier run to diff against."
+    )
+    args = parser.parse_args()
+
+    levels = [int(level) for level in args.levels.split(",")]
+    external = args.web_url is not None
+    if external and not (args.ssh_host and args.exercise):
+        parser.error("--web-url requires --ssh-host and --exercise")
+
+    baseline = None
+    if args.compare:
+        baseline = json.loads(args.compare.read_text())
+
+    with ExitStack() as stack:
+        files = {}
+        if external:
+            target = Target(
+                args.web_url,
+                args.ssh_host,
+                args.ssh_port,
+                args.exercise,
+                args.compose_project,
+            )
+        else:
+            instance = stack.enter_context(
+                REFInstance.running(
+                    prefix=f"ref_load_{uuid.uuid4().hex[:6]}",
+                    build=not args.no_build,
+                    startup_timeout=300.0,
+                )
+            )
+            target = Target(
+                instance.web_url,
+                instance.ssh_host,
+                instance.ssh_port,
+                setup_exercise(instance),
+                instance.project_name,
+            )
+            files["/home/user/solution.c"] = create_correct_solution()
+        if args.solution:
+            files[f"/home/user/{args.solution.name}"] = args.solution.read_text()
+
+        workload = StudentWorkload(
+            exercise_name=target.exercise_name,
+            shell_spawns=args.shell_spawns,
+            files=files,
+            connect_timeout=args.timeout,
+            task_timeout=args.timeout,
+        )
+
+        report = Report(
+            meta={
+                "timestamp": time.strftime("%Y-%m-%dT%H:%M:%S%z"),
+                "hostname": platform.node(),
+                "cpus": os.cpu_count(),
+                "target": "external" if external else "dedicated",
+                "web_url": target.web_url,
+                "exercise": target.exercise_name,
+                "levels": levels,
+                "shell_spawns": args.shell_spawns,
+                "ramp_s": args.ramp,
+            }
+        )
+
+        print(f"[+] Registering {sum(levels)} students")
+        keys = register_students(target.web_url, sum(levels))
+        for concurrency in levels:
+            print(f"[+] Running {concurrency} concurrent students")
+            level_keys, keys = keys[:concurrency], keys[concurrency:]
+            level = run_level(target, level_keys, workload, args.ramp)
+            report.levels.append(level)
+            print_level(level, baseline)
+
+    output = args.output or REPORTS_DIR / f"{time.strftime('%Y%m%d-%H%M%S')}.json"
+    output.parent.mkdir(parents=True, exist_ok=True)
+    output.write_text(json.dumps(asdict(report), indent=2) + "\n")
+    print(f"\n[+] Results written to {output}")
+
+
+if __name__ == "__main__":
+    main()
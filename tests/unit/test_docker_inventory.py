@@ -0,0 +1,140 @@
+"""Unit tests for ref/core/docker_inventory.py.
+
+Covers loading the inventory from API summaries and keeping it current via
+Docker events.
+"""
+
+from __future__ import annotations
+
+import pytest
+
+from ref.core.docker_inventory import Inventory
+
+
+def _container(id_: str, name: str, state: str = "running", networks=()) -> dict:
+    return {
+        "Id": id_,
+        "Names": [f"/{name}"],
+        "State": state,
+        "NetworkSettings": {
+            "Networks": {
+                n: {"NetworkID": n, "EndpointID": "ep" if state == "running" else ""}
+                for n in networks
+            }
+        },
+    }
+
+
+def _network(id_: str, internal: bool = False) -> dict:
+    return {"Id": id_, "Name": f"net-{id_}", "Internal": internal}
+
+
+def _event(type_: str, action: str, id_: str, **attributes) -> dict:
+    return {
+        "Type": type_,
+        "Action": action,
+        "Actor": {"ID": id_, "Attributes": attributes},
+    }
+
+
+def _no_inspect(network_id: str) -> dict:
+    raise AssertionError(f"Unexpected inspect of {network_id}")
+
+
+def _inventory() -> Inventory:
+    inventory = Inventory()
+    inventory.load(
+        [
+            _container("proxy", "ssh-proxy", networks=["n1", "n2"]),
+            _container("a", "ref-a", networks=["n1"]),
+            _container("b", "ref-b", networks=["n2", "n3"]),
+            _container("c", "ref-c", networks=["n3"]),
+            _container("d", "ref-d", state="exited", networks=["n4"]),
+        ],
+        [_network("n1"), _network("n2"), _network("n3", internal=True), _network("n4")],
+    )
+    return inventory
+
+
+@pytest.mark.offline
+class TestLoad:
+    def test_containers_and_links(self):
+        inventory = _inventory()
+        assert inventory.ready
+        assert {c.id for c in inventory.containers("ref-")} == {"a", "b", "c", "d"}
+        assert inventory.container("ref-a").status == "running"
+        assert inventory.container("d").status == "exited"
+        assert inventory.connected_containers("n1") == {"proxy", "a"}
+        assert inventory.connected_networks("b") == {"n2", "n3"}
+        [n3] = inventory.networks("net-n3")
+        assert n3.internal and n3.containers == {"b", "c"}
+
+    def test_stopped_containers_are_not_connected(self):
+        inventory = _inventory()
+        assert inventory.connected_networks("d") == set()
+        assert inventory.connected_containers("n4") == set()
+
+    def test_transitive_closure(self):
+        inventory = _inventory()
+        assert inventory.transitive_closure("proxy") == {"proxy", "a", "b", "c"}
+        assert inventory.transitive_closure("d") == {"d"}
+
+    def test_clear(self):
+        inventory = _inventory()
+        inventory.clear()
+        assert not inventory.ready
+
+
+@pytest.mark.offline
+class TestApply:
+    def test_container_lifecycle(self):
+        inventory = _inventory()
+        inventory.apply(_event("container", "create", "e", name="ref-e"), _no_inspect)
+        assert inventory.container("ref-e").status == "created"
+        inventory.apply(_event("container", "start", "e", name="ref-e"), _no_inspect)
+        inventory.apply(_event("network", "connect", "n1", container="e"), _no_inspect)
+        assert inventory.container("e").status == "running"
+        assert "e" in inventory.transitive_closure("proxy")
+
+        inventory.apply(_event("container", "rename", "e", name="ref-f"), _no_inspect)
+        assert inventory.container("ref-e") is None
+        assert inventory.container("ref-f").status == "running"
+
+        inventory.apply(_event("container", "die", "e", name="ref-f"), _no_inspect)
+        inventory.apply(
+            _event("network", "disconnect", "n1", container="e"), _no_inspect
+        )
+        assert inventory.container("e").status == "exited"
+        assert "e" not in inventory.transitive_closure("proxy")
+
+        inventory.apply(_event("container", "destroy", "e", name="ref-f"), _no_inspect)
+        assert inventory.container("e") is None
+
+    def test_irrelevant_events_are_ignored(self):
+        inventory = _inventory()
+        inventory.apply(
+            _event("container", "exec_start", "a", name="ref-a"), _no_inspect
+        )
+        inventory.apply(_event("container", "top", "unknown"), _no_inspect)
+        assert inventory.container("a").status == "running"
+        assert inventory.container("unknown") is None
+
+    def test_network_lifecycle(self):
+        inventory = _inventory()
+        inspected = []
+
+        def inspect(network_id):
+            inspected.append(network_id)
+            return {"Name": "net-n5", "Internal": True}
+
+        inventory.apply(_event("network", "create", "n5", name="net-n5"), inspect)
+        assert inspected == ["n5"]
+        [n5] = inventory.networks("net-n5")
+        assert n5.internal and n5.containers == frozenset()
+
+        inventory.apply(_event("network", "connect", "n5", container="d"), _no_inspect)
+        assert inventory.connected_networks("d") == {"n5"}
+
+        inventory.apply(_event("network", "destroy", "n5"), _no_inspect)
+        assert inventory.networks("net-n5") == []
+        assert inventory.connected_networks("d") == set()
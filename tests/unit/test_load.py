@@ -0,0 +1,77 @@
+"""
+Unit Tests for the load test helpers
+
+Covers the statistics of helpers/load.py; running student sessions needs a
+REF instance and is done by load_test.py itself.
+"""
+
+import pytest
+
+from helpers.load import CpuSampler, Sample, cpu_usage, percentile, summarize
+
+
+@pytest.mark.offline
+class TestPercentile:
+    def test_nearest_rank(self):
+        values = [float(v) for v in range(1, 101)]
+        assert percentile(values, 50) == 50.0
+        assert percentile(values, 90) == 90.0
+        assert percentile(values, 99) == 99.0
+        assert percentile(values, 100) == 100.0
+
+    def test_small_and_empty(self):
+        assert percentile([3.0], 99) == 3.0
+        assert percentile([1.0, 2.0], 1) == 1.0
+        assert percentile([], 50) == 0.0
+
+
+@pytest.mark.offline
+class TestSummarize:
+    def test_failures_are_counted_but_not_timed(self):
+        samples = [
+            Sample("login", 1.0, True),
+            Sample("login", 3.0, True),
+            Sample("login", 60.0, False, "TimeoutError: timed out"),
+            Sample("check", 5.0, True),
+        ]
+        stats = summarize("login", samples)
+        assert (stats.runs, stats.failures) == (3, 1)
+        assert stats.mean_s == 2.0
+        assert stats.max_s == 3.0
+        assert stats.errors == ["TimeoutError: timed out"]
+
+    def test_errors_are_deduplicated_and_limited(self):
+        samples = [Sample("submit", 1.0, False, f"error {i % 3}") for i in range(9)]
+        stats = summarize("submit", samples, max_errors=2)
+        assert stats.failures == 9
+        assert stats.errors == ["error 0", "error 1"]
+        assert stats.p50_s == 0.0
+
+    def test_phase_without_runs(self):
+        stats = summarize("reset", [Sample("login", 1.0, False, "refused")])
+        assert (stats.runs, stats.failures, stats.max_s) == (0, 0, 0.0)
+
+
+@pytest.mark.offline
+class TestCpuUsage:
+    def test_mean_and_peak(self):
+        # One core for two seconds, then idle for two seconds.
+        samples = [(0.0, 10.0), (1.0, 11.0), (2.0, 12.0), (4.0, 12.0)]
+        usage = cpu_usage(samples)
+        assert usage is not None
+        assert usage.mean_cores == 0.5
+        assert usage.max_cores == 1.0
+
+    def test_not_enough_samples(self):
+        assert cpu_usage([]) is None
+        assert cpu_usage([(1.0, 5.0)]) is None
+        assert cpu_usage([(1.0, 5.0), (1.0, 6.0)]) is None
+
+    def test_sampler_skips_unavailable_sources(self):
+        cpu = iter(float(v) for v in range(100))
+        with CpuSampler(
+            {"counter": lambda: next(cpu), "missing": lambda: None}, interval=60.0
+        ) as sampler:
+            pass
+        assert len(sampler.samples["counter"]) == 2
+        assert sampler.usage()["missing"] is None
@@ -0,0 +1,108 @@
+"""Unit tests for ref/core/regrade.py.
+
+Covers the parts of the regrade scheduler that do not need Docker: sizing of
+the worker pool, the processing order, and computing the per-task changes.
+"""
+
+from __future__ import annotations
+
+import pytest
+
+from ref.core.regrade import (
+    SubmissionRegrade,
+    TaskChange,
+    TaskOutcome,
+    parse_size,
+    queue_order,
+    task_changes,
+    worker_count,
+)
+
+GiB = 1024**3
+
+
+@pytest.mark.offline
+class TestParseSize:
+    @pytest.mark.parametrize(
+        "value, expected",
+        [
+            ("256m", 256 * 1024**2),
+            ("1G", GiB),
+            ("512k", 512 * 1024),
+            ("100", 100),
+            ("100b", 100),
+            (4096, 4096),
+        ],
+    )
+    def test_valid(self, value, expected):
+        assert parse_size(value) == expected
+
+    @pytest.mark.parametrize("value", [None, "", "1t", "m", "-1m", True, 1.5])
+    def test_invalid(self, value):
+        assert parse_size(value) is None
+
+
+@pytest.mark.offline
+class TestWorkerCount:
+    def test_bounded_by_cpu(self):
+        # 16 CPUs, half of them for 0.5 CPU containers.
+        assert worker_count(16, 64 * GiB, 0.5, 256 * 1024**2, 0.5, 100, 500) == 16
+
+    def test_bounded_by_memory(self):
+        assert worker_count(64, 4 * GiB, 0.5, GiB, 0.5, 100, 500) == 2
+
+    def test_bounded_by_max_workers(self):
+        assert worker_count(64, 64 * GiB, 0.5, 256 * 1024**2, 1.0, 8, 500) == 8
+
+    def test_bounded_by_submissions(self):
+        assert worker_count(64, 64 * GiB, 0.5, 256 * 1024**2, 1.0, 100, 3) == 3
+
+    def test_unlimited_containers(self):
+        # Without quota, each container is assumed to use one CPU.
+        assert worker_count(8, 64 * GiB, None, None, 0.5, 100, 500) == 4
+
+    def test_at_least_one(self):
+        assert worker_count(1, GiB, 2, 4 * GiB, 0.5, 100, 500) == 1
+
+
+@pytest.mark.offline
+class TestTaskChanges:
+    def test_unchanged(self):
+        old = {"a": TaskOutcome(True, 1.0)}
+        assert task_changes(old, dict(old)) == []
+
+    def test_changed_success_and_score(self):
+        old = {"a": TaskOutcome(False, None), "b": TaskOutcome(True, 1.0)}
+        new = {"a": TaskOutcome(True, None), "b": TaskOutcome(True, 2.0)}
+        assert task_changes(old, new) == [
+            TaskChange("a", old["a"], new["a"]),
+            TaskChange("b", old["b"], new["b"]),
+        ]
+
+    def test_added_and_removed_tasks(self):
+        old = {"gone": TaskOutcome(True, None)}
+        new = {"added": TaskOutcome(False, None)}
+        assert task_changes(old, new) == [
+            TaskChange("added", None, new["added"]),
+            TaskChange("gone", old["gone"], None),
+        ]
+
+    def test_only_done_regrades_report_changes(self):
+        regrade = SubmissionRegrade(1, "user", None, {"a": TaskOutcome(True, None)})
+        assert regrade.changes == []
+        regrade.new = {"a": TaskOutcome(False, None)}
+        regrade.state = "failed"
+        assert regrade.changes == []
+        regrade.state = "done"
+        assert [c.task_name for c in regrade.changes] == ["a"]
+
+
+@pytest.mark.offline
+def test_queue_order_longest_first():
+    regrades = [
+        SubmissionRegrade(1, "a", 100.0, {}),
+        SubmissionRegrade(2, "b", None, {}),
+        SubmissionRegrade(3, "c", 5000.0, {}),
+        SubmissionRegrade(4, "d", 100.0, {}),
+    ]
+    assert [r.submission_id for r in queue_order(regrades)] == [2, 3, 1, 4]
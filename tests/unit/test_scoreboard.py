@@ -0,0 +1,141 @@
+"""Unit tests for ref/core/scoreboard.py.
+
+Covers merging of new rows, ETag changes, and invalidation of the
+materialized scoreboard.
+"""
+
+from __future__ import annotations
+
+import pytest
+
+from ref.core.scoreboard import ScoreboardCache, merge_rows
+
+
+def _entry(ts: str, score: float = 1.0) -> dict:
+    return {"ts": ts, "score": score, "tasks": {"a": score}}
+
+
+class _Source:
+    """Fake submission source that records how it was queried."""
+
+    def __init__(self):
+        self.rows = {}
+        self.builds = 0
+        self.loads = []
+
+    def build(self):
+        self.builds += 1
+        return merge_rows({}, self.rows.values())
+
+    def load(self, ids):
+        self.loads.append(list(ids))
+        return [self.rows[i] for i in ids if i in self.rows]
+
+
+@pytest.mark.offline
+class TestMergeRows:
+    def test_entries_are_grouped_and_sorted(self):
+        scores = merge_rows(
+            {},
+            [
+                ("chal", "team", _entry("2")),
+                ("chal", "team", _entry("1")),
+                ("other", "team", _entry("3")),
+            ],
+        )
+        assert [e["ts"] for e in scores["chal"]["team"]] == ["1", "2"]
+        assert list(scores["other"]) == ["team"]
+
+
+@pytest.mark.offline
+class TestScoreboardCache:
+    def test_unchanged_board_is_reused(self):
+        cache, source = ScoreboardCache(), _Source()
+        first = cache.get(False, source.build, source.load)
+        second = cache.get(False, source.build, source.load)
+        assert first is second
+        assert source.builds == 1
+        assert source.loads == []
+
+    def test_new_submissions_are_merged(self):
+        cache, source = ScoreboardCache(), _Source()
+        source.rows[1] = ("chal", "team", _entry("1"))
+        before = cache.get(False, source.build, source.load)
+
+        source.rows[2] = ("chal", "team", _entry("2"))
+        cache.add_submissions([2])
+        after = cache.get(False, source.build, source.load)
+
+        assert source.builds == 1
+        assert source.loads == [[2]]
+        assert after.etag != before.etag
+        assert len(after.scores["chal"]["team"]) == 2
+        # Boards that were handed out are not modified.
+        assert len(before.scores["chal"]["team"]) == 1
+
+    def test_pending_submissions_are_tracked_per_key(self):
+        cache, source = ScoreboardCache(), _Source()
+        cache.get(False, source.build, source.load)
+        cache.get(True, source.build, source.load)
+
+        source.rows[1] = ("chal", "team", _entry("1"))
+        cache.add_submissions([1])
+        public = cache.get(False, source.build, source.load)
+        admin = cache.get(True, source.build, source.load)
+
+        assert source.loads == [[1], [1]]
+        assert public.scores == admin.scores
+
+    def test_invalidate_rebuilds(self):
+        cache, source = ScoreboardCache(), _Source()
+        before = cache.get(False, source.build, source.load)
+        cache.invalidate()
+        after = cache.get(False, source.build, source.load)
+        assert source.builds == 2
+        assert after.etag != before.etag
+
+    def test_failed_load_invalidates(self):
+        cache, source = ScoreboardCache(), _Source()
+        cache.get(False, source.build, source.load)
+        cache.add_submissions([1])
+
+        def failing_load(ids):
+            raise RuntimeError("DB error")
+
+        with pytest.raises(RuntimeError):
+            cache.get(False, source.build, failing_load)
+        cache.get(False, source.build, source.load)
+        assert source.builds == 2
+
+    def test_submissions_added_while_merging_are_kept(self):
+        cache, source = ScoreboardCache(), _Source()
+        cache.get(False, source.build, source.load)
+        source.rows[1] = ("chal", "team", _entry("1"))
+        source.rows[2] = ("chal", "team", _entry("2"))
+        cache.add_submissions([1])
+
+        def racing_load(ids):
+            # Another request commits a submission while the board is merged.
+            cache.add_submissions([2])
+            return source.load(ids)
+
+        merged = cache.get(False, source.build, racing_load)
+        assert len(merged.scores["chal"]["team"]) == 1
+        after = cache.get(False, source.build, source.load)
+
+        assert source.builds == 1
+        assert source.loads == [[1], [1, 2]]
+        assert len(after.scores["chal"]["team"]) == 2
+
+    def test_body_is_serialized_once(self):
+        cache, source = ScoreboardCache(), _Source()
+        board = cache.get(False, source.build, source.load)
+        calls = []
+
+        def dumps(scores):
+            calls.append(scores)
+            return "{}"
+
+        assert board.body(dumps) == "{}"
+        assert board.body(dumps) == "{}"
+        assert len(calls) == 1
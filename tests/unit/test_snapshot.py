@@ -0,0 +1,167 @@
+"""Unit tests for ref/core/snapshot.py.
+
+Covers snapshot fidelity (content, metadata, symlinks), deduplication
+across snapshots, the stat cache, and releasing objects.
+"""
+
+from __future__ import annotations
+
+import json
+import os
+from pathlib import Path
+
+import pytest
+
+from ref.core.snapshot import SnapshotStore, copy_tree
+
+
+def _make_tree(root: Path) -> None:
+    (root / "dir" / "sub").mkdir(parents=True)
+    (root / "a.txt").write_text("hello")
+    (root / "dir" / "b.bin").write_bytes(os.urandom(4096))
+    (root / "dir" / "sub" / "same.txt").write_text("hello")
+    (root / "dir" / "exec.sh").write_text("#!/bin/sh\n")
+    (root / "dir" / "exec.sh").chmod(0o755)
+    (root / "link").symlink_to("dir/b.bin")
+    os.utime(root / "a.txt", ns=(1_000_000_000, 1_000_000_000))
+
+
+def _describe(root: Path) -> dict:
+    ret = {}
+    for path in sorted(root.rglob("*")):
+        st = path.lstat()
+        rel = str(path.relative_to(root))
+        if path.is_symlink():
+            ret[rel] = ("link", os.readlink(path))
+        elif path.is_dir():
+            ret[rel] = ("dir", st.st_mode, st.st_uid)
+        else:
+            ret[rel] = ("file", st.st_mode, st.st_mtime_ns, path.read_bytes())
+    return ret
+
+
+@pytest.fixture
+def store(tmp_path: Path) -> SnapshotStore:
+    return SnapshotStore(tmp_path / "store")
+
+
+@pytest.mark.offline
+class TestSnapshot:
+    def test_snapshot_matches_source(self, tmp_path: Path, store: SnapshotStore):
+        src = tmp_path / "src"
+        _make_tree(src)
+        dst = tmp_path / "dst"
+        store.snapshot(src, dst, tmp_path / "manifest")
+        assert _describe(dst) == _describe(src)
+
+    def test_snapshot_files_are_hardlinks(self, tmp_path: Path, store: SnapshotStore):
+        src = tmp_path / "src"
+        _make_tree(src)
+        store.snapshot(src, tmp_path / "dst1", tmp_path / "m1")
+        store.snapshot(src, tmp_path / "dst2", tmp_path / "m2")
+        a1 = (tmp_path / "dst1" / "dir" / "b.bin").stat()
+        a2 = (tmp_path / "dst2" / "dir" / "b.bin").stat()
+        assert a1.st_ino == a2.st_ino
+        # Store + two snapshots
+        assert a1.st_nlink == 3
+
+    def test_metadata_is_part_of_key(self, tmp_path: Path, store: SnapshotStore):
+        """Same content with different mtimes must not share an inode."""
+        src = tmp_path / "src"
+        _make_tree(src)
+        stats = store.snapshot(src, tmp_path / "dst", tmp_path / "manifest")
+        a = (tmp_path / "dst" / "a.txt").stat()
+        same = (tmp_path / "dst" / "dir" / "sub" / "same.txt").stat()
+        assert a.st_ino != same.st_ino
+        assert stats.new_objects == stats.files
+
+    def test_stat_cache_skips_unchanged_files(
+        self, tmp_path: Path, store: SnapshotStore
+    ):
+        src = tmp_path / "src"
+        _make_tree(src)
+        cache = tmp_path / "cache"
+        store.snapshot(src, tmp_path / "dst1", tmp_path / "m1", stat_cache=cache)
+
+        (src / "a.txt").write_text("changed")
+        stats = store.snapshot(
+            src, tmp_path / "dst2", tmp_path / "m2", stat_cache=cache
+        )
+        assert stats.cached == stats.files - 1
+        assert stats.new_objects == 1
+        assert (tmp_path / "dst2" / "a.txt").read_text() == "changed"
+        assert (tmp_path / "dst1" / "a.txt").read_text() == "hello"
+
+    def test_release_drops_unused_objects(self, tmp_path: Path, store: SnapshotStore):
+        src = tmp_path / "src"
+        _make_tree(src)
+        store.snapshot(src, tmp_path / "dst1", tmp_path / "m1")
+        (src / "a.txt").write_text("changed")
+        store.snapshot(src, tmp_path / "dst2", tmp_path / "m2")
+
+        keys1 = set(json.loads((tmp_path / "m1").read_text()))
+        keys2 = set(json.loads((tmp_path / "m2").read_text()))
+        assert len(keys1 - keys2) == 1
+
+        for path in sorted((tmp_path / "dst1").rglob("*"), reverse=True):
+            if path.is_dir() and not path.is_symlink():
+                path.rmdir()
+            else:
+                path.unlink()
+        store.release(store.read_manifest(tmp_path / "m1"))
+
+        objects = {p.name for p in (store.root / "objects").rglob("*") if p.is_file()}
+        assert objects == keys2
+        assert _describe(tmp_path / "dst2")["a.txt"][3] == b"changed"
+
+    def test_collect_garbage(self, tmp_path: Path, store: SnapshotStore):
+        src = tmp_path / "src"
+        _make_tree(src)
+        dst = tmp_path / "dst"
+        store.snapshot(src, dst, tmp_path / "manifest")
+        assert store.collect_garbage() == 0
+        (dst / "a.txt").unlink()
+        # Might belong to an object that is being created.
+        tmp = store.root / "tmp" / "pending"
+        tmp.touch()
+        assert store.collect_garbage() == 1
+        assert tmp.exists()
+
+    def test_recreates_released_object_from_stale_cache(
+        self, tmp_path: Path, store: SnapshotStore
+    ):
+        src = tmp_path / "src"
+        _make_tree(src)
+        cache = tmp_path / "cache"
+        dst1 = tmp_path / "dst1"
+        store.snapshot(src, dst1, tmp_path / "m1", stat_cache=cache)
+        (dst1 / "a.txt").unlink()
+        store.release(store.read_manifest(tmp_path / "m1"))
+
+        dst2 = tmp_path / "dst2"
+        store.snapshot(src, dst2, tmp_path / "m2", stat_cache=cache)
+        assert (dst2 / "a.txt").read_text() == "hello"
+
+
+@pytest.mark.offline
+class TestCopyTree:
+    def test_copy_is_independent(self, tmp_path: Path):
+        src = tmp_path / "src"
+        _make_tree(src)
+        dst = tmp_path / "dst"
+        copy_tree(src, dst)
+        assert _describe(dst) == _describe(src)
+
+        (dst / "a.txt").write_text("modified")
+        assert (src / "a.txt").read_text() == "hello"
+
+    def test_copy_replaces_existing_entries(self, tmp_path: Path):
+        src = tmp_path / "src"
+        _make_tree(src)
+        dst = tmp_path / "dst"
+        dst.mkdir()
+        (dst / "a.txt").mkdir()
+        (dst / "keep").write_text("keep")
+        copy_tree(src, dst)
+        assert (dst / "a.txt").read_text() == "hello"
+        assert (dst / "keep").read_text() == "keep"
@@ -0,0 +1,87 @@
+"""Unit tests for ref/core/subnets.py.
+
+Covers allocation order, freeing, persistence of the bitmap, and
+reconciling it with the networks known to Docker.
+"""
+
+from __future__ import annotations
+
+import ipaddress
+from pathlib import Path
+
+import pytest
+
+from ref.core.subnets import SubnetAllocator
+
+POOL = ipaddress.IPv4Network("10.200.0.0/26")
+PREFIX = 29
+
+
+@pytest.fixture
+def allocator(tmp_path: Path) -> SubnetAllocator:
+    return SubnetAllocator(tmp_path / "subnets.bitmap", POOL, PREFIX)
+
+
+def _allocate_all(allocator: SubnetAllocator) -> list:
+    ret = []
+    with allocator.locked() as subnets:
+        while (subnet := subnets.allocate()) is not None:
+            ret.append(subnet)
+    return ret
+
+
+@pytest.mark.offline
+class TestSubnetAllocator:
+    def test_allocates_every_subnet_once(self, allocator: SubnetAllocator):
+        allocated = _allocate_all(allocator)
+        assert allocated == list(POOL.subnets(new_prefix=PREFIX))
+
+    def test_state_is_persisted(self, tmp_path: Path, allocator: SubnetAllocator):
+        with allocator.locked() as subnets:
+            first = subnets.allocate()
+
+        other = SubnetAllocator(tmp_path / "subnets.bitmap", POOL, PREFIX)
+        with other.locked() as subnets:
+            second = subnets.allocate()
+        assert first != second
+
+    def test_freed_subnet_is_reused_after_wrap_around(
+        self, allocator: SubnetAllocator
+    ):
+        allocated = _allocate_all(allocator)
+        with allocator.locked() as subnets:
+            subnets.free(allocated[2])
+        with allocator.locked() as subnets:
+            assert subnets.allocate() == allocated[2]
+            assert subnets.allocate() is None
+
+    def test_freed_subnet_is_not_reused_immediately(
+        self, allocator: SubnetAllocator
+    ):
+        with allocator.locked() as subnets:
+            a = subnets.allocate()
+            subnets.free(a)
+            b = subnets.allocate()
+        assert a != b
+
+    def test_reconcile(self, allocator: SubnetAllocator):
+        _allocate_all(allocator)
+        used = [
+            # Overlaps with the first two subnets of the pool
+            ipaddress.IPv4Network("10.200.0.0/28"),
+            # Outside of the pool
+            ipaddress.IPv4Network("172.17.0.0/16"),
+        ]
+        with allocator.locked() as subnets:
+            subnets.reconcile(used)
+
+        allocated = _allocate_all(allocator)
+        assert allocated == list(POOL.subnets(new_prefix=PREFIX))[2:]
+
+    def test_ignores_foreign_subnets_on_free(self, allocator: SubnetAllocator):
+        allocated = _allocate_all(allocator)
+        with allocator.locked() as subnets:
+            subnets.free(ipaddress.IPv4Network("172.17.0.0/29"))
+            subnets.free(ipaddress.IPv4Network("10.200.0.0/28"))
+            assert subnets.allocate() is None
+        assert len(allocated) == 8
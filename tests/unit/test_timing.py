@@ -0,0 +1,123 @@
+"""Unit tests for ref/core/timing.py.
+
+Covers validation of the timings and resource usage reported by
+containers and the aggregation of timings for the operator view.
+"""
+
+from __future__ import annotations
+
+import json
+
+import pytest
+
+from ref.core.timing import aggregate, parse_client_timings, parse_resource_usage
+
+_MS = 10**6
+
+
+def _header(**data) -> str:
+    return json.dumps(data)
+
+
+@pytest.mark.offline
+class TestParseClientTimings:
+    def test_missing_or_invalid_header(self):
+        empty = {"phases": {}, "tasks": {}}
+        assert parse_client_timings(None, 0) == empty
+        assert parse_client_timings("not json", 0) == empty
+        assert parse_client_timings("[1, 2]", 0) == empty
+
+    def test_phases_and_tasks_are_converted_to_ms(self):
+        raw = _header(
+            phases={"tests": 1500 * _MS, "sign": 2 * _MS},
+            tasks={"a": 1000 * _MS},
+        )
+        timings = parse_client_timings(raw, 0)
+        assert timings["phases"] == {"tests": 1500.0, "sign": 2.0}
+        assert timings["tasks"] == {"a": 1000.0}
+
+    def test_bogus_values_are_dropped(self):
+        raw = _header(
+            phases={
+                "tests": -1,
+                "sign": "1",
+                "load_tests": True,
+                "launch": 10**20,
+                "handling": _MS,
+                "unknown": _MS,
+            },
+            tasks={"a": 1.5, "x" * 1000: _MS},
+        )
+        assert parse_client_timings(raw, 0) == {"phases": {}, "tasks": {}}
+
+    def test_upload_is_computed_from_send_time(self):
+        raw = _header(sent_ns=100 * _MS)
+        timings = parse_client_timings(raw, 103 * _MS)
+        assert timings["phases"] == {"upload": 3.0}
+
+    def test_send_time_in_the_future_is_ignored(self):
+        raw = _header(sent_ns=100 * _MS)
+        assert parse_client_timings(raw, 99 * _MS)["phases"] == {}
+
+
+@pytest.mark.offline
+class TestParseResourceUsage:
+    def test_valid_usage_is_kept(self):
+        usage = {
+            "cpu_ms": 1500.5,
+            "wall_ms": 2000,
+            "max_rss_kb": 20480,
+            "read_bytes": 4096,
+            "write_bytes": 0,
+            "exceeded_limit": "the time limit of 2s",
+        }
+        assert parse_resource_usage({"a": usage}) == {
+            "a": {**usage, "wall_ms": 2000.0}
+        }
+
+    def test_invalid_values_are_dropped(self):
+        usage = {
+            "cpu_ms": -1,
+            "wall_ms": float("nan"),
+            "max_rss_kb": 1.5,
+            "read_bytes": True,
+            "write_bytes": "1",
+            "exceeded_limit": 1,
+            "unknown": 1,
+        }
+        assert parse_resource_usage({"a": usage, "b": 1, 1: {}}) == {"a": {}}
+
+    def test_invalid_payload(self):
+        assert parse_resource_usage(None) == {}
+        assert parse_resource_usage([{"cpu_ms": 1}]) == {}
+        assert parse_resource_usage({"x" * 129: {"cpu_ms": 1}}) == {}
+
+
+@pytest.mark.offline
+class TestAggregate:
+    def test_percentiles_and_buckets(self):
+        timings = [{"phases": {"tests": float(v)}} for v in range(1, 101)]
+        phases, tasks = aggregate(timings)
+        assert tasks == []
+        [tests] = phases
+        assert tests.name == "tests"
+        assert tests.count == 100
+        assert tests.percentile(50) == 50.0
+        assert tests.percentile(99) == 99.0
+        assert tests.percentile(100) == 100.0
+
+        buckets = tests.buckets()
+        assert buckets[0] == ("1 - 2 ms", 1)
+        assert buckets[-1] == ("64 - 128 ms", 37)
+        assert sum(cnt for _, cnt in buckets) == 100
+
+    def test_phases_keep_their_order_and_tasks_are_sorted(self):
+        timings = [
+            {"phases": {"upload": 1.0, "tests": 2.0}, "tasks": {"a": 1.0, "b": 5.0}},
+            None,
+            {"phases": {"unknown": 1.0}, "tasks": {"a": 1.0}},
+        ]
+        phases, tasks = aggregate(timings)
+        assert [p.name for p in phases] == ["tests", "upload"]
+        assert [t.name for t in tasks] == ["b", "a"]
+        assert tasks[1].count == 2
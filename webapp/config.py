@@ -33,6 +33,11 @@ class ReleaseConfig(Config):
     EXERCISES_PATH = "/exercises"
     IMPORTED_EXERCISES_PATH = os.path.join(DATADIR, "imported_exercises")
     PERSISTANCE_PATH = os.path.join(DATADIR, "persistance")
+    # Object store of submission snapshots. Must be on the same filesystem as
+    # PERSISTANCE_PATH, since snapshots hardlink its objects.
+    SNAPSHOT_STORE_PATH = os.path.join(PERSISTANCE_PATH, ".snapshots")
+    # Allocation state of the instance network subnets (see ref.core.subnets).
+    SUBNET_ALLOCATOR_PATH = os.path.join(DATADIR, "subnets.bitmap")
     SQLALCHEMY_MIGRATE_REPO = "migrations"
 
     LOGIN_DISABLED = False
@@ -133,6 +138,22 @@ class ReleaseConfig(Config):
     # Log a warning if acquiring the database lock takes longer than this.
     DB_LOCK_SLOW_THRESHOLD_SECONDS = 5
 
+    # Number of threads that turn queued submission requests into submissions
+    # (see ref.core.submission_queue). Since creating a submission holds the
+    # database lock, more workers only help if the snapshot is the bottleneck.
+    SUBMISSION_QUEUE_WORKERS = 1
+
+    # Share of the Docker host's CPUs and memory that may be used by the
+    # containers of a regrade job (see ref.core.regrade), the rest is left to
+    # running instances.
+    REGRADE_HOST_SHARE = 0.5
+
+    # Upper bound for the number of submissions that are regraded in parallel.
+    REGRADE_MAX_WORKERS = 32
+
+    # Time after which the tests of a submission are killed while regrading.
+    REGRADE_TIMEOUT_S = 1800
+
 
 class DebugConfig(ReleaseConfig):
     debug = True
@@ -73,6 +73,8 @@ class TestConfig(Config):
     EXERCISES_PATH = "/tmp/ref-test/exercises"
     IMPORTED_EXERCISES_PATH = "/tmp/ref-test/data/imported_exercises"
     PERSISTANCE_PATH = "/tmp/ref-test/data/persistance"
+    SNAPSHOT_STORE_PATH = "/tmp/ref-test/data/persistance/.snapshots"
+    SUBNET_ALLOCATOR_PATH = "/tmp/ref-test/data/subnets.bitmap"
     SQLALCHEMY_MIGRATE_REPO = "migrations"
 
     LOGIN_DISABLED = True  # Disable login checks in tests
@@ -0,0 +1,48 @@
+"""Add submission_ticket for queued submission requests
+
+Submission requests are recorded as tickets and turned into submissions by
+the submission queue (see ref.core.submission_queue).
+
+Revision ID: a8c0e2f4b6d8
+Revises: f7a9b1c3d5e7
+Create Date: 2026-10-14
+
+"""
+
+import sqlalchemy as sa
+from alembic import op
+
+
+revision = "a8c0e2f4b6d8"
+down_revision = "f7a9b1c3d5e7"
+branch_labels = None
+depends_on = None
+
+
+def upgrade():
+    op.create_table(
+        "submission_ticket",
+        sa.Column("id", sa.Integer(), nullable=False),
+        sa.Column("instance_id", sa.Integer(), nullable=False),
+        sa.Column("accepted_ts", sa.DateTime(), nullable=False),
+        sa.Column(
+            "state",
+            sa.Enum("PENDING", "DONE", "FAILED", name="submissionticketstate"),
+            nullable=False,
+        ),
+        sa.Column("payload", sa.JSON(), nullable=False),
+        sa.Column("timings", sa.JSON(), nullable=True),
+        sa.Column("submission_id", sa.Integer(), nullable=True),
+        sa.ForeignKeyConstraint(
+            ["instance_id"], ["exercise_instance.id"], ondelete="CASCADE"
+        ),
+        sa.ForeignKeyConstraint(
+            ["submission_id"], ["submission.id"], ondelete="SET NULL"
+        ),
+        sa.PrimaryKeyConstraint("id"),
+    )
+
+
+def downgrade():
+    op.drop_table("submission_ticket")
+    sa.Enum(name="submissionticketstate").drop(op.get_bind())
@@ -0,0 +1,30 @@
+"""Add submission_test_result.resource_usage
+
+Resources used by the tests of each task as accounted by the container.
+Results created before have none.
+
+Revision ID: b9d1f3a5c7e9
+Revises: a8c0e2f4b6d8
+Create Date: 2026-10-14
+
+"""
+
+import sqlalchemy as sa
+from alembic import op
+
+
+revision = "b9d1f3a5c7e9"
+down_revision = "a8c0e2f4b6d8"
+branch_labels = None
+depends_on = None
+
+
+def upgrade():
+    op.add_column(
+        "submission_test_result",
+        sa.Column("resource_usage", sa.JSON(), nullable=True),
+    )
+
+
+def downgrade():
+    op.drop_column("submission_test_result", "resource_usage")
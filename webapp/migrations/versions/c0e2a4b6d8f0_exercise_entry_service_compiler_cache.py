@@ -0,0 +1,32 @@
+"""Add exercise_entry_service.compiler_cache
+
+Whether the exercise's compilations are cached via ccache. Exercises
+imported before do not use it.
+
+Revision ID: c0e2a4b6d8f0
+Revises: b9d1f3a5c7e9
+Create Date: 2026-10-14
+
+"""
+
+import sqlalchemy as sa
+from alembic import op
+
+
+revision = "c0e2a4b6d8f0"
+down_revision = "b9d1f3a5c7e9"
+branch_labels = None
+depends_on = None
+
+
+def upgrade():
+    op.add_column(
+        "exercise_entry_service",
+        sa.Column(
+            "compiler_cache", sa.Boolean(), nullable=False, server_default=sa.false()
+        ),
+    )
+
+
+def downgrade():
+    op.drop_column("exercise_entry_service", "compiler_cache")
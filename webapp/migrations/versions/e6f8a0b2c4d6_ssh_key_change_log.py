@@ -0,0 +1,33 @@
+"""Add ssh_key_change log for incremental key sync of the SSH proxy
+
+Every insert, delete, or pub_key update of a user appends the affected
+keys to ssh_key_change. The SSH reverse proxy polls /api/getkeys with the
+ID of the last change it has seen and only receives the affected keys.
+
+Revision ID: e6f8a0b2c4d6
+Revises: d5e7f9a0b1c2
+Create Date: 2026-10-14
+
+"""
+
+import sqlalchemy as sa
+from alembic import op
+
+
+revision = "e6f8a0b2c4d6"
+down_revision = "d5e7f9a0b1c2"
+branch_labels = None
+depends_on = None
+
+
+def upgrade():
+    op.create_table(
+        "ssh_key_change",
+        sa.Column("id", sa.Integer(), nullable=False),
+        sa.Column("pub_key", sa.Text(), nullable=False),
+        sa.PrimaryKeyConstraint("id"),
+    )
+
+
+def downgrade():
+    op.drop_table("ssh_key_change")
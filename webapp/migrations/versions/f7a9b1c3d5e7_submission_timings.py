@@ -0,0 +1,27 @@
+"""Add submission.timings
+
+Durations of the phases of `task submit` as reported by the container and
+measured by the webapp. Submissions created before have none.
+
+Revision ID: f7a9b1c3d5e7
+Revises: e6f8a0b2c4d6
+Create Date: 2026-10-14
+
+"""
+
+import sqlalchemy as sa
+from alembic import op
+
+
+revision = "f7a9b1c3d5e7"
+down_revision = "e6f8a0b2c4d6"
+branch_labels = None
+depends_on = None
+
+
+def upgrade():
+    op.add_column("submission", sa.Column("timings", sa.JSON(), nullable=True))
+
+
+def downgrade():
+    op.drop_column("submission", "timings")
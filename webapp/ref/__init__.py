@@ -568,6 +568,12 @@ def create_app(config=None):
             )
             failsafe()
 
+        # Networks might have been created or removed while we were not running.
+        try:
+            DockerClient().reconcile_subnets()
+        except Exception:
+            app.logger.error("Failed to reconcile instance subnets.", exc_info=True)
+
     # Enable/Disable maintenance mode base on the ctrl.sh '--maintenance' argument.
     with app.app_context():
         from ref.model import SystemSettingsManager
@@ -581,6 +587,9 @@ def create_app(config=None):
         # Instruct our clients to not cache anything if
         # DISABLE_RESPONSE_CACHING is set.
         def disable_response_chaching(response):
+            # Responses with an ETag are revalidated on each request anyway.
+            if response.get_etag()[0]:
+                return response
             response.headers["Cache-Control"] = (
                 "no-cache, no-store, must-revalidate, public, max-age=0"
             )
@@ -614,6 +623,21 @@ def create_app(config=None):
 
     app.before_request(request_time)
 
+    def start_submission_queue():
+        from ref.core import submission_queue
+
+        # Picks up requests that were queued before a restart.
+        submission_queue.start(app)
+
+    app.before_request(start_submission_queue)
+
+    def start_docker_inventory():
+        from ref.core import docker_inventory
+
+        docker_inventory.start(app)
+
+    app.before_request(start_docker_inventory)
+
     # Lock database each time a new DB transaction is started (BEGIN...)
     # This is not really optimal, but we do not have to deal with concurrency issues, so what?
     @db.event.listens_for(db.session, "after_begin")
@@ -5,7 +5,7 @@ import re
 import tarfile
 from io import BytesIO
 from pathlib import Path
-from typing import List, Union, Optional
+from typing import List, Union
 
 import docker
 from docker import errors
@@ -14,6 +14,9 @@ from flask import current_app
 
 from ref.core.logging import get_logger
 
+from . import docker_inventory
+from .subnets import SubnetAllocator
+
 log = get_logger(__name__)
 
 # Network pool for instance networks. Using /29 subnets (6 usable IPs) to avoid
@@ -256,6 +259,15 @@ class DockerClient:
             docker.errors.APIError
             docker.errors.NotFound
         """
+        inventory = docker_inventory.live()
+        if inventory is not None:
+            info = inventory.container(getattr(container, "id", container))
+            if info is not None:
+                containers = inventory.transitive_closure(info.id)
+                if not include_self:
+                    containers.remove(info.id)
+                return containers
+
         container = self.container(container, raise_on_not_found=True)
         containers = set()
         containers.add(container.id)
@@ -406,33 +418,42 @@ class DockerClient:
         """Get all subnets currently in use by Docker networks."""
         used = set()
         for network in self.client.networks.list():
+            used.update(self._network_subnets(network))
+        return used
+
+    @staticmethod
+    def _subnet_allocator() -> SubnetAllocator:
+        return SubnetAllocator(
+            Path(current_app.config["SUBNET_ALLOCATOR_PATH"]),
+            INSTANCE_NETWORK_POOL,
+            INSTANCE_SUBNET_PREFIX,
+        )
+
+    @staticmethod
+    def _network_subnets(
+        network: docker.models.networks.Network,
+    ) -> List[ipaddress.IPv4Network]:
+        ret = []
+        ipam_config = (network.attrs.get("IPAM") or {}).get("Config") or []
+        for config in ipam_config:
             try:
-                ipam_config = (network.attrs.get("IPAM") or {}).get("Config") or []
-                for config in ipam_config:
-                    subnet_str = config.get("Subnet")
-                    if subnet_str:
-                        used.add(ipaddress.IPv4Network(subnet_str))
+                ret.append(ipaddress.IPv4Network(config["Subnet"]))
             except (KeyError, ValueError):
                 continue
-        return used
+        return ret
 
-    def _allocate_subnet(self) -> Optional[ipaddress.IPv4Network]:
+    def reconcile_subnets(self):
         """
-        Allocate an unused /29 subnet from the instance network pool.
-
-        Returns:
-            An available IPv4Network, or None if pool is exhausted.
+        Synchronize the subnet allocator with the networks that exist in Docker.
+        This lists all networks, thus it should only be called at startup and
+        during garbage collection.
+        Raises:
+            - docker.errors.APIError
         """
-        used_subnets = self._get_used_subnets()
-
-        # Iterate through all possible /29 subnets in our pool
-        for subnet in INSTANCE_NETWORK_POOL.subnets(new_prefix=INSTANCE_SUBNET_PREFIX):
-            # Check if this subnet overlaps with any used subnet
-            overlaps = any(subnet.overlaps(used) for used in used_subnets)
-            if not overlaps:
-                return subnet
-
-        return None
+        with self._subnet_allocator().locked() as subnets:
+            used = self._get_used_subnets()
+            subnets.reconcile(used)
+        log.info(f"Reconciled subnet allocator with {len(used)} used subnets")
 
     def create_network(self, name=None, driver="bridge", internal=False):
         """
@@ -450,43 +471,45 @@ class DockerClient:
                 random.choices(string.ascii_uppercase, k=10)
             )
 
-        # Retry loop to handle race conditions when multiple processes
-        # try to allocate the same subnet concurrently
+        # The allocator stays locked until the network is created, thus concurrent
+        # calls do not pick the same subnet. Docker may still report an overlap
+        # with a network that was created since the allocator was last reconciled.
+        # Such subnets stay marked as used and the next one is tried.
         max_retries = 10
         last_error = None
 
-        for attempt in range(max_retries):
-            # Allocate a /29 subnet from our pool
-            subnet = self._allocate_subnet()
-            if subnet is None:
-                raise RuntimeError(
-                    "No available subnet in instance network pool. "
-                    "Consider cleaning up unused networks."
-                )
+        with self._subnet_allocator().locked() as subnets:
+            for attempt in range(max_retries):
+                subnet = subnets.allocate()
+                if subnet is None:
+                    raise RuntimeError(
+                        "No available subnet in instance network pool. "
+                        "Consider cleaning up unused networks."
+                    )
 
-            # First usable host is the gateway
-            gateway = str(list(subnet.hosts())[0])
+                # First usable host is the gateway
+                gateway = str(next(subnet.hosts()))
 
-            ipam_pool = IPAMPool(subnet=str(subnet), gateway=gateway)
-            ipam_config = IPAMConfig(pool_configs=[ipam_pool])
+                ipam_pool = IPAMPool(subnet=str(subnet), gateway=gateway)
+                ipam_config = IPAMConfig(pool_configs=[ipam_pool])
 
-            log.debug(
-                f"Creating network {name} with subnet {subnet} (attempt {attempt + 1})"
-            )
-            try:
-                return self.client.networks.create(
-                    name, driver=driver, internal=internal, ipam=ipam_config
+                log.debug(
+                    f"Creating network {name} with subnet {subnet} (attempt {attempt + 1})"
                 )
-            except errors.APIError as e:
-                # Check if this is a subnet overlap error (race condition)
-                if "Pool overlaps" in str(e):
-                    log.warning(
-                        f"Subnet {subnet} was allocated by another process, retrying..."
+                try:
+                    return self.client.networks.create(
+                        name, driver=driver, internal=internal, ipam=ipam_config
                     )
-                    last_error = e
-                    continue
-                # Re-raise other API errors
-                raise
+                except errors.APIError as e:
+                    if "Pool overlaps" in str(e):
+                        log.warning(
+                            f"Subnet {subnet} is used by an unknown network, retrying..."
+                        )
+                        last_error = e
+                        continue
+                    subnets.free(subnet)
+                    # Re-raise other API errors
+                    raise
 
         # All retries exhausted
         raise RuntimeError(
@@ -536,4 +559,8 @@ class DockerClient:
         # also unable to remove the network. This is a known docker bug and can only be
         # solved by restarting docker.
         if not failed:
+            subnets = self._network_subnets(network)
             network.remove()
+            with self._subnet_allocator().locked() as allocator:
+                for subnet in subnets:
+                    allocator.free(subnet)
@@ -0,0 +1,326 @@
+"""Inventory of Docker containers and networks.
+
+Listing and inspecting every container and network through the Docker API
+takes minutes on hosts with thousands of instances, and slows down the
+daemon for everybody. Thus, the webapp keeps an in-memory inventory of all
+containers, networks, and which containers are connected to which networks.
+It is bootstrapped once from two list requests and then kept current by
+following the daemon's event stream, where most events are applied without
+querying the daemon at all.
+
+The inventory lags slightly behind the daemon, thus code that acts on the
+state of a specific container or network right after changing it must still
+query the Docker API.
+"""
+
+from __future__ import annotations
+
+import os
+import time
+from collections import deque
+from dataclasses import dataclass
+from threading import Lock, Thread
+from typing import Callable, Dict, FrozenSet, Iterable, List, Optional, Set
+
+import docker
+from docker import errors
+from flask import Flask
+
+from ref.core.logging import get_logger
+
+log = get_logger(__name__)
+
+# Time to wait before reconnecting after the event stream broke.
+_RETRY_INTERVAL_S = 5
+
+# Container status after each event that changes it.
+_CONTAINER_STATUS_BY_ACTION = {
+    "create": "created",
+    "start": "running",
+    "restart": "running",
+    "unpause": "running",
+    "pause": "paused",
+    "die": "exited",
+}
+
+
+@dataclass(frozen=True)
+class ContainerInfo:
+    id: str
+    name: str
+    status: str
+
+
+@dataclass(frozen=True)
+class NetworkInfo:
+    id: str
+    name: str
+    internal: bool
+    # IDs of the connected containers.
+    containers: FrozenSet[str]
+
+
+class Inventory:
+    """
+    Containers, networks, and the links between them. All methods are thread
+    safe.
+    """
+
+    def __init__(self):
+        self._lock = Lock()
+        self._ready = False
+        self._containers: Dict[str, ContainerInfo] = {}
+        self._container_ids_by_name: Dict[str, str] = {}
+        # Network ID -> (name, internal)
+        self._networks: Dict[str, tuple] = {}
+        self._network_members: Dict[str, Set[str]] = {}
+        self._container_networks: Dict[str, Set[str]] = {}
+
+    @property
+    def ready(self) -> bool:
+        return self._ready
+
+    def load(self, containers: Iterable[dict], networks: Iterable[dict]):
+        """
+        Replace the inventory with the given container and network summaries,
+        as returned by the `GET /containers/json?all=1` and `GET /networks`
+        endpoints.
+        """
+        with self._lock:
+            self._containers.clear()
+            self._container_ids_by_name.clear()
+            self._networks.clear()
+            self._network_members.clear()
+            self._container_networks.clear()
+            for n in networks:
+                self._add_network(n["Id"], n["Name"], bool(n.get("Internal")))
+            for c in containers:
+                names = c.get("Names") or [c["Id"]]
+                self._set_container(
+                    ContainerInfo(c["Id"], names[0].lstrip("/"), c.get("State", ""))
+                )
+                settings = (c.get("NetworkSettings") or {}).get("Networks") or {}
+                for endpoint in settings.values():
+                    # Stopped containers keep their configuration, but are
+                    # disconnected (like the daemon reports via events).
+                    if endpoint.get("NetworkID") and endpoint.get("EndpointID"):
+                        self._connect(endpoint["NetworkID"], c["Id"])
+            self._ready = True
+
+    def clear(self):
+        """
+        Mark the inventory as outdated, until load() is called again.
+        """
+        with self._lock:
+            self._ready = False
+
+    def apply(self, event: dict, inspect_network: Callable[[str], dict]):
+        """
+        Apply an event of the daemon's event stream.
+        Args:
+            inspect_network: Returns the attributes of the network with the
+                given ID, used for networks that were created.
+        """
+        actor = event.get("Actor") or {}
+        object_id = actor.get("ID")
+        attributes = actor.get("Attributes") or {}
+        action = event.get("Action", "")
+        if not object_id:
+            return
+
+        if event.get("Type") == "container":
+            with self._lock:
+                if action == "destroy":
+                    removed = self._containers.pop(object_id, None)
+                    if removed is not None:
+                        self._container_ids_by_name.pop(removed.name, None)
+                    for network_id in self._container_networks.pop(object_id, set()):
+                        self._network_members.get(network_id, set()).discard(
+                            object_id
+                        )
+                    return
+                current = self._containers.get(object_id)
+                name = attributes.get("name") or (current.name if current else "")
+                status = _CONTAINER_STATUS_BY_ACTION.get(action)
+                if status is None:
+                    if action != "rename" or current is None:
+                        return
+                    status = current.status
+                if current is not None and current.name != name:
+                    self._container_ids_by_name.pop(current.name, None)
+                self._set_container(ContainerInfo(object_id, name, status))
+
+        elif event.get("Type") == "network":
+            if action == "create":
+                try:
+                    attrs = inspect_network(object_id)
+                except errors.NotFound:
+                    return
+                with self._lock:
+                    self._add_network(
+                        object_id, attrs["Name"], bool(attrs.get("Internal"))
+                    )
+                return
+            with self._lock:
+                if action == "destroy":
+                    self._networks.pop(object_id, None)
+                    for container_id in self._network_members.pop(object_id, set()):
+                        self._container_networks.get(container_id, set()).discard(
+                            object_id
+                        )
+                elif action == "connect" and attributes.get("container"):
+                    self._connect(object_id, attributes["container"])
+                elif action == "disconnect" and attributes.get("container"):
+                    self._network_members.get(object_id, set()).discard(
+                        attributes["container"]
+                    )
+                    self._container_networks.get(
+                        attributes["container"], set()
+                    ).discard(object_id)
+
+    def _set_container(self, info: ContainerInfo):
+        self._containers[info.id] = info
+        self._container_ids_by_name[info.name] = info.id
+
+    def _add_network(self, network_id: str, name: str, internal: bool):
+        self._networks[network_id] = (name, internal)
+        self._network_members.setdefault(network_id, set())
+
+    def _connect(self, network_id: str, container_id: str):
+        self._network_members.setdefault(network_id, set()).add(container_id)
+        self._container_networks.setdefault(container_id, set()).add(network_id)
+
+    def containers(self, name: Optional[str] = None) -> List[ContainerInfo]:
+        """
+        All containers (including stopped ones), optionally only those whose
+        name contains `name`.
+        """
+        with self._lock:
+            return [
+                c for c in self._containers.values() if name is None or name in c.name
+            ]
+
+    def container(self, name_or_id: str) -> Optional[ContainerInfo]:
+        with self._lock:
+            container_id = self._container_ids_by_name.get(name_or_id, name_or_id)
+            return self._containers.get(container_id)
+
+    def networks(self, name: Optional[str] = None) -> List[NetworkInfo]:
+        """
+        All networks, optionally only those whose name contains `name`.
+        """
+        with self._lock:
+            return [
+                NetworkInfo(
+                    network_id,
+                    network_name,
+                    internal,
+                    # Networks might have endpoints of containers that do not
+                    # exist anymore.
+                    frozenset(self._network_members.get(network_id, ())),
+                )
+                for network_id, (network_name, internal) in self._networks.items()
+                if name is None or name in network_name
+            ]
+
+    def connected_containers(self, network_id: str) -> Set[str]:
+        with self._lock:
+            return set(self._network_members.get(network_id, ()))
+
+    def connected_networks(self, container_id: str) -> Set[str]:
+        with self._lock:
+            return set(self._container_networks.get(container_id, ()))
+
+    def transitive_closure(self, container_id: str) -> Set[str]:
+        """
+        IDs of all containers that are connected to `container_id` over any
+        network, including via intermediate containers, and the container
+        itself.
+        """
+        with self._lock:
+            visited = {container_id}
+            todo = deque([container_id])
+            while todo:
+                for network_id in self._container_networks.get(todo.popleft(), ()):
+                    for other in self._network_members.get(network_id, ()):
+                        if other not in visited:
+                            visited.add(other)
+                            todo.append(other)
+            return visited
+
+
+_inventory = Inventory()
+_start_lock = Lock()
+# PID of the process the event stream is followed in.
+_started_pid: Optional[int] = None
+
+
+def load_from_api(client: docker.DockerClient) -> Inventory:
+    """
+    A one-off inventory loaded from the Docker API.
+    """
+    inventory = Inventory()
+    inventory.load(client.api.containers(all=True), client.api.networks())
+    return inventory
+
+
+def get(client: docker.DockerClient) -> Inventory:
+    """
+    The live inventory, or one loaded via `client` if it is not available
+    (e.g., because it is still bootstrapping, or the event stream broke).
+    """
+    if _inventory.ready:
+        return _inventory
+    return load_from_api(client)
+
+
+def live() -> Optional[Inventory]:
+    """
+    The live inventory, if it is available.
+    """
+    return _inventory if _inventory.ready else None
+
+
+def start(app: Flask):
+    """
+    Start following the event stream, if this is not done in this process yet.
+    """
+    global _started_pid
+
+    with _start_lock:
+        if _started_pid == os.getpid():
+            return
+        # Threads do not survive forking.
+        _started_pid = os.getpid()
+        _inventory.clear()
+        Thread(
+            target=_follow_events, args=(app,), name="docker-inventory", daemon=True
+        ).start()
+
+
+def _follow_events(app: Flask):
+    with app.app_context():
+        while True:
+            client = docker.from_env()
+            try:
+                # Opened before loading the inventory, thus changes that happen
+                # meanwhile are applied afterwards.
+                events = client.api.events(
+                    decode=True, filters={"type": ["container", "network"]}
+                )
+                try:
+                    _inventory.load(
+                        client.api.containers(all=True), client.api.networks()
+                    )
+                    log.info("Docker inventory loaded")
+                    for event in events:
+                        _inventory.apply(event, client.api.inspect_network)
+                finally:
+                    events.close()
+                log.warning("Docker event stream ended")
+            except Exception:
+                log.warning("Docker event stream failed", exc_info=True)
+            finally:
+                _inventory.clear()
+                client.close()
+            time.sleep(_RETRY_INTERVAL_S)
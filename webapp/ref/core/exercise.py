@@ -298,6 +298,9 @@ class ExerciseManager:
         entry.allow_internet = ExerciseManager._parse_attr(
             entry_cfg, "allow-internet", bool, required=False, default=False
         )
+        entry.compiler_cache = ExerciseManager._parse_attr(
+            entry_cfg, "compiler-cache", bool, required=False, default=False
+        )
 
         def __check_mem_limit(val, min_mb):
             if not val or val.strip() == "0" or val.lower() == "none":
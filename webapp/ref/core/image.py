@@ -17,9 +17,24 @@ from ref.core.logging import get_logger
 
 from .docker import DockerClient
 from .exercise import Exercise, ExerciseBuildStatus
+from .pool import InstancePool
 
 log = get_logger(__name__)
 
+# Cache of the objects compiled by the build-cmd of exercises that enable
+# compiler-cache. The tests of all instances use it as read-only cache in
+# addition to their own cache (see _run_tests() in ref-docker-base/task.py).
+# Only accessible by root, since it contains the objects of the harness.
+# ! Keep in sync with ref-docker-base/task.py
+_COMPILER_CACHE_EXERCISE_DIR = "/var/cache/ref/ccache"
+# Prepended to each build-cmd, such that compilers (e.g., cc, gcc, clang) are
+# invoked via ccache and store their results in the exercise's cache only.
+_COMPILER_CACHE_BUILD_ENV = (
+    'export PATH="/usr/lib/ccache:$PATH" CCACHE_DIR=/tmp/ref-ccache'
+    f" CCACHE_REMOTE_STORAGE=file:{_COMPILER_CACHE_EXERCISE_DIR}"
+    " CCACHE_REMOTE_ONLY=true"
+)
+
 # Create a dedicated file logger for build operations that persists even on crash
 _build_file_logger: logging.Logger | None = None
 
@@ -180,9 +195,12 @@ class ExerciseImageManager:
         es = exercise_service
         cmd = []
         if es.flag_path:
-            cmd += [f'RUN echo "{es.flag_value}" > {es.flag_path}']
-            cmd += [f'RUN chown {es.flag_user}:{es.flag_group} "{es.flag_path}"']
-            cmd += [f'RUN chmod {es.flag_permission} "{es.flag_path}"']
+            # A single layer on top of the exercise's files.
+            cmd += [
+                f'RUN echo "{es.flag_value}" > {es.flag_path}'
+                f' && chown {es.flag_user}:{es.flag_group} "{es.flag_path}"'
+                f' && chmod {es.flag_permission} "{es.flag_path}"'
+            ]
 
         return cmd
 
@@ -260,16 +278,29 @@ class ExerciseImageManager:
             if exercise.submission_test_enabled:
                 _log_build("[BUILD] Submission tests enabled, adding to image")
                 assert os.path.isfile(f"{exercise.template_path}/submission_tests")
+                # The bytecode is cached next to it (checked against the hash of
+                # the source), thus _task does not compile it on every run.
                 cmds += [
                     "COPY submission_tests /usr/local/bin/submission_tests",
-                    "RUN chown root:root /usr/local/bin/submission_tests && chmod 700 /usr/local/bin/submission_tests",
+                    "RUN chown root:root /usr/local/bin/submission_tests && chmod 700 /usr/local/bin/submission_tests"
+                    " && python3 -c 'import py_compile as c; c.compile(\"/usr/local/bin/submission_tests\", invalidation_mode=c.PycInvalidationMode.CHECKED_HASH)'",
+                ]
+
+            build_cmd = exercise.entry_service.build_cmd
+            if exercise.entry_service.compiler_cache:
+                _log_build("[BUILD] Compiler cache enabled")
+                build_cmd = [f"mkdir -p {_COMPILER_CACHE_EXERCISE_DIR}"] + [
+                    f"{_COMPILER_CACHE_BUILD_ENV} && {line}" for line in build_cmd
                 ]
+                cmds = [
+                    f"RUN rm -rf /tmp/ref-ccache && chmod -R go= {_COMPILER_CACHE_EXERCISE_DIR}"
+                ] + cmds
 
             _log_build("[BUILD] Generating Dockerfile template...")
             dockerfile = ExerciseImageManager.__build_template(
                 app,
                 exercise.entry_service.files,
-                exercise.entry_service.build_cmd,
+                build_cmd,
                 exercise.entry_service.disable_aslr,
                 custom_build_cmd=cmds,
             )
@@ -609,6 +640,9 @@ class ExerciseImageManager:
             inconsistency_on_error: If deletion fails.
         """
         with inconsistency_on_error(f"Failed to delete images of {self.exercise}"):
+            # Pooled containers would keep the entry service image alive.
+            InstancePool(self.exercise).drain()
+
             # Delete docker images
             ExerciseImageManager.__purge_entry_service_image(self.exercise, force=force)
             ExerciseImageManager.__purge_peripheral_services_images(
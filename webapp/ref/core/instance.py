@@ -1,9 +1,12 @@
 import datetime
 import os
+import secrets
 import shutil
 import subprocess
+import time
 from pathlib import Path
-from typing import List
+from threading import Thread
+from typing import Dict, List, Optional, Tuple
 
 from flask import current_app
 
@@ -21,10 +24,37 @@ from ref.model import SubmissionTestResult
 
 from .docker import DockerClient
 from .exercise import Exercise
+from .pool import InstancePool
+from .snapshot import SnapshotStore, copy_tree
 
 log = get_logger(__name__)
 
 
+def _purge_in_background(path: Path):
+    """
+    Delete `path` in a background thread, using the lowest best-effort I/O
+    priority and CPU priority.
+    """
+
+    def purge():
+        cmd = [
+            "/usr/bin/sudo",
+            "/usr/bin/ionice",
+            "-c2",
+            "-n7",
+            "/usr/bin/nice",
+            "-n19",
+            "/bin/rm",
+            "-rf",
+            "--",
+            path.as_posix(),
+        ]
+        if subprocess.call(cmd, shell=False):
+            log.error(f"Failed to purge {path}")
+
+    Thread(target=purge, name=f"purge-{path.name}", daemon=True).start()
+
+
 class InstanceManager:
     """
     Used to manage a ExerciseInstance.
@@ -34,6 +64,10 @@ class InstanceManager:
         self.dc = DockerClient()
         self.instance = instance
 
+    @staticmethod
+    def _snapshot_store() -> SnapshotStore:
+        return SnapshotStore(Path(current_app.config["SNAPSHOT_STORE_PATH"]))
+
     @staticmethod
     def create_instance(user: User, exercise: Exercise) -> Instance:
         """
@@ -97,11 +131,36 @@ class InstanceManager:
 
         return instance
 
-    def create_submission(self, test_results: List[SubmissionTestResult]) -> Instance:
+    def _snapshot_entry_upper(self, dst: Path, manifest: Path):
+        """
+        Snapshot the user data of the instance into `dst`. Unchanged files are
+        shared with earlier snapshots via the snapshot store.
+        """
+        # XXX: We are working here with mounted overlayfs directories.
+        src = Path(self.instance.entry_service.overlay_upper)
+        stat_cache = Path(self.instance.entry_service.overlay_upper_stat_cache)
+        container = self.dc.container(self.instance.entry_service.container_id)
+
+        # Make sure no running process is interfering with our copy operation,
+        # since, e.g., files disappiring during `cp`` execution cause non zero
+        # exit statuses.
+        container.pause()
+        try:
+            self._snapshot_store().snapshot(src, dst, manifest, stat_cache=stat_cache)
+        finally:
+            container.unpause()
+
+    def create_submission(
+        self,
+        test_results: List[SubmissionTestResult],
+        phases: Optional[Dict[str, float]] = None,
+    ) -> Instance:
         """
         Args:
             test_ret: The return value of the submission test (user controlled!)
             test_out: The output of the submission test (user controlled!)
+            phases: If passed, the duration of the snapshot (in ms) is recorded
+              as its "snapshot" entry (see ref/core/timing.py).
         Creates a new instance that represents a snapshot of the current instance state.
           - This will not check whether associated deadline is passed.
         Raises:
@@ -119,35 +178,21 @@ class InstanceManager:
         new_instance = InstanceManager.create_instance(user, exercise)
         new_mgr = InstanceManager(new_instance)
 
-        # Copy user data from the original instance as second lower dir to new instance.
-        # XXX: We are working here with mounted overlayfs directories.
-        src = self.instance.entry_service.overlay_upper
-        dst = new_instance.entry_service.overlay_submitted
-        # -a is mandatory, since the upper dir might contain files with extended file attrbiutes (used by overlayfs).
-        cmd = f"sudo rsync -arXv {src}/ {dst}/"
+        # Snapshot user data from the original instance as second lower dir to new instance.
+        dst = Path(new_instance.entry_service.overlay_submitted)
+        manifest = Path(new_instance.entry_service.overlay_submitted_manifest)
 
         try:
-            container = self.dc.container(self.instance.entry_service.container_id)
+            started_ns = time.monotonic_ns()
+            self._snapshot_entry_upper(dst, manifest)
+            if phases is not None:
+                phases["snapshot"] = round((time.monotonic_ns() - started_ns) / 1e6, 3)
         except Exception:
-            log.error("Error while getting instance container", exc_info=True)
-            with inconsistency_on_error():
-                new_mgr.remove()
-            raise
-
-        try:
-            # Make sure no running process is interfering with our copy operation,
-            # since, e.g., files disappiring during `cp`` execution cause non zero
-            # exit statuses.
-            container.pause()
-            subprocess.check_call(cmd, shell=True)
-            container.unpause()
-        except subprocess.CalledProcessError:
             log.error(
                 "Error while coping submitted data into new instance.", exc_info=True
             )
             with inconsistency_on_error():
                 new_mgr.remove()
-                container.unpause()
             raise
 
         submission = Submission()
@@ -208,13 +253,15 @@ class InstanceManager:
                 # We are working directly on the merged directory, since changeing the upper dir itself causes issues:
                 # [328100.750176] overlayfs: failed to verify origin (entry-server/lower, ino=31214863, err=-116)
                 # [328100.750178] overlayfs: failed to verify upper root origin
-                # rsync ignores whiteouts created by overlayfs without the --devices argument. Thus, this command will
-                # cause whiteouts to be discarded and will only copy user created data into the new distance.
+                # copy_tree() skips whiteouts created by overlayfs. Thus, this will cause whiteouts to be discarded
+                # and will only copy user created data into the new distance.
                 # So, if the user deleted a file from the lower dir, it will become visible again after an upgrade.
-                # FIXME: Transfer whiteouts to new instances during upgrade. Just using --devices causes mount to fail
+                # FIXME: Transfer whiteouts to new instances during upgrade. Just copying them causes mount to fail
                 # FIXME: with an `stale file error`.
-                cmd = f"sudo rsync -arXv {self.instance.entry_service.overlay_upper}/ {new_instance.entry_service.overlay_upper}/"
-                subprocess.check_call(cmd, shell=True)
+                copy_tree(
+                    Path(self.instance.entry_service.overlay_upper),
+                    Path(new_instance.entry_service.overlay_upper),
+                )
         except Exception:
             log.info("whops", exc_info=True)
             with inconsistency_on_error():
@@ -240,7 +287,8 @@ class InstanceManager:
         # Split the CIDR suffix
         return ip.split("/")[0]
 
-    def __get_container_config_defaults(self):
+    @staticmethod
+    def _get_container_config_defaults():
         config = {}
 
         # Apply a custom seccomp:
@@ -261,7 +309,8 @@ class InstanceManager:
 
         return config
 
-    def __get_container_limits_config(self, limits: RessourceLimits):
+    @staticmethod
+    def _get_container_limits_config(limits: RessourceLimits):
         config = {}
         log.info(f"limits={limits}")
 
@@ -417,9 +466,9 @@ class InstanceManager:
 
         to_entry_network.connect(entry_container)
 
-        default_config = self.__get_container_config_defaults()
+        default_config = self._get_container_config_defaults()
         # Use default settings for peripheral services.
-        ressource_limit_config = self.__get_container_limits_config(None)
+        ressource_limit_config = self._get_container_limits_config(None)
 
         config = default_config | ressource_limit_config
         assert (len(default_config) + len(ressource_limit_config)) == len(config)
@@ -453,30 +502,14 @@ class InstanceManager:
 
             current_app.db.session.add(service)
 
-    def start(self):
+    @staticmethod
+    def _get_infrastructure_containers(dc: DockerClient):
         """
-        Starts the instance. Before calling this function, .stop() should be called.
+        Returns the SSH reverse proxy and the web container that must be connected
+        to the network of each entry service.
         Raises:
-            *: If starting the instance failed.
-            InconsistentStateError: If the starting operation failed, and left the system in an inconsistent state.
+            RuntimeError: If one of the containers does not exist.
         """
-        assert self.is_mounted(), (
-            "Instances should always be mounted, except just before they are removed"
-        )
-
-        # FIXME: Remove this? It feels wrong to call this each time as a safeguard.
-        # Make sure everything is cleaned up (this function can be called regardless of whether the instance is running)
-        self.stop()
-
-        exercise: Exercise = self.instance.exercise
-
-        # Class if the EntryService
-        exercise_entry_service = exercise.entry_service
-
-        # Object/Instance of the EntryService
-        instance_entry_service = self.instance.entry_service
-
-        # Get the container IDs of the SSH reverse proxy and web container.
         ssh_proxy_name = current_app.config["SSH_REVERSE_PROXY_CONTAINER_NAME"]
         web_name = current_app.config["WEB_CONTAINER_NAME"]
         log.info(f"[INSTANCE] Looking up SSH proxy container: {ssh_proxy_name}")
@@ -486,8 +519,8 @@ class InstanceManager:
         )
         print(f"[INSTANCE] Looking up web container: {web_name}", flush=True)
 
-        ssh_proxy_container = self.dc.container(ssh_proxy_name)
-        web_container = self.dc.container(web_name)
+        ssh_proxy_container = dc.container(ssh_proxy_name)
+        web_container = dc.container(web_name)
 
         log.info(f"[INSTANCE] SSH proxy container: {ssh_proxy_container}")
         log.info(f"[INSTANCE] Web container: {web_container}")
@@ -505,37 +538,191 @@ class InstanceManager:
                 "The container may still be starting or has been removed."
             )
 
-        # Create a network that connects the entry service with the SSH reverse proxy.
-        entry_to_ssh_network_name = f"{current_app.config['DOCKER_RESSOURCE_PREFIX']}{self.instance.exercise.short_name}-v{self.instance.exercise.version}-ssh-to-entry-{self.instance.id}"
+        return ssh_proxy_container, web_container
 
+    @staticmethod
+    def _create_entry_network(
+        dc: DockerClient, name: str, internal: bool, ssh_proxy_container, web_container
+    ):
+        """
+        Create a network that connects an entry service with the SSH reverse proxy
+        and the web container.
+        """
         # If it is internal, the host does not attach an interface to the bridge, and therefore there is no way
         # of routing data to other endpoints then the two connected containers.
-        entry_to_ssh_network = self.dc.create_network(
-            name=entry_to_ssh_network_name,
-            internal=not self.instance.exercise.entry_service.allow_internet,
-        )
-        self.instance.network_id = entry_to_ssh_network.id
+        network = dc.create_network(name=name, internal=internal)
 
         # Make the SSH reverse proxy join the network (for SSH routing to instance containers)
-        log.info(f"Connecting SSH reverse proxy to network {self.instance.network_id}")
+        log.info(f"Connecting SSH reverse proxy to network {network.id}")
 
         try:
-            entry_to_ssh_network.connect(ssh_proxy_container)
+            network.connect(ssh_proxy_container)
         except Exception:
             # This will reraise automatically
             with inconsistency_on_error():
-                self.dc.remove_network(entry_to_ssh_network)
+                dc.remove_network(network)
 
         # Connect web container with alias so instance containers can reach the API
         # (task.py uses http://ssh-reverse-proxy:8000 for API calls)
-        log.info(f"Connecting web container to network {self.instance.network_id}")
+        log.info(f"Connecting web container to network {network.id}")
         try:
-            entry_to_ssh_network.connect(web_container, aliases=["ssh-reverse-proxy"])
+            network.connect(web_container, aliases=["ssh-reverse-proxy"])
         except Exception:
             # This will reraise automatically
             with inconsistency_on_error():
-                entry_to_ssh_network.disconnect(ssh_proxy_container)
-                self.dc.remove_network(entry_to_ssh_network)
+                network.disconnect(ssh_proxy_container)
+                dc.remove_network(network)
+
+        return network
+
+    @staticmethod
+    def _get_common_mounts(dc: DockerClient) -> dict:
+        """
+        Returns the mounts that are the same for all entry services.
+        Raises:
+            RuntimeError: If the container SSH keys are missing.
+        """
+        mounts = {}
+
+        # Bind-mount the host ref-utils source over the baked editable install
+        # so edits on the host apply immediately inside the instance container.
+        # /ref-utils is mounted into the webapp container by docker-compose.yml.
+        ref_utils_webapp_path = "/ref-utils"
+        if Path(ref_utils_webapp_path).is_dir():
+            mounts[dc.local_path_to_host(ref_utils_webapp_path)] = {
+                "bind": "/opt/ref-utils",
+                "mode": "ro",
+            }
+
+        # Bind-mount container SSH public keys so sshd can authenticate the
+        # SSH reverse proxy. Keys are live — changing them on the host takes
+        # effect immediately without rebuilding images or restarting containers.
+        container_keys_path = Path("/container-keys")
+        user_key = container_keys_path / "user_key.pub"
+        root_key = container_keys_path / "root_key.pub"
+        if not user_key.exists() or not root_key.exists():
+            raise RuntimeError(
+                f"Container SSH public keys not found at {container_keys_path}. "
+                "Ensure container-keys/ is mounted into the web container."
+            )
+        mounts[dc.local_path_to_host(str(user_key))] = {
+            "bind": "/etc/ssh/master_keys/user",
+            "mode": "ro",
+        }
+        mounts[dc.local_path_to_host(str(root_key))] = {
+            "bind": "/etc/ssh/master_keys/root",
+            "mode": "ro",
+        }
+
+        return mounts
+
+    def _entry_container_name(self) -> str:
+        name = f"{current_app.config['DOCKER_RESSOURCE_PREFIX']}"
+        name += f"{self.instance.exercise.short_name}-v{self.instance.exercise.version}-entry-{self.instance.id}"
+        return name
+
+    def _entry_setup_script(self) -> str:
+        """
+        Script that is initially executed in entry containers of this instance
+        to setup the environment.
+        """
+        exercise: Exercise = self.instance.exercise
+
+        # The instance ID is world readable, thus `task id` can be answered
+        # by task-wrapper.c without calling into _task.
+        container_setup_script = (
+            "#!/bin/bash\n"
+            "set -e\n"
+            f"echo -n {self.instance.id} > /etc/instance_id && chmod 444 /etc/instance_id\n"
+        )
+        if exercise.entry_service.disable_aslr:
+            container_setup_script += (
+                "touch /etc/aslr_disabled && chmod 400 /etc/aslr_disabled\n"
+            )
+
+        if self.instance.submission:
+            container_setup_script += "touch /etc/is_submission\n"
+
+        return container_setup_script
+
+    @staticmethod
+    def _provision_container(
+        dc: DockerClient, container, setup_script: str, instance_key: bytes
+    ):
+        """
+        Run `setup_script` (see _entry_setup_script()) in `container` and store
+        the instance key. Does not access the DB.
+        Raises:
+            Exception: If the setup script failed.
+        """
+        dc.container_add_file(container, "/tmp/setup.sh", setup_script.encode("utf-8"))
+        ret = container.exec_run('bash -c "/tmp/setup.sh"')
+        if ret.exit_code != 0:
+            log.info(f"Container setup script failed. ret={ret}")
+            raise Exception("Failed to start instance")
+
+        # Store the instance specific key that is used to sign requests from the container to web.
+        dc.container_add_file(container, "/etc/key", instance_key)
+
+    def _provision_entry_container(self, container):
+        """
+        Bind a freshly created entry container to this instance by running the setup
+        script and storing the instance key.
+        Raises:
+            Exception: If the setup script failed.
+        """
+        self._provision_container(
+            self.dc, container, self._entry_setup_script(), self.instance.get_key()
+        )
+
+    def start(self):
+        """
+        Starts the instance. Before calling this function, .stop() should be called.
+        Raises:
+            *: If starting the instance failed.
+            InconsistentStateError: If the starting operation failed, and left the system in an inconsistent state.
+        """
+        assert self.is_mounted(), (
+            "Instances should always be mounted, except just before they are removed"
+        )
+
+        # FIXME: Remove this? It feels wrong to call this each time as a safeguard.
+        # Make sure everything is cleaned up (this function can be called regardless of whether the instance is running)
+        self.stop()
+
+        exercise: Exercise = self.instance.exercise
+
+        # Class if the EntryService
+        exercise_entry_service = exercise.entry_service
+
+        # Object/Instance of the EntryService
+        instance_entry_service = self.instance.entry_service
+
+        # Get the container IDs of the SSH reverse proxy and web container.
+        ssh_proxy_container, web_container = self._get_infrastructure_containers(
+            self.dc
+        )
+
+        # Take a pre-created container from the pool, if there is one.
+        pool = InstancePool(exercise)
+        if not self.instance.submission and pool.claim(
+            self, ssh_proxy_container, web_container
+        ):
+            current_app.db.session.add(self.instance)
+            current_app.db.session.add(self.instance.entry_service)
+            pool.fill()
+            return
+
+        # Create a network that connects the entry service with the SSH reverse proxy.
+        entry_to_ssh_network_name = f"{current_app.config['DOCKER_RESSOURCE_PREFIX']}{self.instance.exercise.short_name}-v{self.instance.exercise.version}-ssh-to-entry-{self.instance.id}"
+        entry_to_ssh_network = self._create_entry_network(
+            self.dc,
+            entry_to_ssh_network_name,
+            not self.instance.exercise.entry_service.allow_internet,
+            ssh_proxy_container,
+            web_container,
+        )
+        self.instance.network_id = entry_to_ssh_network.id
 
         image_name = exercise.entry_service.image_name
         # Create container that is initally connected to the 'none' network
@@ -574,35 +761,13 @@ class InstanceManager:
             "mode": "rw",
         }
 
-        # Bind-mount the host ref-utils source over the baked editable install
-        # so edits on the host apply immediately inside the instance container.
-        # /ref-utils is mounted into the webapp container by docker-compose.yml.
-        ref_utils_webapp_path = "/ref-utils"
-        if Path(ref_utils_webapp_path).is_dir():
-            mounts[self.dc.local_path_to_host(ref_utils_webapp_path)] = {
-                "bind": "/opt/ref-utils",
-                "mode": "ro",
-            }
-
-        # Bind-mount container SSH public keys so sshd can authenticate the
-        # SSH reverse proxy. Keys are live — changing them on the host takes
-        # effect immediately without rebuilding images or restarting containers.
-        container_keys_path = Path("/container-keys")
-        user_key = container_keys_path / "user_key.pub"
-        root_key = container_keys_path / "root_key.pub"
-        if not user_key.exists() or not root_key.exists():
-            raise RuntimeError(
-                f"Container SSH public keys not found at {container_keys_path}. "
-                "Ensure container-keys/ is mounted into the web container."
-            )
-        mounts[self.dc.local_path_to_host(str(user_key))] = {
-            "bind": "/etc/ssh/master_keys/user",
-            "mode": "ro",
-        }
-        mounts[self.dc.local_path_to_host(str(root_key))] = {
-            "bind": "/etc/ssh/master_keys/root",
-            "mode": "ro",
-        }
+        try:
+            mounts |= self._get_common_mounts(self.dc)
+        except Exception:
+            with inconsistency_on_error():
+                entry_to_ssh_network.disconnect(web_container)
+                entry_to_ssh_network.disconnect(ssh_proxy_container)
+                self.dc.remove_network(entry_to_ssh_network)
 
         # Coverage configuration for testing
         coverage_env = {}
@@ -620,16 +785,15 @@ class InstanceManager:
                 shutil.copy(coveragerc_src, coveragerc_dst)
 
         # Default setting shared by the entry service and the peripheral services.
-        default_config = self.__get_container_config_defaults()
-        ressource_limit_config = self.__get_container_limits_config(
+        default_config = self._get_container_config_defaults()
+        ressource_limit_config = self._get_container_limits_config(
             exercise.entry_service.ressource_limit
         )
 
         config = default_config | ressource_limit_config
         assert (len(default_config) + len(ressource_limit_config)) == len(config)
 
-        entry_container_name = f"{current_app.config['DOCKER_RESSOURCE_PREFIX']}"
-        entry_container_name += f"{self.instance.exercise.short_name}-v{self.instance.exercise.version}-entry-{self.instance.id}"
+        entry_container_name = self._entry_container_name()
 
         log.info(f"Creating docker container {entry_container_name}")
         try:
@@ -652,36 +816,15 @@ class InstanceManager:
 
         instance_entry_service.container_id = container.id
 
-        # Script that is initially executed to setup the environment.
-        container_setup_script = (
-            "#!/bin/bash\n"
-            "set -e\n"
-            f"echo -n {self.instance.id} > /etc/instance_id && chmod 400 /etc/instance_id\n"
-        )
-        if exercise.entry_service.disable_aslr:
-            container_setup_script += (
-                "touch /etc/aslr_disabled && chmod 400 /etc/aslr_disabled\n"
-            )
-
-        if self.instance.submission:
-            container_setup_script += "touch /etc/is_submission\n"
-
-        self.dc.container_add_file(
-            container, "/tmp/setup.sh", container_setup_script.encode("utf-8")
-        )
-        ret = container.exec_run('bash -c "/tmp/setup.sh"')
-        if ret.exit_code != 0:
-            log.info(f"Container setup script failed. ret={ret}")
+        try:
+            self._provision_entry_container(container)
+        except Exception:
+            # This will reraise automatically
             with inconsistency_on_error():
                 self.dc.stop_container(container, remove=True)
                 entry_to_ssh_network.disconnect(web_container)
                 entry_to_ssh_network.disconnect(ssh_proxy_container)
                 self.dc.remove_network(entry_to_ssh_network)
-            raise Exception("Failed to start instance")
-
-        # Store the instance specific key that is used to sign requests from the container to web.
-        instance_key = self.instance.get_key()
-        self.dc.container_add_file(container, "/etc/key", instance_key)
 
         try:
             # Remove created container from 'none' network
@@ -713,6 +856,9 @@ class InstanceManager:
         current_app.db.session.add(self.instance)
         current_app.db.session.add(self.instance.entry_service)
 
+        # Prepare a container for the next user of this exercise.
+        pool.fill()
+
     def _stop_networks(self):
         if self.instance.network_id:
             self.dc.remove_network(self.instance.network_id)
@@ -772,6 +918,9 @@ class InstanceManager:
 
         self._remove_container()
 
+        # Detach the instance's persistance from the pool slot its container came from.
+        InstancePool.release(self)
+
         # Sync state back to DB
         self.instance.entry_service.container_id = None
         self.instance.network_id = None
@@ -874,12 +1023,8 @@ class InstanceManager:
         """
         log.info(f"Deleting instance {self.instance}")
         self.stop()
-        self.umount()
         try:
-            if os.path.exists(self.instance.persistance_path):
-                subprocess.check_call(
-                    f"sudo rm -rf {self.instance.persistance_path}", shell=True
-                )
+            InstanceManager.remove_persistance(*self.persistance_paths())
         except Exception:
             log.error(f"Error during removal of instance {self.instance}")
             raise
@@ -904,24 +1049,69 @@ class InstanceManager:
         current_app.db.session.delete(self.instance.entry_service)
         current_app.db.session.delete(self.instance)
 
+    def persistance_paths(self) -> Tuple[str, str, str]:
+        """
+        The arguments of remove_persistance() for this instance. They can not be
+        resolved anymore once committing the instance failed, thus callers that
+        need to clean up after such a failure must resolve them beforehand.
+        """
+        return (
+            self.instance.persistance_path,
+            self.instance.entry_service.overlay_merged,
+            self.instance.entry_service.overlay_submitted_manifest,
+        )
+
+    @staticmethod
+    def remove_persistance(persistance_path: str, overlay_merged: str, manifest: str):
+        """
+        Unmount and delete the persisted data of an instance, and release the
+        snapshot objects used by its submitted data. This does not touch the DB.
+        Args:
+            See persistance_paths().
+        """
+        if os.path.ismount(overlay_merged):
+            subprocess.check_call(["sudo", "/bin/umount", overlay_merged])
+        store = InstanceManager._snapshot_store()
+        snapshot_keys = store.read_manifest(Path(manifest))
+        if os.path.exists(persistance_path):
+            subprocess.check_call(["sudo", "/bin/rm", "-rf", "--", persistance_path])
+        store.release(snapshot_keys)
+
     def reset(self):
         """
         Purges all persisted data from the instance.
+        The upper dir is replaced by an empty one and the old one is deleted in
+        the background, thus this does not depend on the amount of data.
         """
         self.stop()
         self.umount()
         try:
             path = Path(self.instance.entry_service.overlay_upper)
             if path.is_dir():
-                for path in path.glob("*"):
-                    if path.parts[-1] in [".ssh"]:
-                        # Do not purge the .ssh file since it contains the SSH keys
-                        # that are allowed to connect to the instance.
-                        continue
+                # Located next to the upper dir, thus moving it is a rename, and it
+                # is deleted along with the instance if it is still there.
+                trash = path.with_name(f"{path.name}.trash-{secrets.token_hex(8)}")
+                subprocess.check_call(
+                    ["/usr/bin/sudo", "/bin/mv", "-T", "--", str(path), str(trash)],
+                    shell=False,
+                )
+                path.mkdir()
+                # Do not purge the .ssh file since it contains the SSH keys
+                # that are allowed to connect to the instance.
+                ssh = trash / ".ssh"
+                if ssh.exists():
                     subprocess.check_call(
-                        ["/usr/bin/sudo", "/bin/rm", "-rf", "--", path.as_posix()],
+                        [
+                            "/usr/bin/sudo",
+                            "/bin/mv",
+                            "-T",
+                            "--",
+                            str(ssh),
+                            str(path / ".ssh"),
+                        ],
                         shell=False,
                     )
+                _purge_in_background(trash)
         except Exception:
             log.error(
                 f"Error during purgeing of persisted data {self.instance}",
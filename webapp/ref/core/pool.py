@@ -0,0 +1,454 @@
+"""Pool of pre-created entry containers.
+
+Starting an instance creates a network, connects the SSH reverse proxy and
+the web container to it, and creates the entry container. If many students
+connect at the same time (e.g., at the start of an exam), the Docker daemon
+serializes these operations and the SSH connections time out. Thus, for each
+default exercise, up to `INSTANCE_POOL_SIZE` containers are created in
+advance, before they are assigned to an instance.
+
+Each pooled container lives in a *slot* directory below the exercise's
+persistence path:
+
+    pool/<slot>/home          bind mounted to /home/user (if the exercise
+                              persists it)
+    pool/<slot>/shared        bind mounted to /shared
+    pool/<slot>/container_id
+    pool/<slot>/network_id
+    pool/<slot>/ready         created once the container is running
+    pool/<slot>/claimed/      created atomically by whoever takes the slot
+
+The `home` and `shared` directories are mounted with slave propagation.
+Claiming a slot bind mounts the instance's overlay and shared folder onto
+them, which propagates into the running container. Afterwards, the usual
+per-instance setup (instance ID, key) is done and the container is renamed.
+When the instance is stopped, its container is removed as usual, the bind
+mounts are released, and the slot is deleted.
+
+Only exercises without peripheral services are pooled.
+"""
+
+from __future__ import annotations
+
+import os
+import secrets
+import shutil
+import subprocess
+from dataclasses import dataclass
+from pathlib import Path
+from threading import Event, Lock, Thread
+from typing import TYPE_CHECKING, Dict, List, Optional, Set
+
+from flask import current_app
+
+from ref.core.logging import get_logger
+from ref.model import SystemSettingsManager
+
+from .docker import DockerClient
+from .exercise import Exercise
+
+if TYPE_CHECKING:
+    from .instance import InstanceManager
+
+log = get_logger(__name__)
+
+
+@dataclass
+class _Fill:
+    """
+    A running fill thread, or a drain if `thread` is None. Setting `stop` makes
+    the fill thread return before it creates the next slot. For drains, `stop`
+    is set once the drain is finished.
+    """
+
+    thread: Optional[Thread]
+    stop: Event
+
+
+# Exercise ID -> fill thread or drain that currently owns the exercise's pool.
+_filling: Dict[int, _Fill] = {}
+_filling_lock = Lock()
+
+
+@dataclass(frozen=True)
+class _PoolSpec:
+    """
+    Everything needed to create containers for a pool. The fill thread does not
+    access the DB, thus all values are resolved before it is started.
+    """
+
+    exercise_id: int
+    path: str
+    name_prefix: str
+    image_name: str
+    hostname: str
+    readonly: bool
+    internal: bool
+    # Whether /home/user is persisted, i.e., the instance's overlay is mounted there.
+    persistent: bool
+    config: Dict
+    size: int
+
+
+def _bind_mount(src: str, dst: Path):
+    subprocess.check_call(["sudo", "/bin/mount", "--bind", src, dst.as_posix()])
+
+
+def _umount(path: Path):
+    if os.path.ismount(path):
+        subprocess.check_call(["sudo", "/bin/umount", path.as_posix()])
+
+
+def _try_claim(slot: Path) -> bool:
+    try:
+        (slot / "claimed").mkdir()
+    except FileExistsError:
+        return False
+    return True
+
+
+def _read_id(path: Path) -> Optional[str]:
+    try:
+        return path.read_text().strip()
+    except FileNotFoundError:
+        return None
+
+
+def _ready_slots(path: Path) -> List[Path]:
+    if not path.is_dir():
+        return []
+    return [
+        p
+        for p in sorted(path.iterdir())
+        if (p / "ready").exists() and not (p / "claimed").exists()
+    ]
+
+
+def _discard_slot(dc: DockerClient, slot: Path):
+    """
+    Remove the container, network, and directory of a slot. The caller must
+    own the slot, i.e., it was claimed or is still being created.
+    """
+    log.info(f"Discarding pool slot {slot}")
+    container = dc.container(_read_id(slot / "container_id"))
+    if container:
+        container.remove(force=True)
+    dc.remove_network(_read_id(slot / "network_id"))
+
+    # The container is gone, thus the mounts are not busy anymore.
+    _umount(slot / "home")
+    _umount(slot / "shared")
+    shutil.rmtree(slot, ignore_errors=True)
+
+
+def _create_slot(dc: DockerClient, spec: _PoolSpec, ssh_proxy_container, web_container):
+    from .instance import InstanceManager
+
+    slot_id = secrets.token_hex(6)
+    slot = Path(spec.path) / slot_id
+    (slot / "home").mkdir(parents=True)
+    (slot / "shared").mkdir()
+
+    # Mark the slot as ours, thus it is not taken before it is ready.
+    (slot / "claimed").mkdir()
+
+    try:
+        network = InstanceManager._create_entry_network(
+            dc,
+            f"{spec.name_prefix}-ssh-to-entry-pool-{slot_id}",
+            spec.internal,
+            ssh_proxy_container,
+            web_container,
+        )
+        (slot / "network_id").write_text(network.id)
+
+        # Slave propagation makes the mounts done while claiming the slot visible
+        # inside the container.
+        mounts = {
+            dc.local_path_to_host((slot / "shared").as_posix()): {
+                "bind": "/shared",
+                "mode": "rw,rslave",
+            },
+        }
+        # Without persistence, regular starts keep the image's home directory.
+        if spec.persistent:
+            mounts[dc.local_path_to_host((slot / "home").as_posix())] = {
+                "bind": "/home/user",
+                "mode": "rw,rslave",
+            }
+        mounts |= InstanceManager._get_common_mounts(dc)
+
+        container = dc.create_container(
+            spec.image_name,
+            name=f"{spec.name_prefix}-entry-pool-{slot_id}",
+            network_mode="none",
+            volumes=mounts,
+            read_only=spec.readonly,
+            hostname=spec.hostname,
+            **spec.config,
+        )
+        (slot / "container_id").write_text(container.id)
+
+        dc.network("none").disconnect(container)
+        network.connect(container)
+    except Exception:
+        _discard_slot(dc, slot)
+        raise
+
+    (slot / "ready").touch()
+    (slot / "claimed").rmdir()
+    log.info(f"Created pool slot {slot}")
+
+
+def container_ids() -> Set[str]:
+    """
+    IDs of the containers of all pool slots that are not bound to an instance,
+    i.e., that are ready or still being created. These are not referenced by
+    any DB record yet.
+    """
+    ids: Set[str] = set()
+    for (persistence_path,) in current_app.db.session.query(Exercise.persistence_path):
+        path = Path(persistence_path) / "pool"
+        if not path.is_dir():
+            continue
+        for slot in path.iterdir():
+            if (slot / "ready").exists() and (slot / "claimed").exists():
+                continue
+            container_id = _read_id(slot / "container_id")
+            if container_id:
+                ids.add(container_id)
+    return ids
+
+
+class InstancePool:
+    """
+    Pre-created entry containers of an exercise.
+    """
+
+    def __init__(self, exercise: Exercise):
+        self.dc = DockerClient()
+        self.exercise = exercise
+
+    @property
+    def path(self) -> Path:
+        return Path(self.exercise.persistence_path) / "pool"
+
+    def is_enabled(self) -> bool:
+        """
+        Whether containers of this exercise are pooled.
+        """
+        if SystemSettingsManager.INSTANCE_POOL_SIZE.value <= 0:
+            return False
+        if not self.exercise.is_default or self.exercise.services:
+            return False
+        # Coverage runs need per instance container environments.
+        return not os.environ.get("COVERAGE_PROCESS_START")
+
+    def claim(
+        self, mgr: "InstanceManager", ssh_proxy_container, web_container
+    ) -> bool:
+        """
+        Assign a pooled container to the (stopped) instance of `mgr`.
+        On success, the instance's container and network IDs are set and
+        True is returned. If no usable container is available, False is
+        returned and the instance must be started the regular way.
+        """
+        if not self.is_enabled():
+            return False
+
+        for slot in _ready_slots(self.path):
+            if not _try_claim(slot):
+                continue
+            try:
+                if self._bind(mgr, slot, ssh_proxy_container, web_container):
+                    log.info(f"Claimed pool slot {slot} for {mgr.instance}")
+                    return True
+            except Exception:
+                log.warning(f"Failed to claim pool slot {slot}", exc_info=True)
+            InstancePool.release(mgr)
+            _discard_slot(self.dc, slot)
+
+        return False
+
+    def _bind(
+        self, mgr: "InstanceManager", slot: Path, ssh_proxy_container, web_container
+    ) -> bool:
+        instance = mgr.instance
+        container = self.dc.container(_read_id(slot / "container_id"))
+        network = self.dc.network(_read_id(slot / "network_id"))
+        if not container or container.status != "running" or not network:
+            return False
+
+        # The proxy or web container might have been recreated since the slot was created.
+        connected = self.dc.get_connected_container(network)
+        if ssh_proxy_container.id not in connected:
+            return False
+        if web_container.id not in connected:
+            return False
+
+        # Record the slot before mounting, thus release() can undo partial binds.
+        InstancePool._slot_marker(mgr).write_text(slot.as_posix())
+
+        if self.exercise.entry_service.persistance_container_path:
+            _bind_mount(instance.entry_service.overlay_merged, slot / "home")
+
+        # Same as for regular starts, the shared folder starts empty.
+        shared_folder = Path(instance.entry_service.shared_folder)
+        if shared_folder.exists():
+            shutil.rmtree(shared_folder)
+        shared_folder.mkdir(parents=True)
+        _bind_mount(shared_folder.as_posix(), slot / "shared")
+
+        # Make sure the mounts actually propagated into the container.
+        probe = shared_folder / f".pool-probe-{secrets.token_hex(6)}"
+        probe.touch()
+        ret = container.exec_run(["test", "-e", f"/shared/{probe.name}"])
+        probe.unlink()
+        if ret.exit_code != 0:
+            log.warning(f"Mounts of pool slot {slot} did not propagate")
+            return False
+
+        mgr._provision_entry_container(container)
+        container.rename(mgr._entry_container_name())
+
+        instance.entry_service.container_id = container.id
+        instance.network_id = network.id
+        return True
+
+    @staticmethod
+    def _slot_marker(mgr: "InstanceManager") -> Path:
+        return Path(mgr.instance.persistance_path) / "pool-slot"
+
+    @staticmethod
+    def release(mgr: "InstanceManager"):
+        """
+        Release the slot the instance's container was taken from. Must be called
+        after the container has been removed. It is safe to call this function for
+        instances that do not use a pooled container.
+        """
+        marker = InstancePool._slot_marker(mgr)
+        slot = _read_id(marker)
+        if not slot:
+            return
+        _discard_slot(mgr.dc, Path(slot))
+        marker.unlink()
+
+    def fill(self, wait: bool = False):
+        """
+        Top up the pool in a background thread. Surplus containers (e.g., after
+        the pool size was decreased) are removed.
+        """
+        size = SystemSettingsManager.INSTANCE_POOL_SIZE.value
+        if not self.is_enabled():
+            size = 0
+            if not self.path.is_dir():
+                return
+
+        from .instance import InstanceManager
+
+        exercise = self.exercise
+        config = InstanceManager._get_container_config_defaults()
+        config |= InstanceManager._get_container_limits_config(
+            exercise.entry_service.ressource_limit
+        )
+        spec = _PoolSpec(
+            exercise_id=exercise.id,
+            path=self.path.as_posix(),
+            name_prefix=f"{current_app.config['DOCKER_RESSOURCE_PREFIX']}{exercise.short_name}-v{exercise.version}",
+            image_name=exercise.entry_service.image_name,
+            hostname=exercise.short_name,
+            readonly=exercise.entry_service.readonly,
+            internal=not exercise.entry_service.allow_internet,
+            persistent=bool(exercise.entry_service.persistance_container_path),
+            config=config,
+            size=size,
+        )
+
+        stop = Event()
+        t = Thread(
+            target=InstancePool._run_fill,
+            args=(current_app._get_current_object(), spec, stop),
+        )
+        with _filling_lock:
+            if self.exercise.id in _filling:
+                return
+            _filling[self.exercise.id] = _Fill(t, stop)
+            # Started while holding the lock, thus drain() never joins a thread
+            # that was not started yet.
+            t.start()
+        if wait:
+            t.join()
+
+    def drain(self):
+        """
+        Remove all containers of the pool that are not bound to an instance.
+        A running fill thread is stopped first and no new one is started until
+        the pool is drained. Must be called before the exercise's images are
+        removed.
+        """
+        exercise_id = self.exercise.id
+        while True:
+            with _filling_lock:
+                running = _filling.get(exercise_id)
+                if running is None:
+                    _filling[exercise_id] = _Fill(None, Event())
+                    break
+                if running.thread is not None:
+                    running.stop.set()
+            if running.thread is None:
+                running.stop.wait()
+            else:
+                running.thread.join()
+
+        try:
+            if not self.path.is_dir():
+                return
+            for slot in sorted(self.path.iterdir()):
+                if not (slot / "ready").exists():
+                    # Left behind by a fill thread, which is not running anymore.
+                    _discard_slot(self.dc, slot)
+                elif _try_claim(slot):
+                    _discard_slot(self.dc, slot)
+        finally:
+            with _filling_lock:
+                _filling.pop(exercise_id).stop.set()
+
+    @staticmethod
+    def _run_fill(app, spec: _PoolSpec, stop: Event):
+        from .instance import InstanceManager
+
+        try:
+            with app.app_context():
+                dc = DockerClient()
+                path = Path(spec.path)
+                path.mkdir(parents=True, exist_ok=True)
+
+                # Slots are only created by the (single) fill thread, thus slots that
+                # are not ready have been left behind by a crash.
+                for slot in sorted(path.iterdir()):
+                    if not (slot / "ready").exists():
+                        _discard_slot(dc, slot)
+
+                ready = _ready_slots(path)
+                for slot in ready[spec.size :]:
+                    if _try_claim(slot):
+                        _discard_slot(dc, slot)
+
+                missing = spec.size - len(ready)
+                if missing <= 0:
+                    return
+
+                ssh_proxy_container, web_container = (
+                    InstanceManager._get_infrastructure_containers(dc)
+                )
+                log.info(f"Creating {missing} pooled containers in {path}")
+                for _ in range(missing):
+                    if stop.is_set():
+                        log.info(f"Stopped filling instance pool {path}")
+                        return
+                    _create_slot(dc, spec, ssh_proxy_container, web_container)
+        except Exception:
+            log.error(f"Failed to fill instance pool {spec.path}", exc_info=True)
+        finally:
+            with _filling_lock:
+                del _filling[spec.exercise_id]
@@ -0,0 +1,642 @@
+"""Regrading of all submissions of an exercise.
+
+After a bug in an exercise's `submission_tests` was fixed, the submissions
+that were already made must be tested again. A regrade job runs the tests of
+all submissions of an exercise, either with the exercise's own tests or with
+the `submission_tests` of another version of the exercise (e.g., the one
+containing the fix).
+
+Each submission is tested in a container of its own that is created for this
+purpose, is not connected to any network, and is removed afterwards. The
+submitted data is never modified: the container's /home/user is an overlay
+whose lower layers are the submitted data and the exercise's files, while all
+changes go to a scratch directory that is deleted afterwards. The tests are
+run by `_task submit --results-path`, i.e., the same way `task submit` ran
+them, but the results are written to a file in the container instead of
+being submitted.
+
+Submissions are processed by a bounded number of worker threads that take
+the next submission from a shared queue as soon as they are done with the
+previous one. Thus, a few slow submissions do not delay the others. The queue
+is ordered by the previous duration of the tests (longest first), such that
+the slowest submissions do not end up last. The number of workers is derived
+from the CPUs and memory of the Docker host, and the limits of the exercise's
+containers (see worker_count()).
+
+Jobs are kept in memory of the (single) webapp process. Unless a job was
+started as a preview, the new test results replace the old ones of each
+submission as soon as it was tested.
+"""
+
+from __future__ import annotations
+
+import datetime
+import json
+import math
+import os
+import re
+import secrets
+import subprocess
+import time
+from dataclasses import asdict, dataclass, field
+from pathlib import Path
+from queue import Empty, SimpleQueue
+from threading import Lock, Thread
+from typing import Dict, List, Optional, Set, Tuple
+
+from flask import Flask, current_app
+
+from ref.core.logging import get_logger
+from ref.core.timing import parse_resource_usage
+from ref.model import Submission, SubmissionTestResult
+
+from .docker import DockerClient
+from .exercise import Exercise
+from .instance import InstanceManager, _purge_in_background
+
+log = get_logger(__name__)
+
+# Directory below the persistence path of a submitted instance that contains
+# the overlay used while regrading it.
+_SCRATCH_DIR = "regrade"
+
+# Time the tests get to exit after REGRADE_TIMEOUT_S was reached, before they
+# are killed.
+_KILL_GRACE_S = 10
+
+_SIZE_SUFFIXES = {"": 1, "b": 1, "k": 1024, "m": 1024**2, "g": 1024**3}
+
+
+class RegradeError(Exception):
+    pass
+
+
+@dataclass(frozen=True)
+class TaskOutcome:
+    success: bool
+    score: Optional[float]
+
+
+@dataclass(frozen=True)
+class TaskChange:
+    task_name: str
+    # None if the task did not exist before or after regrading.
+    old: Optional[TaskOutcome]
+    new: Optional[TaskOutcome]
+
+
+def task_changes(
+    old: Dict[str, TaskOutcome], new: Dict[str, TaskOutcome]
+) -> List[TaskChange]:
+    """
+    The tasks whose outcome differs between `old` and `new`, ordered by name.
+    """
+    return [
+        TaskChange(name, old.get(name), new.get(name))
+        for name in sorted(old.keys() | new.keys())
+        if old.get(name) != new.get(name)
+    ]
+
+
+def parse_size(value) -> Optional[int]:
+    """
+    Convert a Docker memory limit (e.g., 256m, or a number of bytes) into
+    bytes. Returns None for unset or malformed values.
+    """
+    if isinstance(value, int) and not isinstance(value, bool):
+        return value
+    if not isinstance(value, str):
+        return None
+    m = re.fullmatch(r"\s*(\d+)\s*([bkmg]?)\s*", value.lower())
+    if not m:
+        return None
+    return int(m.group(1)) * _SIZE_SUFFIXES[m.group(2)]
+
+
+def worker_count(
+    host_cpus: int,
+    host_memory: int,
+    container_cpus: Optional[float],
+    container_memory: Optional[int],
+    share: float,
+    max_workers: int,
+    submissions: int,
+) -> int:
+    """
+    Number of submissions to test in parallel, such that the regrade
+    containers use at most `share` of the host's CPUs and memory.
+    Args:
+        container_cpus: CPU quota of each container, None if unlimited.
+        container_memory: Memory limit of each container in bytes, None if
+            unlimited.
+    """
+    # Containers without CPU quota are assumed to keep one CPU busy.
+    by_cpu = math.floor(host_cpus * share / (container_cpus or 1))
+    by_memory = max_workers
+    if container_memory:
+        by_memory = math.floor(host_memory * share / container_memory)
+    return max(1, min(by_cpu, by_memory, max_workers, submissions))
+
+
+@dataclass(frozen=True)
+class _SubmissionSpec:
+    """
+    Everything needed to regrade a submission. Workers only access the DB to
+    store the results, thus all values are resolved when the job is created.
+    """
+
+    submission_id: int
+    image_name: str
+    container_name: str
+    hostname: str
+    # Lower directories of the overlay mounted to /home/user (topmost first),
+    # None if the exercise does not persist /home/user.
+    lower_dirs: Optional[Tuple[str, ...]]
+    scratch_path: str
+    setup_script: str
+    instance_key: bytes
+    config: Dict
+    common_mounts: Dict
+    # `submission_tests` replacing the one of the image, if any.
+    submission_tests: Optional[bytes]
+    timeout_s: int
+
+
+@dataclass
+class SubmissionRegrade:
+    """
+    Progress and outcome of regrading a single submission.
+    """
+
+    submission_id: int
+    user: str
+    # Duration of the tests when the submission was made (ms), if known.
+    expected_ms: Optional[float]
+    old: Dict[str, TaskOutcome]
+    new: Dict[str, TaskOutcome] = field(default_factory=dict)
+    # pending, running, done, failed, or cancelled
+    state: str = "pending"
+    error: Optional[str] = None
+    duration_s: Optional[float] = None
+
+    @property
+    def changes(self) -> List[TaskChange]:
+        if self.state != "done":
+            return []
+        return task_changes(self.old, self.new)
+
+
+def _outcomes(results) -> Dict[str, TaskOutcome]:
+    return {r.task_name: TaskOutcome(r.success, r.score) for r in results}
+
+
+def queue_order(regrades: List[SubmissionRegrade]) -> List[SubmissionRegrade]:
+    """
+    The order the submissions are processed in, longest expected duration
+    first. Submissions whose duration is unknown are processed before all
+    others, since they might be the slowest.
+    """
+    return sorted(
+        regrades,
+        key=lambda r: (
+            r.expected_ms is not None,
+            -(r.expected_ms or 0),
+            r.submission_id,
+        ),
+    )
+
+
+class RegradeJob:
+    """
+    Regrading of the submissions of an exercise. All methods are thread safe.
+    """
+
+    def __init__(
+        self,
+        exercise_id: int,
+        tests_exercise_id: int,
+        apply: bool,
+        regrades: List[SubmissionRegrade],
+        workers: int,
+    ):
+        self.exercise_id = exercise_id
+        self.tests_exercise_id = tests_exercise_id
+        self.apply = apply
+        self.workers = workers
+        self.started_ts = datetime.datetime.now()
+        self.finished_ts: Optional[datetime.datetime] = None
+        self._lock = Lock()
+        self._regrades = {r.submission_id: r for r in regrades}
+        self._cancelled = False
+        self._running_workers = 0
+        # IDs of the containers that are currently used by this job.
+        self._container_ids: Set[str] = set()
+
+    @property
+    def regrades(self) -> List[SubmissionRegrade]:
+        with self._lock:
+            return sorted(self._regrades.values(), key=lambda r: r.submission_id)
+
+    @property
+    def cancelled(self) -> bool:
+        return self._cancelled
+
+    @property
+    def done(self) -> bool:
+        return self.finished_ts is not None
+
+    def cancel(self):
+        """
+        Stop once the submissions that are currently tested are done.
+        """
+        self._cancelled = True
+
+    def counts(self) -> Dict[str, int]:
+        with self._lock:
+            counts = {
+                s: 0 for s in ("pending", "running", "done", "failed", "cancelled")
+            }
+            changed = 0
+            for r in self._regrades.values():
+                counts[r.state] += 1
+                changed += bool(r.changes)
+            counts["total"] = len(self._regrades)
+            counts["changed"] = changed
+            return counts
+
+    def container_ids(self) -> Set[str]:
+        with self._lock:
+            return set(self._container_ids)
+
+    def _update(self, submission_id: int, **kwargs):
+        with self._lock:
+            regrade = self._regrades[submission_id]
+            for k, v in kwargs.items():
+                setattr(regrade, k, v)
+
+    def to_dict(self) -> Dict:
+        counts = self.counts()
+        return {
+            "exercise_id": self.exercise_id,
+            "tests_exercise_id": self.tests_exercise_id,
+            "apply": self.apply,
+            "workers": self.workers,
+            "started_ts": self.started_ts.isoformat(),
+            "finished_ts": self.finished_ts.isoformat() if self.finished_ts else None,
+            "cancelled": self.cancelled,
+            "counts": counts,
+            "submissions": [
+                {
+                    "submission_id": r.submission_id,
+                    "user": r.user,
+                    "state": r.state,
+                    "error": r.error,
+                    "duration_s": r.duration_s,
+                    "changes": [
+                        {
+                            "task_name": c.task_name,
+                            "old": asdict(c.old) if c.old else None,
+                            "new": asdict(c.new) if c.new else None,
+                        }
+                        for c in r.changes
+                    ],
+                }
+                for r in self.regrades
+            ],
+        }
+
+
+# Exercise ID -> most recent job of that exercise.
+_jobs: Dict[int, RegradeJob] = {}
+_jobs_lock = Lock()
+
+
+def get(exercise_id: int) -> Optional[RegradeJob]:
+    with _jobs_lock:
+        return _jobs.get(exercise_id)
+
+
+def active_container_ids() -> Set[str]:
+    """
+    IDs of all containers that are currently used for regrading.
+    """
+    with _jobs_lock:
+        jobs = list(_jobs.values())
+    ids: Set[str] = set()
+    for job in jobs:
+        ids |= job.container_ids()
+    return ids
+
+
+def _host_resources(dc: DockerClient) -> Tuple[int, int]:
+    info = dc.client.info()
+    return info["NCPU"], info["MemTotal"]
+
+
+def start(
+    exercise: Exercise, tests_exercise: Optional[Exercise], apply: bool
+) -> RegradeJob:
+    """
+    Regrade all submissions of `exercise` in the background.
+    Args:
+        tests_exercise: Version of the exercise whose `submission_tests` are
+            used, defaults to `exercise`.
+        apply: Whether the new results replace the stored ones. Otherwise,
+            only the changes are reported.
+    Raises:
+        RegradeError: If the exercise can not be regraded (now).
+    """
+    tests_exercise = tests_exercise or exercise
+    if not exercise.submission_test_enabled:
+        raise RegradeError("The exercise has no submission tests")
+    if tests_exercise.short_name != exercise.short_name:
+        raise RegradeError(
+            "The tests must be taken from a version of the same exercise"
+        )
+    if exercise.services:
+        raise RegradeError("Exercises with peripheral services can not be regraded")
+
+    submission_tests = None
+    if tests_exercise.id != exercise.id:
+        path = Path(tests_exercise.template_path) / "submission_tests"
+        if not path.is_file():
+            raise RegradeError(f"{tests_exercise} has no submission_tests")
+        submission_tests = path.read_bytes()
+
+    with _jobs_lock:
+        job = _jobs.get(exercise.id)
+        if job and not job.done:
+            raise RegradeError("The submissions of the exercise are already regraded")
+
+        submissions: List[Submission] = exercise.submissions()
+        if not submissions:
+            raise RegradeError("The exercise has no submissions")
+
+        specs = {}
+        regrades = []
+        config = InstanceManager._get_container_config_defaults()
+        config |= InstanceManager._get_container_limits_config(
+            exercise.entry_service.ressource_limit
+        )
+        dc = DockerClient()
+        common_mounts = InstanceManager._get_common_mounts(dc)
+        name_prefix = (
+            f"{current_app.config['DOCKER_RESSOURCE_PREFIX']}"
+            f"{exercise.short_name}-v{exercise.version}"
+        )
+        for submission in submissions:
+            instance = submission.submitted_instance
+            mgr = InstanceManager(instance)
+            lower_dirs = None
+            if exercise.entry_service.persistance_container_path:
+                lower_dirs = (
+                    instance.entry_service.overlay_submitted,
+                    exercise.entry_service.persistance_lower,
+                )
+            specs[submission.id] = _SubmissionSpec(
+                submission_id=submission.id,
+                image_name=exercise.entry_service.image_name,
+                container_name=f"{name_prefix}-regrade-{submission.id}",
+                hostname=exercise.short_name,
+                lower_dirs=lower_dirs,
+                scratch_path=f"{instance.persistance_path}/{_SCRATCH_DIR}",
+                setup_script=mgr._entry_setup_script(),
+                instance_key=instance.get_key(),
+                config=config,
+                common_mounts=common_mounts,
+                submission_tests=submission_tests,
+                timeout_s=current_app.config.get("REGRADE_TIMEOUT_S", 1800),
+            )
+            tests_ms = ((submission.timings or {}).get("phases") or {}).get("tests")
+            regrades.append(
+                SubmissionRegrade(
+                    submission_id=submission.id,
+                    user=instance.user.full_name,
+                    expected_ms=tests_ms,
+                    old=_outcomes(submission.submission_test_results),
+                )
+            )
+
+        container_cpus = None
+        if config.get("cpu_quota") and config.get("cpu_period"):
+            container_cpus = config["cpu_quota"] / config["cpu_period"]
+        host_cpus, host_memory = _host_resources(dc)
+        workers = worker_count(
+            host_cpus,
+            host_memory,
+            container_cpus,
+            parse_size(config.get("mem_limit")),
+            current_app.config.get("REGRADE_HOST_SHARE", 0.5),
+            current_app.config.get("REGRADE_MAX_WORKERS", 32),
+            len(regrades),
+        )
+
+        job = RegradeJob(exercise.id, tests_exercise.id, apply, regrades, workers)
+        _jobs[exercise.id] = job
+
+    queue: SimpleQueue = SimpleQueue()
+    for regrade in queue_order(regrades):
+        queue.put(specs[regrade.submission_id])
+
+    log.info(
+        f"Regrading {len(regrades)} submissions of {exercise} with the tests of "
+        f"{tests_exercise} using {workers} workers (apply={apply})"
+    )
+    app = current_app._get_current_object()
+    job._running_workers = workers
+    for i in range(workers):
+        Thread(
+            target=_run_worker,
+            args=(app, job, queue),
+            name=f"regrade-{exercise.id}-{i}",
+            daemon=True,
+        ).start()
+    return job
+
+
+def _run_worker(app: Flask, job: RegradeJob, queue: SimpleQueue):
+    with app.app_context():
+        try:
+            while True:
+                try:
+                    spec: _SubmissionSpec = queue.get_nowait()
+                except Empty:
+                    break
+                if job.cancelled:
+                    job._update(spec.submission_id, state="cancelled")
+                    continue
+                _regrade(job, spec)
+        finally:
+            with job._lock:
+                job._running_workers -= 1
+                if job._running_workers == 0:
+                    job.finished_ts = datetime.datetime.now()
+                    log.info(f"Regrade job of exercise {job.exercise_id} finished")
+
+
+def _regrade(job: RegradeJob, spec: _SubmissionSpec):
+    job._update(spec.submission_id, state="running")
+    started = time.monotonic()
+    try:
+        results = _run_tests(job, spec)
+        if results.get("output_exceeded"):
+            raise RegradeError("The test output exceeded the maximum length")
+        new = {
+            r["task_name"]: TaskOutcome(r["success"], r["score"])
+            for r in results["test_results"]
+        }
+        if job.apply:
+            _store_results(spec.submission_id, results)
+        job._update(
+            spec.submission_id,
+            state="done",
+            new=new,
+            duration_s=round(time.monotonic() - started, 1),
+        )
+    except Exception as e:
+        log.warning(f"Failed to regrade submission {spec.submission_id}", exc_info=True)
+        job._update(
+            spec.submission_id,
+            state="failed",
+            error=str(e) or type(e).__name__,
+            duration_s=round(time.monotonic() - started, 1),
+        )
+
+
+def _mount(spec: _SubmissionSpec) -> Optional[str]:
+    """
+    Mount the overlay of the submission's data, returns its merged directory.
+    """
+    if spec.lower_dirs is None:
+        return None
+    scratch = Path(spec.scratch_path)
+    for name in ("upper", "work", "merged"):
+        (scratch / name).mkdir(parents=True, exist_ok=True)
+    merged = (scratch / "merged").as_posix()
+    options = (
+        f"lowerdir={':'.join(spec.lower_dirs)},"
+        f"upperdir={scratch / 'upper'},workdir={scratch / 'work'}"
+    )
+    cmd = [
+        "sudo",
+        "/bin/mount",
+        "-t",
+        "overlay",
+        "overlay",
+        f"-o{options}",
+        merged,
+    ]
+    subprocess.check_call(cmd)
+    subprocess.check_call(["sudo", "/bin/chown", "9999:9999", merged])
+    return merged
+
+
+def _cleanup(spec: _SubmissionSpec):
+    scratch = Path(spec.scratch_path)
+    merged = scratch / "merged"
+    if os.path.ismount(merged):
+        subprocess.check_call(["sudo", "/bin/umount", merged.as_posix()])
+    if scratch.exists():
+        # Move it out of the way, thus the submission can be regraded again
+        # right away.
+        trash = scratch.with_name(f"{_SCRATCH_DIR}-trash-{secrets.token_hex(6)}")
+        scratch.rename(trash)
+        _purge_in_background(trash)
+
+
+def _run_tests(job: RegradeJob, spec: _SubmissionSpec) -> Dict:
+    dc = DockerClient()
+    container = None
+    # Leftovers of a previous run that crashed.
+    stale = dc.container(spec.container_name)
+    if stale:
+        stale.remove(force=True)
+    _cleanup(spec)
+
+    try:
+        mounts = dict(spec.common_mounts)
+        merged = _mount(spec)
+        if merged:
+            mounts[dc.local_path_to_host(merged)] = {"bind": "/home/user", "mode": "rw"}
+        shared = Path(spec.scratch_path) / "shared"
+        shared.mkdir(parents=True, exist_ok=True)
+        mounts[dc.local_path_to_host(shared.as_posix())] = {
+            "bind": "/shared",
+            "mode": "rw",
+        }
+
+        container = dc.create_container(
+            spec.image_name,
+            name=spec.container_name,
+            network_mode="none",
+            volumes=mounts,
+            hostname=spec.hostname,
+            **spec.config,
+        )
+        with job._lock:
+            job._container_ids.add(container.id)
+
+        InstanceManager._provision_container(
+            dc, container, spec.setup_script, spec.instance_key
+        )
+        if spec.submission_tests is not None:
+            dc.container_add_file(
+                container, "/usr/local/bin/submission_tests", spec.submission_tests
+            )
+
+        results_path = f"/tmp/ref-regrade-{secrets.token_hex(8)}.json"
+        ret = container.exec_run(
+            [
+                "timeout",
+                "-k",
+                str(_KILL_GRACE_S),
+                str(spec.timeout_s),
+                "/usr/local/bin/_task",
+                "submit",
+                "--yes",
+                "--results-path",
+                results_path,
+            ],
+            workdir="/home/user",
+        )
+        # Exit codes of `timeout` if the tests timed out or had to be killed.
+        if ret.exit_code in (124, 137):
+            raise RegradeError(f"The tests did not finish within {spec.timeout_s}s")
+        ret_results = container.exec_run(["cat", results_path])
+        if ret.exit_code != 0 or ret_results.exit_code != 0:
+            log.info(f"Regrading {spec.submission_id} failed: {ret.output[-4096:]!r}")
+            raise RegradeError(f"Running the tests failed (exit code {ret.exit_code})")
+        return json.loads(ret_results.output)
+    finally:
+        if container:
+            container.remove(force=True)
+            with job._lock:
+                job._container_ids.discard(container.id)
+        _cleanup(spec)
+
+
+def _store_results(submission_id: int, results: Dict):
+    """
+    Replace the test results of the submission with `results`.
+    """
+    db = current_app.db
+    try:
+        submission = Submission.get(submission_id)
+        if submission is None:
+            raise RegradeError("The submission was deleted meanwhile")
+        # ! Keep in sync with submission_queue._process()
+        resource_usage = parse_resource_usage(results.get("resource_usage"))
+        for result in list(submission.submission_test_results):
+            db.session.delete(result)
+        test_results = []
+        for r in results["test_results"]:
+            result = SubmissionTestResult(
+                r["task_name"], results["output"], r["success"], r["score"]
+            )
+            result.resource_usage = resource_usage.get(r["task_name"])
+            test_results.append(result)
+        submission.submission_test_results = test_results
+        db.session.commit()
+    except Exception:
+        db.session.rollback()
+        raise
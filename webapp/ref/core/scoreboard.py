@@ -0,0 +1,141 @@
+"""Materialized scoreboard.
+
+Computing the scoreboard requires scoring every submission, and the SPA
+polls it every few seconds. Thus, the result is kept in memory and only
+updated when something changed: new submissions are merged into it, any
+other change that might affect it (e.g., an edited scoring policy or a
+deleted submission) drops it, and it is rebuilt on the next request.
+
+Every state of the scoreboard is identified by an ETag, thus clients that
+already have the current state get a 304 without the scoreboard being
+serialized again.
+
+The state is kept in memory of the webapp process (see the process model
+in docs/ARCHITECTURE.md).
+"""
+
+from __future__ import annotations
+
+import secrets
+from threading import Lock
+from typing import Callable, Dict, Iterable, List, Optional, Tuple
+
+# challenge short name -> team -> entries sorted by "ts"
+Scores = Dict[str, Dict[str, List[dict]]]
+
+# (challenge short name, team, entry)
+ScoreRow = Tuple[str, str, dict]
+
+
+def merge_rows(scores: Scores, rows: Iterable[ScoreRow]) -> Scores:
+    """
+    Add the given rows to `scores` and keep the entries of each team sorted.
+    """
+    touched = []
+    for short_name, team, entry in rows:
+        entries = scores.setdefault(short_name, {}).setdefault(team, [])
+        entries.append(entry)
+        touched.append(entries)
+    for entries in touched:
+        entries.sort(key=lambda e: e["ts"])
+    return scores
+
+
+class Scoreboard:
+    """
+    One state of the scoreboard.
+    """
+
+    def __init__(self, scores: Scores, etag: str):
+        self.scores = scores
+        self.etag = etag
+        self._body: Optional[str] = None
+
+    def body(self, dumps: Callable[[Scores], str]) -> str:
+        """
+        The serialized scoreboard, computed once per state.
+        """
+        if self._body is None:
+            self._body = dumps(self.scores)
+        return self._body
+
+
+class ScoreboardCache:
+    """
+    Materialized scoreboards, keyed by an arbitrary hashable (e.g., whether
+    admin submissions are included).
+    """
+
+    def __init__(self):
+        self._lock = Lock()
+        # Distinguishes the ETags of different processes and restarts.
+        self._token = secrets.token_hex(4)
+        self._generation = 0
+        self._boards: Dict[object, Scoreboard] = {}
+        # IDs of submissions that are not yet merged into the respective board.
+        self._pending: Dict[object, List[int]] = {}
+
+    def invalidate(self):
+        """
+        Drop all boards, they are rebuilt on the next request.
+        """
+        with self._lock:
+            self._generation += 1
+            self._boards.clear()
+            self._pending.clear()
+
+    def add_submissions(self, ids: Iterable[int]):
+        """
+        Mark the given (committed) submissions to be merged into all boards.
+        """
+        ids = list(ids)
+        if not ids:
+            return
+        with self._lock:
+            self._generation += 1
+            for key in self._boards:
+                self._pending.setdefault(key, []).extend(ids)
+
+    def get(
+        self,
+        key,
+        build: Callable[[], Scores],
+        load: Callable[[List[int]], Iterable[ScoreRow]],
+    ) -> Scoreboard:
+        """
+        Returns the current board for `key`. If there is none, it is created
+        via `build()`. Pending submissions are merged via `load(ids)`, which
+        returns the rows of the given submissions.
+        """
+        with self._lock:
+            generation = self._generation
+            board = self._boards.get(key)
+            pending = self._pending.pop(key, [])
+
+        if board is None:
+            scores = build()
+        elif pending:
+            # Boards are never modified in place, thus a board that was already
+            # handed out stays consistent with its ETag.
+            scores = {
+                short_name: {team: list(entries) for team, entries in teams.items()}
+                for short_name, teams in board.scores.items()
+            }
+            try:
+                merge_rows(scores, load(pending))
+            except Exception:
+                # The pending IDs are gone, thus the board can not be updated anymore.
+                self.invalidate()
+                raise
+        else:
+            return board
+
+        new_board = Scoreboard(scores, f"{self._token}-{generation}")
+        with self._lock:
+            # Changes that happened meanwhile might be missing from the board.
+            if self._generation == generation:
+                self._boards[key] = new_board
+            elif board is not None and self._boards.get(key) is board:
+                # The stored board still lacks the merged submissions.
+                self._pending[key] = pending + self._pending.get(key, [])
+        return new_board
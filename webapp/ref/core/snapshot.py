@@ -0,0 +1,393 @@
+"""Content-addressed snapshots of instance directories.
+
+Submitting an instance freezes its overlay upper dir into the
+`overlay_submitted` dir of the submitted instance, which is afterwards
+only used as a read-only overlay lower dir. Instead of copying every file
+for every submission, regular files are stored once in an object store and
+hardlinked into each snapshot. Since hardlinks share their inode, objects
+are keyed by the file's content *and* metadata (mode, owner, mtime,
+xattrs). Objects with the same content but different metadata are created
+as reflinks of each other if the filesystem supports it, such that their
+data is still stored only once.
+
+A stat cache kept next to the snapshotted directory avoids rehashing files
+that did not change since the previous snapshot. Thus, taking a snapshot
+costs roughly the size of the changes made since then.
+
+Objects are garbage once the store holds their only link (`st_nlink == 1`).
+Snapshots record the objects they use in a manifest. Its keys are passed to
+`SnapshotStore.release()` after the snapshot was deleted. Objects that were
+not released (e.g., since deleting the snapshot failed halfway) are dropped
+by `SnapshotStore.collect_garbage()`, which is run via the system garbage
+collector view.
+
+All functions must be run as root, since ownership and trusted.* xattrs
+(used by overlayfs) must be preserved.
+"""
+
+from __future__ import annotations
+
+import errno
+import fcntl
+import hashlib
+import json
+import os
+import shutil
+import stat
+import time
+import uuid
+from dataclasses import dataclass
+from pathlib import Path
+from typing import Dict, Iterable, List, Optional, Tuple
+
+from ref.core.logging import get_logger
+
+log = get_logger(__name__)
+
+# ioctl number of FICLONE (see linux/fs.h).
+_FICLONE = 0x40049409
+
+_HASH_CHUNK_SIZE = 1024 * 1024
+
+# Temporary files younger than this might belong to an object that is being
+# created, thus collect_garbage() keeps them.
+_TMP_MIN_AGE_S = 60 * 60
+
+
+@dataclass
+class SnapshotStats:
+    files: int = 0
+    # Files whose key was taken from the stat cache.
+    cached: int = 0
+    # Files that required a new object.
+    new_objects: int = 0
+    new_bytes: int = 0
+
+
+def _read_xattrs(path: Path) -> List[Tuple[str, bytes]]:
+    try:
+        names = os.listxattr(path, follow_symlinks=False)
+    except OSError as e:
+        if e.errno in (errno.ENOTSUP, errno.EPERM):
+            return []
+        raise
+    return sorted(
+        (name, os.getxattr(path, name, follow_symlinks=False)) for name in names
+    )
+
+
+def _apply_metadata(path: Path, st: os.stat_result, xattrs) -> None:
+    """Apply owner, mode, xattrs, and timestamps of `st` to `path`."""
+    is_link = stat.S_ISLNK(st.st_mode)
+    os.chown(path, st.st_uid, st.st_gid, follow_symlinks=False)
+    if not is_link:
+        os.chmod(path, stat.S_IMODE(st.st_mode))
+    for name, value in xattrs:
+        try:
+            os.setxattr(path, name, value, follow_symlinks=False)
+        except OSError as e:
+            # Symlinks only support a subset of xattr namespaces.
+            if not is_link or e.errno not in (errno.ENOTSUP, errno.EPERM):
+                raise
+    os.utime(
+        path,
+        ns=(st.st_mtime_ns, st.st_mtime_ns),
+        follow_symlinks=False,
+    )
+
+
+def clone_file(src: Path, dst: Path) -> None:
+    """
+    Create `dst` with the content of `src`. Uses a reflink if supported
+    by the filesystem and falls back to copying otherwise.
+    """
+    with open(src, "rb") as fsrc, open(dst, "xb") as fdst:
+        try:
+            fcntl.ioctl(fdst.fileno(), _FICLONE, fsrc.fileno())
+            return
+        except OSError as e:
+            if e.errno not in (
+                errno.EOPNOTSUPP,
+                errno.ENOTTY,
+                errno.EXDEV,
+                errno.EINVAL,
+                errno.ENOSYS,
+            ):
+                raise
+        shutil.copyfileobj(fsrc, fdst, _HASH_CHUNK_SIZE)
+
+
+def _hash_file(path: Path) -> str:
+    h = hashlib.sha256()
+    with open(path, "rb") as f:
+        while chunk := f.read(_HASH_CHUNK_SIZE):
+            h.update(chunk)
+    return h.hexdigest()
+
+
+def _walk(root: Path) -> Iterable[Tuple[Path, os.stat_result]]:
+    """
+    Yield (relative path, lstat) for all entries below `root`. Directories
+    are yielded before their content.
+    """
+    stack = [Path("")]
+    while stack:
+        rel = stack.pop()
+        with os.scandir(root / rel) as it:
+            entries = sorted(it, key=lambda e: e.name)
+        for entry in entries:
+            st = entry.stat(follow_symlinks=False)
+            if stat.S_ISDIR(st.st_mode):
+                stack.append(rel / entry.name)
+            yield rel / entry.name, st
+
+
+class SnapshotStore:
+    """
+    Object store shared by all snapshots. Must be located on the same
+    filesystem as the snapshots, since these hardlink the objects.
+    """
+
+    def __init__(self, root: Path):
+        self.root = Path(root)
+        self._objects = self.root / "objects"
+        # Symlinks from content hashes to an object with that content, used
+        # as reflink source for objects differing only in their metadata.
+        self._content = self.root / "content"
+        self._tmp = self.root / "tmp"
+
+    def _ensure_dirs(self) -> None:
+        for d in (self._objects, self._content, self._tmp):
+            d.mkdir(mode=0o700, parents=True, exist_ok=True)
+
+    def _object_path(self, key: str) -> Path:
+        return self._objects / key[:2] / key
+
+    def _content_path(self, content_hash: str) -> Path:
+        return self._content / content_hash[:2] / content_hash
+
+    @staticmethod
+    def _object_key(content_hash: str, st: os.stat_result, xattrs) -> str:
+        meta = json.dumps(
+            [
+                content_hash,
+                stat.S_IMODE(st.st_mode),
+                st.st_uid,
+                st.st_gid,
+                st.st_mtime_ns,
+                [(name, value.hex()) for name, value in xattrs],
+            ]
+        )
+        return hashlib.sha256(meta.encode()).hexdigest()
+
+    def _create_object(
+        self, src: Path, key: str, content_hash: str, st: os.stat_result, xattrs
+    ) -> Path:
+        obj = self._object_path(key)
+        obj.parent.mkdir(mode=0o700, exist_ok=True)
+
+        content_link = self._content_path(content_hash)
+        clone_src = content_link if content_link.exists() else src
+
+        tmp = self._tmp / uuid.uuid4().hex
+        try:
+            clone_file(clone_src, tmp)
+            _apply_metadata(tmp, st, xattrs)
+            try:
+                os.link(tmp, obj)
+            except FileExistsError:
+                pass
+        finally:
+            tmp.unlink(missing_ok=True)
+
+        content_link.parent.mkdir(mode=0o700, exist_ok=True)
+        if not content_link.exists():
+            content_link.unlink(missing_ok=True)
+            try:
+                content_link.symlink_to(obj)
+            except FileExistsError:
+                pass
+        return obj
+
+    def snapshot(
+        self, src: Path, dst: Path, manifest: Path, stat_cache: Optional[Path] = None
+    ) -> SnapshotStats:
+        """
+        Recreate the directory tree `src` in the (empty or non-existing) `dst`,
+        with regular files being hardlinks into the store. `dst` must be
+        treated as read-only afterwards. The keys of all used objects are
+        written to `manifest`. If `stat_cache` is given, it is used to skip
+        hashing files of `src` that did not change since the last snapshot
+        that used the same cache.
+        """
+        self._ensure_dirs()
+        src = Path(src)
+        dst = Path(dst)
+        dst.mkdir(parents=True, exist_ok=True)
+
+        cache: Dict[str, list] = {}
+        if stat_cache is not None:
+            try:
+                cache = json.loads(stat_cache.read_text())
+            except FileNotFoundError:
+                pass
+            except (OSError, ValueError):
+                log.warning(f"Ignoring invalid stat cache {stat_cache}", exc_info=True)
+        new_cache: Dict[str, list] = {}
+
+        stats = SnapshotStats()
+        keys = set()
+        dirs: List[Tuple[Path, os.stat_result, list]] = []
+
+        for rel, st in _walk(src):
+            src_path = src / rel
+            dst_path = dst / rel
+            mode = st.st_mode
+
+            if stat.S_ISDIR(mode):
+                dst_path.mkdir()
+                # Metadata (mtime) is applied once the directory is populated.
+                dirs.append((dst_path, st, _read_xattrs(src_path)))
+                continue
+
+            if stat.S_ISLNK(mode):
+                os.symlink(os.readlink(src_path), dst_path)
+                _apply_metadata(dst_path, st, _read_xattrs(src_path))
+                continue
+
+            if not stat.S_ISREG(mode):
+                # Devices (e.g., overlayfs whiteouts), FIFOs, and sockets.
+                os.mknod(dst_path, mode, st.st_rdev)
+                _apply_metadata(dst_path, st, _read_xattrs(src_path))
+                continue
+
+            stats.files += 1
+            fingerprint = [st.st_ino, st.st_size, st.st_mtime_ns, st.st_ctime_ns]
+            cached = cache.get(str(rel))
+            key = None
+            if cached and cached[:4] == fingerprint:
+                key = cached[4]
+                stats.cached += 1
+
+            while True:
+                if key is None:
+                    xattrs = _read_xattrs(src_path)
+                    content_hash = _hash_file(src_path)
+                    key = self._object_key(content_hash, st, xattrs)
+                    obj = self._object_path(key)
+                    if not obj.exists():
+                        self._create_object(src_path, key, content_hash, st, xattrs)
+                        stats.new_objects += 1
+                        stats.new_bytes += st.st_size
+                try:
+                    os.link(self._object_path(key), dst_path)
+                    break
+                except FileNotFoundError:
+                    # Released concurrently (or stale cache entry), recreate it.
+                    key = None
+
+            keys.add(key)
+            new_cache[str(rel)] = fingerprint + [key]
+
+        for dst_path, st, xattrs in reversed(dirs):
+            _apply_metadata(dst_path, st, xattrs)
+        src_st = src.stat()
+        _apply_metadata(dst, src_st, _read_xattrs(src))
+
+        manifest.write_text(json.dumps(sorted(keys)))
+        if stat_cache is not None:
+            tmp = stat_cache.with_name(f".{stat_cache.name}.tmp")
+            tmp.write_text(json.dumps(new_cache))
+            os.replace(tmp, stat_cache)
+
+        log.info(f"Snapshot of {src} to {dst}: {stats}")
+        return stats
+
+    def _release_object(self, key: str) -> bool:
+        # Dangling content links are replaced on demand (see _create_object())
+        # and swept by collect_garbage().
+        obj = self._object_path(key)
+        try:
+            if obj.stat().st_nlink != 1:
+                return False
+            obj.unlink()
+        except FileNotFoundError:
+            return False
+        return True
+
+    @staticmethod
+    def read_manifest(manifest: Path) -> List[str]:
+        """Return the object keys recorded in `manifest`, if it exists."""
+        try:
+            return json.loads(Path(manifest).read_text())
+        except FileNotFoundError:
+            return []
+
+    def release(self, keys: Iterable[str]) -> None:
+        """
+        Drop all objects in `keys` that are not used by any snapshot anymore.
+        Must be called after the snapshot that used them was deleted.
+        """
+        for key in keys:
+            self._release_object(key)
+
+    def collect_garbage(self) -> int:
+        """
+        Drop all objects not used by any snapshot, e.g., after snapshots
+        were deleted without calling release(). Returns the number of
+        dropped objects.
+        """
+        if not self._objects.is_dir():
+            return 0
+        dropped = 0
+        for bucket in self._objects.iterdir():
+            for obj in bucket.iterdir():
+                dropped += self._release_object(obj.name)
+        for bucket in self._content.iterdir():
+            for link in bucket.iterdir():
+                if not link.exists():
+                    link.unlink(missing_ok=True)
+        min_mtime = time.time() - _TMP_MIN_AGE_S
+        for tmp in self._tmp.iterdir():
+            try:
+                if tmp.lstat().st_mtime < min_mtime:
+                    tmp.unlink()
+            except FileNotFoundError:
+                pass
+        return dropped
+
+
+def copy_tree(src: Path, dst: Path) -> None:
+    """
+    Copy the directory tree `src` into `dst`, preserving ownership, modes,
+    timestamps and xattrs. Regular files are reflinked where supported, so
+    copying costs roughly nothing on filesystems like btrfs or XFS.
+    Unlike snapshots, the copy is independent and may be modified.
+    Device files (i.e., overlayfs whiteouts), FIFOs, and sockets are skipped.
+    """
+    src = Path(src)
+    dst = Path(dst)
+    dst.mkdir(parents=True, exist_ok=True)
+    dirs = []
+    for rel, st in _walk(src):
+        src_path = src / rel
+        dst_path = dst / rel
+        mode = st.st_mode
+        if stat.S_ISDIR(mode):
+            dst_path.mkdir(exist_ok=True)
+            dirs.append((dst_path, st, _read_xattrs(src_path)))
+            continue
+        if not stat.S_ISLNK(mode) and not stat.S_ISREG(mode):
+            continue
+        if dst_path.is_symlink() or dst_path.exists():
+            if dst_path.is_dir() and not dst_path.is_symlink():
+                shutil.rmtree(dst_path)
+            else:
+                dst_path.unlink()
+        if stat.S_ISLNK(mode):
+            os.symlink(os.readlink(src_path), dst_path)
+        else:
+            clone_file(src_path, dst_path)
+        _apply_metadata(dst_path, st, _read_xattrs(src_path))
+    for dst_path, st, xattrs in reversed(dirs):
+        _apply_metadata(dst_path, st, xattrs)
@@ -0,0 +1,217 @@
+"""Queue of submission requests.
+
+Creating a submission takes a while (a new instance is created), thus
+`task submit` requests only record the request as a SubmissionTicket and
+return. The tickets are turned into submissions by a bounded number of
+worker threads, while `task submit` polls the ticket's state.
+
+Accepting a request only inserts its ticket, the instance's data is
+snapshotted once a worker processes the ticket, and the container is only
+paused while the snapshot is taken. The submission is dated by the time the
+request was accepted, since that is the time the deadline was checked.
+
+Tickets are stored in the DB, thus pending requests survive restarts of the
+webapp and are processed once it is up again.
+"""
+
+import datetime
+import os
+import time
+from threading import Condition, Thread
+from typing import Dict, List, Optional, Set
+
+from flask import Flask, current_app
+
+from ref.core.logging import get_logger
+from ref.model import (
+    Instance,
+    SubmissionTestResult,
+    SubmissionTicket,
+    SubmissionTicketState,
+)
+
+from .instance import InstanceManager
+
+log = get_logger(__name__)
+
+# Time after which idle workers check the DB for tickets, in case a ticket
+# was created by another process.
+_POLL_INTERVAL_S = 30
+
+_cond = Condition()
+# Incremented by notify(), thus workers do not miss notifications that happen
+# while they are querying the DB.
+_generation = 0
+# PID of the process the workers were started in.
+_started_pid: Optional[int] = None
+# IDs of the tickets that are currently processed.
+_in_flight: Set[int] = set()
+
+
+def enqueue(
+    instance: Instance, payload: Dict, timings: Optional[Dict]
+) -> SubmissionTicket:
+    """
+    Record a submission request for `instance`. The caller must commit, and
+    call notify() afterwards.
+    Args:
+        payload: The test results and output sent by the container (user controlled!).
+        timings: Timings of the request (see ref/core/timing.py).
+    """
+    ticket = SubmissionTicket()
+    ticket.instance = instance
+    ticket.accepted_ts = datetime.datetime.now()
+    ticket.state = SubmissionTicketState.PENDING
+    ticket.payload = payload
+    ticket.timings = timings
+    current_app.db.session.add(ticket)
+    return ticket
+
+
+def pending_ticket(instance: Instance) -> Optional[SubmissionTicket]:
+    return SubmissionTicket.query.filter(
+        SubmissionTicket.instance_id == instance.id,
+        SubmissionTicket.state == SubmissionTicketState.PENDING,
+    ).first()
+
+
+def notify(app: Flask):
+    """
+    Wake up a worker, the workers are started if they are not running yet.
+    """
+    global _generation
+
+    start(app)
+    with _cond:
+        _generation += 1
+        _cond.notify()
+
+
+def start(app: Flask):
+    """
+    Start the workers, if they are not running in this process yet.
+    """
+    global _started_pid
+
+    with _cond:
+        if _started_pid == os.getpid():
+            return
+        # Threads do not survive forking.
+        _started_pid = os.getpid()
+        _in_flight.clear()
+        for i in range(app.config.get("SUBMISSION_QUEUE_WORKERS", 1)):
+            Thread(
+                target=_run_worker,
+                args=(app,),
+                name=f"submission-queue-{i}",
+                daemon=True,
+            ).start()
+
+
+def _claim(ids: List[int]) -> Optional[int]:
+    with _cond:
+        for id_ in ids:
+            if id_ not in _in_flight:
+                _in_flight.add(id_)
+                return id_
+    return None
+
+
+def _pending_ticket_ids() -> List[int]:
+    try:
+        return [
+            id_
+            for (id_,) in current_app.db.session.query(SubmissionTicket.id)
+            .filter(SubmissionTicket.state == SubmissionTicketState.PENDING)
+            .order_by(SubmissionTicket.id)
+        ]
+    except Exception:
+        log.error("Failed to query pending submission tickets", exc_info=True)
+        return []
+    finally:
+        # Release the DB lock.
+        current_app.db.session.rollback()
+
+
+def _run_worker(app: Flask):
+    with app.app_context():
+        while True:
+            with _cond:
+                generation = _generation
+            ticket_id = _claim(_pending_ticket_ids())
+            if ticket_id is None:
+                with _cond:
+                    if generation == _generation:
+                        _cond.wait(_POLL_INTERVAL_S)
+                continue
+
+            try:
+                _process(ticket_id)
+            finally:
+                with _cond:
+                    _in_flight.discard(ticket_id)
+
+
+def _process(ticket_id: int):
+    db = current_app.db
+    started_ns = time.monotonic_ns()
+    ticket = SubmissionTicket.get(ticket_id)
+    if ticket is None or ticket.state != SubmissionTicketState.PENDING:
+        db.session.rollback()
+        return
+
+    instance = ticket.instance
+    queued_ms = (datetime.datetime.now() - ticket.accepted_ts).total_seconds() * 1000
+    # Persisted data of the submitted instance, removed if committing fails.
+    new_persistance = None
+    try:
+        # ! Keep in sync with api_instance_submit
+        output = ticket.payload["output"]
+        # Missing in tickets that were created before resources were accounted.
+        resource_usage = ticket.payload.get("resource_usage") or {}
+        test_results = []
+        for r in ticket.payload["test_results"]:
+            result = SubmissionTestResult(
+                r["task_name"], output, r["success"], r["score"]
+            )
+            result.resource_usage = resource_usage.get(r["task_name"])
+            test_results.append(result)
+        timings = {
+            "phases": dict((ticket.timings or {}).get("phases", {})),
+            "tasks": dict((ticket.timings or {}).get("tasks", {})),
+        }
+        timings["phases"]["queue"] = round(queued_ms, 3)
+        new_instance = InstanceManager(instance).create_submission(
+            test_results, phases=timings["phases"]
+        )
+        new_persistance = InstanceManager(new_instance).persistance_paths()
+        timings["phases"]["create"] = round(
+            (time.monotonic_ns() - started_ns) / 1e6, 3
+        )
+        submission = new_instance.submission
+        submission.submission_ts = ticket.accepted_ts
+        submission.timings = timings
+
+        ticket.state = SubmissionTicketState.DONE
+        ticket.submission = submission
+        db.session.commit()
+        log.info(f"Created submission {submission} for {ticket}")
+    except Exception:
+        log.error(f"Failed to create submission of ticket {ticket_id}", exc_info=True)
+        db.session.rollback()
+        if new_persistance is not None:
+            try:
+                InstanceManager.remove_persistance(*new_persistance)
+            except Exception:
+                log.error(
+                    f"Failed to remove the submitted data of ticket {ticket_id}",
+                    exc_info=True,
+                )
+        try:
+            ticket = SubmissionTicket.get(ticket_id)
+            if ticket is not None:
+                ticket.state = SubmissionTicketState.FAILED
+            db.session.commit()
+        except Exception:
+            log.error(f"Failed to mark ticket {ticket_id} as failed", exc_info=True)
+            db.session.rollback()
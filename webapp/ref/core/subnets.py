@@ -0,0 +1,164 @@
+"""Persistent allocator for the subnets of instance networks.
+
+Each subnet of the instance network pool is represented by one bit of a
+bitmap that is stored in a file. The file is locked via flock() while it is
+used, thus allocations are serialized across threads and processes. The
+bitmap is only reconciled with the networks that actually exist in Docker
+at startup and during garbage collection, such that allocating a subnet
+does not require to list all networks.
+
+File layout: a 4 byte little-endian cursor (index of the subnet after the
+last allocated one), followed by the bitmap.
+"""
+
+from __future__ import annotations
+
+import contextlib
+import fcntl
+import ipaddress
+import os
+import struct
+from pathlib import Path
+from typing import Iterable, Iterator, Optional
+
+from ref.core.logging import get_logger
+
+log = get_logger(__name__)
+
+_CURSOR = struct.Struct("<I")
+
+
+class _SubnetBitmap:
+    """
+    In-memory view of the bitmap that is handed out by SubnetAllocator.locked().
+    """
+
+    def __init__(self, pool: ipaddress.IPv4Network, prefix: int, data: bytes):
+        self.pool = pool
+        self.prefix = prefix
+        self.count = 1 << (prefix - pool.prefixlen)
+        size = (self.count + 7) // 8
+
+        if len(data) == _CURSOR.size + size:
+            (self.cursor,) = _CURSOR.unpack_from(data)
+            self.bits = bytearray(data[_CURSOR.size :])
+        else:
+            if data:
+                log.warning("Subnet bitmap has unexpected size, starting empty")
+            self.cursor = 0
+            self.bits = bytearray(size)
+        self.cursor %= self.count
+        self.dirty = False
+
+    def serialize(self) -> bytes:
+        return _CURSOR.pack(self.cursor) + bytes(self.bits)
+
+    def _subnet(self, index: int) -> ipaddress.IPv4Network:
+        address = int(self.pool.network_address) + (index << (32 - self.prefix))
+        return ipaddress.IPv4Network((address, self.prefix))
+
+    def _index(self, subnet: ipaddress.IPv4Network) -> int:
+        return (int(subnet.network_address) - int(self.pool.network_address)) >> (
+            32 - self.prefix
+        )
+
+    def _is_set(self, index: int) -> bool:
+        return bool(self.bits[index >> 3] & (1 << (index & 7)))
+
+    def _set(self, index: int):
+        self.bits[index >> 3] |= 1 << (index & 7)
+        self.dirty = True
+
+    def _clear(self, index: int):
+        self.bits[index >> 3] &= ~(1 << (index & 7)) & 0xFF
+        self.dirty = True
+
+    def _overlapping(self, network: ipaddress.IPv4Network) -> range:
+        """
+        Returns the indices of all subnets of the pool that overlap with network.
+        """
+        if not network.overlaps(self.pool):
+            return range(0)
+        first = max(int(network.network_address), int(self.pool.network_address))
+        last = min(int(network.broadcast_address), int(self.pool.broadcast_address))
+        base = int(self.pool.network_address)
+        shift = 32 - self.prefix
+        return range((first - base) >> shift, ((last - base) >> shift) + 1)
+
+    def allocate(self) -> Optional[ipaddress.IPv4Network]:
+        """
+        Allocate the next free subnet after the cursor.
+        Returns:
+            The subnet, or None if the pool is exhausted.
+        """
+        byte_count = len(self.bits)
+        start = self.cursor >> 3
+        for i in range(byte_count + 1):
+            byte_idx = (start + i) % byte_count
+            if self.bits[byte_idx] == 0xFF:
+                continue
+            for bit in range(8):
+                index = (byte_idx << 3) | bit
+                if index >= self.count or self._is_set(index):
+                    continue
+                # Skip subnets before the cursor on the first byte, thus freed subnets
+                # are not immediately reused.
+                if i == 0 and index < self.cursor:
+                    continue
+                self._set(index)
+                self.cursor = (index + 1) % self.count
+                return self._subnet(index)
+        return None
+
+    def mark_used(self, network: ipaddress.IPv4Network):
+        for index in self._overlapping(network):
+            self._set(index)
+
+    def free(self, network: ipaddress.IPv4Network):
+        if network.prefixlen != self.prefix or not network.subnet_of(self.pool):
+            return
+        self._clear(self._index(network))
+
+    def reconcile(self, used: Iterable[ipaddress.IPv4Network]):
+        """
+        Replace the bitmap by the given set of used networks.
+        """
+        self.bits = bytearray(len(self.bits))
+        self.dirty = True
+        for network in used:
+            self.mark_used(network)
+
+
+class SubnetAllocator:
+    """
+    Allocates subnets of `prefix` length from `pool` and persists the
+    allocation state at `path`.
+    """
+
+    def __init__(self, path: Path, pool: ipaddress.IPv4Network, prefix: int):
+        assert prefix >= pool.prefixlen
+        self.path = Path(path)
+        self.pool = pool
+        self.prefix = prefix
+
+    @contextlib.contextmanager
+    def locked(self) -> Iterator[_SubnetBitmap]:
+        """
+        Lock the bitmap and yield it. Modifications are written back once the
+        context is left (also if an exception was raised).
+        """
+        self.path.parent.mkdir(parents=True, exist_ok=True)
+        fd = os.open(self.path, os.O_RDWR | os.O_CREAT, 0o600)
+        try:
+            fcntl.flock(fd, fcntl.LOCK_EX)
+            size = os.fstat(fd).st_size
+            bitmap = _SubnetBitmap(self.pool, self.prefix, os.pread(fd, size, 0))
+            try:
+                yield bitmap
+            finally:
+                if bitmap.dirty:
+                    data = bitmap.serialize()
+                    os.pwrite(fd, data, 0)
+                    os.ftruncate(fd, len(data))
+        finally:
+            os.close(fd)
@@ -0,0 +1,232 @@
+"""Timings of the phases of `task submit`.
+
+`_task` sends the duration of each phase it went through (see `_Timings` in
+ref-docker-base/task.py) in the X-REF-Timings header of a submission. The
+webapp adds the phases it observes itself, stores the result with the
+submission (see ref.core.submission_queue), and aggregates the stored timings into one histogram per phase
+for the operator view.
+
+Stored format (all durations in milliseconds)::
+
+    {"phases": {"<phase>": float, ...}, "tasks": {"<task>": float, ...}}
+
+The header is not covered by the request's signature. This is fine, since it
+is only accepted along with a validly signed submission and its values are
+only used for diagnostics.
+
+Submissions also contain the resources used by each task (see
+parse_resource_usage()), which are stored with the task's test result.
+"""
+
+from __future__ import annotations
+
+import json
+import math
+from dataclasses import dataclass, field
+from typing import Dict, Iterable, List, Optional, Tuple
+
+# ! Keep in sync with ref-docker-base/task.py
+TIMINGS_HEADER = "X-REF-Timings"
+
+# Phases in the order they happen, with a description for the operator view.
+PHASES: Dict[str, str] = {
+    "wrapper_env": "Environment snapshot in task-wrapper",
+    "launch": "sudo and Python startup, or forking by the task server",
+    "load_tests": "Importing submission_tests",
+    "tests": "Running the tests",
+    "sign": "Serializing, compressing, and signing the request",
+    "upload": "Request transfer via the SSH reverse proxy",
+    "handling": "Processing of the request by the webapp",
+    "queue": "Wait in the submission queue",
+    "snapshot": "Snapshot of the instance's data",
+    "create": "Creating the submission, including the snapshot",
+}
+
+# Phases that are measured by the client.
+_CLIENT_PHASES = ("wrapper_env", "launch", "load_tests", "tests", "sign")
+
+_MAX_TASKS = 256
+_MAX_TASK_NAME_LENGTH = 128
+# Anything longer is considered bogus.
+_MAX_DURATION_NS = 24 * 3600 * 10**9
+
+# Upper bounds (ms) of the histogram buckets, the last bucket is unbounded.
+BUCKET_BOUNDS_MS: Tuple[float, ...] = tuple(float(2**i) for i in range(0, 18))
+
+
+def _ns_to_ms(value) -> Optional[float]:
+    if isinstance(value, bool) or not isinstance(value, int):
+        return None
+    if not 0 <= value <= _MAX_DURATION_NS:
+        return None
+    return round(value / 1e6, 3)
+
+
+def parse_client_timings(raw: Optional[str], received_ns: int) -> Dict[str, Dict]:
+    """
+    Parse the timings header sent by `_task`. Invalid values are dropped.
+    Args:
+        raw: The header value, if any.
+        received_ns: CLOCK_MONOTONIC timestamp the request was received at,
+            used to compute the "upload" phase.
+    Returns:
+        Timings in the stored format.
+    """
+    timings: Dict[str, Dict] = {"phases": {}, "tasks": {}}
+    if not raw:
+        return timings
+    try:
+        data = json.loads(raw)
+    except ValueError:
+        return timings
+    if not isinstance(data, dict):
+        return timings
+
+    phases = data.get("phases")
+    if isinstance(phases, dict):
+        for name in _CLIENT_PHASES:
+            ms = _ns_to_ms(phases.get(name))
+            if ms is not None:
+                timings["phases"][name] = ms
+
+    tasks = data.get("tasks")
+    if isinstance(tasks, dict):
+        for name, value in list(tasks.items())[:_MAX_TASKS]:
+            if not isinstance(name, str) or len(name) > _MAX_TASK_NAME_LENGTH:
+                continue
+            ms = _ns_to_ms(value)
+            if ms is not None:
+                timings["tasks"][name] = ms
+
+    # All containers share the host's monotonic clock.
+    sent_ns = data.get("sent_ns")
+    if isinstance(sent_ns, int) and not isinstance(sent_ns, bool):
+        ms = _ns_to_ms(received_ns - sent_ns)
+        if ms is not None:
+            timings["phases"]["upload"] = ms
+
+    return timings
+
+
+# ! Keep in sync with _task_resource_usage() in ref-docker-base/task.py
+_RESOURCE_DURATIONS = ("cpu_ms", "wall_ms")
+_RESOURCE_COUNTERS = ("max_rss_kb", "read_bytes", "write_bytes")
+_MAX_COUNTER = 2**53
+_MAX_LIMIT_DESCRIPTION_LENGTH = 128
+
+
+def parse_resource_usage(raw) -> Dict[str, Dict]:
+    """
+    Parse the resources used by each task, as sent along with a submission.
+    Invalid values are dropped.
+    Returns:
+        Task name -> {"cpu_ms": float, "wall_ms": float, "max_rss_kb": int,
+        "read_bytes": int, "write_bytes": int, "exceeded_limit": str}, each
+        value is optional.
+    """
+    usage: Dict[str, Dict] = {}
+    if not isinstance(raw, dict):
+        return usage
+
+    for name, values in list(raw.items())[:_MAX_TASKS]:
+        if not isinstance(name, str) or len(name) > _MAX_TASK_NAME_LENGTH:
+            continue
+        if not isinstance(values, dict):
+            continue
+        task_usage: Dict = {}
+        for key in _RESOURCE_DURATIONS:
+            value = values.get(key)
+            if (
+                isinstance(value, (int, float))
+                and not isinstance(value, bool)
+                and 0 <= value <= _MAX_DURATION_NS / 1e6
+            ):
+                task_usage[key] = round(float(value), 3)
+        for key in _RESOURCE_COUNTERS:
+            value = values.get(key)
+            if (
+                isinstance(value, int)
+                and not isinstance(value, bool)
+                and 0 <= value <= _MAX_COUNTER
+            ):
+                task_usage[key] = value
+        exceeded = values.get("exceeded_limit")
+        if isinstance(exceeded, str) and exceeded:
+            task_usage["exceeded_limit"] = exceeded[:_MAX_LIMIT_DESCRIPTION_LENGTH]
+        usage[name] = task_usage
+    return usage
+
+
+def _percentile(values: List[float], p: float) -> float:
+    """Nearest-rank percentile of the sorted `values`."""
+    idx = max(0, math.ceil(p / 100 * len(values)) - 1)
+    return values[idx]
+
+
+@dataclass
+class DurationStats:
+    """Histogram and percentiles of the durations of one phase or task."""
+
+    name: str
+    description: str = ""
+    values: List[float] = field(default_factory=list)
+
+    @property
+    def count(self) -> int:
+        return len(self.values)
+
+    def percentile(self, p: float) -> float:
+        return _percentile(sorted(self.values), p)
+
+    @property
+    def total(self) -> float:
+        return sum(self.values)
+
+    def buckets(self) -> List[Tuple[str, int]]:
+        """
+        Returns (label, count) for each bucket, empty buckets at both ends are
+        omitted.
+        """
+        counts = [0] * (len(BUCKET_BOUNDS_MS) + 1)
+        for v in self.values:
+            idx = 0
+            while idx < len(BUCKET_BOUNDS_MS) and v >= BUCKET_BOUNDS_MS[idx]:
+                idx += 1
+            counts[idx] += 1
+
+        labels = [f"< {BUCKET_BOUNDS_MS[0]:g} ms"]
+        for lower, upper in zip(BUCKET_BOUNDS_MS, BUCKET_BOUNDS_MS[1:]):
+            labels.append(f"{lower:g} - {upper:g} ms")
+        labels.append(f">= {BUCKET_BOUNDS_MS[-1]:g} ms")
+
+        used = [i for i, c in enumerate(counts) if c]
+        if not used:
+            return []
+        return [(labels[i], counts[i]) for i in range(used[0], used[-1] + 1)]
+
+
+def aggregate(
+    timings: Iterable[Optional[Dict]],
+) -> Tuple[List[DurationStats], List[DurationStats]]:
+    """
+    Aggregate stored timings.
+    Returns:
+        The stats of each phase (in order of PHASES) and of each task (sorted by
+        their total duration, descending). Phases and tasks without values are
+        omitted.
+    """
+    phases = {name: DurationStats(name, desc) for name, desc in PHASES.items()}
+    tasks: Dict[str, DurationStats] = {}
+    for t in timings:
+        if not t:
+            continue
+        for name, value in (t.get("phases") or {}).items():
+            if name in phases:
+                phases[name].values.append(value)
+        for name, value in (t.get("tasks") or {}).items():
+            tasks.setdefault(name, DurationStats(name)).values.append(value)
+
+    return (
+        [s for s in phases.values() if s.count],
+        sorted(tasks.values(), key=lambda s: s.total, reverse=True),
+    )
@@ -6,12 +6,18 @@ scoring-policy-transformed submission scores with a per-task breakdown.
 
 Both are gated behind ``SYSTEM_SETTING.SCOREBOARD_ENABLED`` and return 404
 when the scoreboard is turned off (avoids leaking the feature's existence).
+
+The submissions are served from a materialized scoreboard (see
+``ref/core/scoreboard.py``) with an ETag. New submissions are merged into it
+once they are committed, other relevant changes are tracked via session
+events and cause a rebuild.
 """
 
 import typing as ty
 from collections import defaultdict
 
-from flask import abort, jsonify
+from flask import Response, abort, current_app, jsonify, request
+from sqlalchemy import inspect as sa_inspect
 from sqlalchemy.orm import selectinload
 
 from ref import db, limiter, refbp
@@ -21,11 +27,24 @@ from ref.core import (
     team_identity,
 )
 from ref.core.logging import get_logger
-from ref.model import Exercise, ExerciseConfig, Submission, SystemSettingsManager
+from ref.core.scoreboard import ScoreboardCache, ScoreRow, merge_rows
+from ref.model import (
+    Exercise,
+    ExerciseConfig,
+    Instance,
+    Submission,
+    SubmissionTestResult,
+    SystemSetting,
+    SystemSettingsManager,
+    User,
+    UserGroup,
+)
 from ref.model.enums import ExerciseBuildStatus
 
 log = get_logger(__name__)
 
+_scoreboard_cache = ScoreboardCache()
+
 
 def _scoreboard_enabled_or_abort() -> None:
     if not SystemSettingsManager.SCOREBOARD_ENABLED.value:
@@ -154,20 +173,16 @@ def api_scoreboard_config():
     )
 
 
-def _collect_submissions(*, include_admins: bool) -> dict:
-    """Build the challenge -> team -> entries mapping.
+def _submission_rows(
+    submissions: ty.Iterable[Submission], *, include_admins: bool
+) -> ty.Iterator[ScoreRow]:
+    """Yield a (challenge, team, entry) row for each scoreboard relevant submission.
 
     When *include_admins* is ``False``, submissions by admin users are
     silently skipped and submissions before the assignment start time
     are excluded so the public scoreboard only shows student work
     within the configured window.
     """
-    scores: dict[str, dict[str, list[dict]]] = defaultdict(lambda: defaultdict(list))
-
-    submissions = Submission.query.options(
-        selectinload(Submission.submission_test_results)
-    ).all()
-
     for submission in submissions:
         instance = submission.origin_instance
         if instance is None:
@@ -197,20 +212,126 @@ def _collect_submissions(*, include_admins: bool) -> dict:
         )
         if not breakdown:
             continue
-        team = team_identity(user)
-        scores[exercise.short_name][team].append(
+        yield (
+            exercise.short_name,
+            team_identity(user),
             {
                 "ts": datetime_to_string(submission.submission_ts),
                 "score": total,
                 "tasks": breakdown,
-            }
+            },
+        )
+
+
+def _load_submissions(ids: ty.Optional[ty.List[int]] = None) -> ty.List[Submission]:
+    query = Submission.query.options(selectinload(Submission.submission_test_results))
+    if ids is not None:
+        query = query.filter(Submission.id.in_(ids))
+    return query.all()
+
+
+def _collect_submissions(*, include_admins: bool) -> dict:
+    """Build the challenge -> team -> entries mapping from all submissions."""
+    return merge_rows(
+        {},
+        _submission_rows(_load_submissions(), include_admins=include_admins),
+    )
+
+
+def _scoreboard_response(*, include_admins: bool) -> Response:
+    """Serve the materialized scoreboard, or a 304 if the client has it already."""
+    board = _scoreboard_cache.get(
+        include_admins,
+        lambda: _collect_submissions(include_admins=include_admins),
+        lambda ids: _submission_rows(
+            _load_submissions(ids), include_admins=include_admins
+        ),
+    )
+
+    if request.if_none_match.contains(board.etag):
+        response = Response(status=304)
+    else:
+        response = Response(
+            board.body(current_app.json.dumps), mimetype="application/json"
         )
+    response.set_etag(board.etag)
+    # Clients must revalidate each time, but may keep the body to do so.
+    response.headers["Cache-Control"] = "no-cache"
+    return response
+
+
+# Attributes that affect the scoreboard. Changing one of them drops the
+# materialized scoreboard. None means all attributes.
+_TRACKED_ATTRIBUTES: ty.Dict[type, ty.Optional[ty.Tuple[str, ...]]] = {
+    ExerciseConfig: None,
+    Submission: ("submission_ts", "origin_instance_id"),
+    SubmissionTestResult: ("task_name", "score", "submission_id"),
+    User: ("first_name", "surname", "group", "group_id", "auth_groups"),
+    UserGroup: ("name",),
+}
+
+# Models whose deletion drops the materialized scoreboard.
+_TRACKED_DELETES = (
+    Exercise,
+    ExerciseConfig,
+    Instance,
+    Submission,
+    SubmissionTestResult,
+    User,
+    UserGroup,
+)
 
-    for challenge in scores.values():
-        for entries in challenge.values():
-            entries.sort(key=lambda e: e["ts"])
 
-    return scores
+def _affects_scoreboard(session, obj) -> bool:
+    if isinstance(obj, SystemSetting):
+        return obj.name == SystemSettingsManager.GROUPS_ENABLED.key
+    for model, attributes in _TRACKED_ATTRIBUTES.items():
+        if not isinstance(obj, model):
+            continue
+        if attributes is None:
+            return session.is_modified(obj)
+        state = sa_inspect(obj)
+        return any(state.attrs[a].history.has_changes() for a in attributes)
+    return False
+
+
+@db.event.listens_for(db.session, "after_flush")
+def _track_scoreboard_changes(session, flush_context):
+    """Record the changes of the current transaction that affect the scoreboard.
+
+    New submissions are merged into the materialized scoreboard once the
+    transaction is committed; all other changes drop it.
+    """
+    changes = session.info.setdefault(
+        "scoreboard_changes",
+        {"submissions": set(), "results": set(), "invalidate": False},
+    )
+    for obj in session.new:
+        if isinstance(obj, Submission):
+            changes["submissions"].add(obj.id)
+        elif isinstance(obj, SubmissionTestResult):
+            changes["results"].add(obj.submission_id)
+    if any(isinstance(obj, _TRACKED_DELETES) for obj in session.deleted):
+        changes["invalidate"] = True
+    elif any(_affects_scoreboard(session, obj) for obj in session.dirty):
+        changes["invalidate"] = True
+
+
+@db.event.listens_for(db.session, "after_commit")
+def _apply_scoreboard_changes(session):
+    changes = session.info.pop("scoreboard_changes", None)
+    if not changes:
+        return
+    # Results that were added to an existing submission (e.g., by a regrade).
+    if changes["invalidate"] or not changes["results"] <= changes["submissions"]:
+        _scoreboard_cache.invalidate()
+    else:
+        _scoreboard_cache.add_submissions(changes["submissions"])
+
+
+@db.event.listens_for(db.session, "after_rollback")
+def _discard_scoreboard_changes(session):
+    session.info.pop("scoreboard_changes", None)
 
 
 @refbp.route("/api/scoreboard/submissions", methods=("GET",))
@@ -239,7 +360,7 @@ def api_scoreboard_submissions():
     Submissions by admin users are excluded from the public scoreboard.
     """
     _scoreboard_enabled_or_abort()
-    return jsonify(_collect_submissions(include_admins=False))
+    return _scoreboard_response(include_admins=False)
 
 
 @refbp.route("/api/scoreboard/submissions/admin", methods=("GET",))
@@ -257,4 +378,4 @@ def api_scoreboard_submissions_admin():
     if not current_user.is_authenticated or not current_user.is_admin:
         abort(403)
 
-    return jsonify(_collect_submissions(include_admins=True))
+    return _scoreboard_response(include_admins=True)
@@ -10,11 +10,14 @@ from .instance import InstanceEntryService as InstanceEntryService
 from .instance import InstanceService as InstanceService
 from .instance import Submission as Submission
 from .instance import SubmissionTestResult as SubmissionTestResult
+from .instance import SubmissionTicket as SubmissionTicket
 from .instance import SubmissionExtendedTestResult as SubmissionExtendedTestResult
 from .settings import SystemSetting as SystemSetting
 from .settings import SystemSettingsManager as SystemSettingsManager
 from .user import GroupNameList as GroupNameList
+from .user import SshKeyChange as SshKeyChange
 from .user import User as User
 from .user import UserGroup as UserGroup
 from .enums import ExerciseBuildStatus as ExerciseBuildStatus
+from .enums import SubmissionTicketState as SubmissionTicketState
 from .enums import UserAuthorizationGroups as UserAuthorizationGroups
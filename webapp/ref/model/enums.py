@@ -26,6 +26,16 @@ class ExerciseBuildStatus(Enum):
     FAILED = "FAILED"
 
 
+class SubmissionTicketState(Enum):
+    """
+    Possible states of a queued submission request.
+    """
+
+    PENDING = "PENDING"
+    DONE = "DONE"
+    FAILED = "FAILED"
+
+
 class UserAuthorizationGroups(Enum):
     """
     Groups used for permission checks.
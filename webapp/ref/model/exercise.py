@@ -87,6 +87,9 @@ class ExerciseEntryService(CommonDbOpsMixin, ModelToStringMixin, db.Model):
 
     allow_internet: Mapped[bool] = mapped_column(default=False)
 
+    # Whether compilers invoked by build_cmd and the submission tests use ccache.
+    compiler_cache: Mapped[bool] = mapped_column(default=False)
+
     # options for the flag that is placed inside the container
     flag_path: Mapped[Optional[str]] = mapped_column(Text)
     flag_value: Mapped[Optional[str]] = mapped_column(Text)
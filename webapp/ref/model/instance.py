@@ -4,12 +4,13 @@ from pathlib import Path
 from typing import TYPE_CHECKING, List, Optional
 
 from flask import current_app
-from sqlalchemy import ForeignKey, Text, UniqueConstraint
-from sqlalchemy.orm import Mapped, mapped_column, relationship
+from sqlalchemy import JSON, ForeignKey, Text, UniqueConstraint, event, select
+from sqlalchemy.orm import Mapped, attributes, mapped_column, relationship
 
 from ref import db
 
-from .user import User
+from .enums import SubmissionTicketState
+from .user import User, _log_key_changes
 from .util import CommonDbOpsMixin, ModelToStringMixin
 
 # Avoid cyclic dependencies for type hinting
@@ -90,6 +91,14 @@ class InstanceEntryService(CommonDbOpsMixin, ModelToStringMixin, db.Model):
         """
         return f"{self.instance.persistance_path}/entry-submitted"
 
+    @property
+    def overlay_submitted_manifest(self) -> str:
+        """
+        Objects of the snapshot store (see ref.core.snapshot) that are used by
+        overlay_submitted.
+        """
+        return f"{self.instance.persistance_path}/entry-submitted.manifest"
+
     @property
     def overlay_upper(self) -> str:
         """
@@ -98,6 +107,13 @@ class InstanceEntryService(CommonDbOpsMixin, ModelToStringMixin, db.Model):
         """
         return f"{self.instance.persistance_path}/entry-upper"
 
+    @property
+    def overlay_upper_stat_cache(self) -> str:
+        """
+        Stat cache used to speed up consecutive snapshots of overlay_upper.
+        """
+        return f"{self.instance.persistance_path}/entry-upper.snapshot-cache"
+
     @property
     def overlay_work(self) -> str:
         """
@@ -268,6 +284,20 @@ class Instance(CommonDbOpsMixin, ModelToStringMixin, db.Model):
         return self.submission is not None
 
 
+@event.listens_for(InstanceEntryService, "after_update")
+def _entry_service_after_update(mapper, connection, target: InstanceEntryService):
+    # The SSH reverse proxy caches the address of running instances per key and
+    # drops these entries once the key shows up in the key change log.
+    history = attributes.get_history(target, "container_id")
+    if any(history.deleted):
+        pub_key = connection.execute(
+            select(User.pub_key)
+            .join(Instance, Instance.user_id == User.id)
+            .where(Instance.id == target.instance_id)
+        ).scalar()
+        _log_key_changes(connection, [pub_key])
+
+
 class SubmissionTestResult(CommonDbOpsMixin, ModelToStringMixin, db.Model):
     __to_str_fields__ = ["id"]
     __tablename__ = "submission_test_result"
@@ -284,6 +314,10 @@ class SubmissionTestResult(CommonDbOpsMixin, ModelToStringMixin, db.Model):
     # If the task supports grading, this is the score that was reached.
     score: Mapped[Optional[float]]
 
+    # Resources used by the task's tests (see ref/core/timing.py), if the
+    # container accounted them.
+    resource_usage: Mapped[Optional[dict]] = mapped_column(JSON, nullable=True)
+
     # ondelete='CASCADE' => Delete result if associated submission is deleted (realized via db-constraint)
     submission_id: Mapped[int] = mapped_column(
         ForeignKey("submission.id", ondelete="CASCADE")
@@ -361,6 +395,9 @@ class Submission(CommonDbOpsMixin, ModelToStringMixin, db.Model):
     # Point in time the submission was created.
     submission_ts: Mapped[datetime.datetime]
 
+    # Durations of the phases of `task submit` (see ref/core/timing.py), if reported.
+    timings: Mapped[Optional[dict]] = mapped_column(JSON, nullable=True)
+
     # Set if this Submission was graded
     # ondelete='RESTRICT' => restrict deletetion of referenced row if it is still referenced from here.
     grading_id: Mapped[Optional[int]] = mapped_column(
@@ -416,6 +453,41 @@ class Submission(CommonDbOpsMixin, ModelToStringMixin, db.Model):
         return [s for s in submissions if s.submission_ts > self.submission_ts]
 
 
+class SubmissionTicket(CommonDbOpsMixin, ModelToStringMixin, db.Model):
+    """
+    A submission request that was accepted but not yet turned into a Submission
+    (see ref.core.submission_queue).
+    """
+
+    __to_str_fields__ = ["id", "instance_id", "state"]
+    __tablename__ = "submission_ticket"
+
+    id: Mapped[int] = mapped_column(primary_key=True)
+
+    # The instance that is submitted.
+    instance_id: Mapped[int] = mapped_column(
+        ForeignKey("exercise_instance.id", ondelete="CASCADE")
+    )
+    instance: Mapped[Instance] = relationship("Instance", foreign_keys=[instance_id])
+
+    # Point in time the request was accepted. This is the time of the submission.
+    accepted_ts: Mapped[datetime.datetime]
+    state: Mapped[SubmissionTicketState]
+
+    # The test results and output sent by the container (user controlled!).
+    payload: Mapped[dict] = mapped_column(JSON)
+    # Timings of the request (see ref/core/timing.py).
+    timings: Mapped[Optional[dict]] = mapped_column(JSON, nullable=True)
+
+    # The created submission, if state is DONE.
+    submission_id: Mapped[Optional[int]] = mapped_column(
+        ForeignKey("submission.id", ondelete="SET NULL")
+    )
+    submission: Mapped[Optional[Submission]] = relationship(
+        "Submission", foreign_keys=[submission_id]
+    )
+
+
 class Grading(CommonDbOpsMixin, ModelToStringMixin, db.Model):
     __to_str_fields__ = ["id"]
     __tablename__ = "grading"
@@ -96,6 +96,8 @@ class SystemSettingsManager:
     INSTANCE_NON_DEFAULT_PROVISIONING = Setting(
         "INSTANCE_NON_DEFAULT_PROVISIONING", bool, False
     )
+    # Number of pre-created containers per default exercise (see ref.core.pool).
+    INSTANCE_POOL_SIZE = Setting("INSTANCE_POOL_SIZE", int, 0)
 
     SSH_WELCOME_MSG = Setting("SSH_WELCOME_MSG", str, default_ssh_welcome_msg)
     SSH_MESSAGE_OF_THE_DAY = Setting("SSH_MESSAGE_OF_THE_DAY", str, None)
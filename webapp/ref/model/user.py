@@ -4,8 +4,19 @@ from typing import TYPE_CHECKING, List, Optional
 
 from flask_bcrypt import check_password_hash, generate_password_hash
 from flask_login import UserMixin
-from sqlalchemy import Boolean, ForeignKey, LargeBinary, PickleType, Text
-from sqlalchemy.orm import Mapped, mapped_column, relationship
+from sqlalchemy import (
+    Boolean,
+    ForeignKey,
+    LargeBinary,
+    PickleType,
+    Text,
+    delete,
+    event,
+    func,
+    insert,
+    select,
+)
+from sqlalchemy.orm import Mapped, attributes, mapped_column, relationship
 
 from ref import db
 from ref.model.enums import CourseOfStudies, UserAuthorizationGroups
@@ -128,3 +139,54 @@ class User(CommonDbOpsMixin, ModelToStringMixin, UserMixin, db.Model):
     @property
     def submissions(self) -> List["Instance"]:
         return [i for i in self.exercise_instances if i.submission]
+
+
+class SshKeyChange(db.Model):
+    """
+    Log of public keys that were added to or removed from the set of user keys.
+    The SSH reverse proxy uses the ID of the latest change as version of its key
+    set and asks for the keys affected since then (see /api/getkeys).
+    Keys are also logged when the container of one of their owner's instances is
+    stopped, since the proxy drops the endpoints it cached for affected keys.
+
+    Since all transactions are serialized by the DB lock (see ref.core.util.lock_db),
+    IDs become visible in ascending order.
+    """
+
+    __tablename__ = "ssh_key_change"
+
+    id: Mapped[int] = mapped_column(primary_key=True)
+    pub_key: Mapped[str] = mapped_column(Text)
+
+
+# Number of logged key changes that are kept. Proxies that are further behind
+# receive the full key set.
+SSH_KEY_CHANGE_RETENTION = 10000
+
+
+def _log_key_changes(connection, keys):
+    keys = [k for k in keys if k]
+    if keys:
+        table = SshKeyChange.__table__
+        connection.execute(insert(table), [{"pub_key": k} for k in keys])
+        latest = select(func.max(table.c.id)).scalar_subquery()
+        connection.execute(
+            delete(table).where(table.c.id <= latest - SSH_KEY_CHANGE_RETENTION)
+        )
+
+
+@event.listens_for(User, "after_insert")
+def _user_after_insert(mapper, connection, target: User):
+    _log_key_changes(connection, [target.pub_key])
+
+
+@event.listens_for(User, "after_update")
+def _user_after_update(mapper, connection, target: User):
+    history = attributes.get_history(target, "pub_key")
+    if history.has_changes():
+        _log_key_changes(connection, list(history.added) + list(history.deleted))
+
+
+@event.listens_for(User, "after_delete")
+def _user_after_delete(mapper, connection, target: User):
+    _log_key_changes(connection, [target.pub_key])
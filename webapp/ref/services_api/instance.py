@@ -4,25 +4,53 @@ Each request carries a payload signed with the instance's own key (see
 ``Instance.get_key``). The outer body has a plain ``instance_id`` used
 only to look up the verification key; the verified inner ``instance_id``
 is what subsequent code trusts.
+
+Submissions may instead carry a zstd compressed body whose digest is signed
+in a header (see ``_unwrap_compressed_container_request``).
 """
 
+import hashlib
+import hmac
 import json
+import time
 import typing as ty
-from dataclasses import dataclass
+from dataclasses import asdict, dataclass
 
-from flask import Request, abort, current_app, request
-from itsdangerous import TimedSerializer
+import zstandard
+from flask import Request, abort, current_app, g, request
+from itsdangerous import TimedSerializer, TimestampSigner
 
 from ref import limiter, refbp
-from ref.core import InstanceManager, datetime_to_string
+from ref.core import InstanceManager, datetime_to_string, submission_queue
 from ref.core.logging import get_logger
-from ref.model import Instance, SystemSettingsManager, User
-from ref.model.instance import SubmissionTestResult
+from ref.core.timing import (
+    TIMINGS_HEADER,
+    parse_client_timings,
+    parse_resource_usage,
+)
+from ref.model import (
+    Instance,
+    SubmissionTicket,
+    SubmissionTicketState,
+    SystemSettingsManager,
+    User,
+)
 
 from . import error_response, ok_response
 
 log = get_logger(__name__)
 
+# ! Keep in sync with ref-docker-base/task.py
+COMPRESSED_REQUEST_CONTENT_TYPE = "application/zstd"
+COMPRESSED_REQUEST_SIGNATURE_HEADER = "X-REF-Signature"
+COMPRESSED_REQUEST_SALT = "from-container-to-web-compressed"
+
+# Bounds for compressed requests. Test output is capped at 64 KiB by the
+# container, so these leave plenty of room for JSON escaping.
+_MAX_COMPRESSED_REQUEST_SIZE = 4 * 1024 * 1024
+_MAX_DECOMPRESSED_REQUEST_SIZE = 16 * 1024 * 1024
+_READ_CHUNK_SIZE = 64 * 1024
+
 
 class SignatureUnwrappingError(Exception):
     """Raised when a container request can't be verified.
@@ -93,6 +121,101 @@ def _unwrap_signed_container_request(req: Request, max_age_s: int = 60) -> ty.An
     return signed_content
 
 
+class _HashingReader:
+    """Read-only stream wrapper that hashes and bounds everything read."""
+
+    def __init__(self, stream: ty.BinaryIO, limit: int):
+        self._stream = stream
+        self._limit = limit
+        self.size = 0
+        self.digest = hashlib.sha256()
+
+    def read(self, size: int = -1) -> bytes:
+        data = self._stream.read(size)
+        self.size += len(data)
+        if self.size > self._limit:
+            raise SignatureUnwrappingError("Request is too large")
+        self.digest.update(data)
+        return data
+
+
+def _unwrap_compressed_container_request(
+    req: Request, max_age_s: int = 60
+) -> ty.Any:
+    """Verify and return the payload of a compressed container request.
+
+    Expected wire format::
+
+        Content-Type: application/zstd
+        X-REF-Signature: "<instance_id>:<sha256 of body>" signed with
+                         Instance.get_key() (itsdangerous TimestampSigner)
+
+        <body>: zstd compressed JSON, {"instance_id": int, ...}
+
+    The signature is checked before the body is touched. The body is then
+    decompressed while it is read from the client, so only the decompressed
+    payload is kept in memory.
+    """
+    token = req.headers.get(COMPRESSED_REQUEST_SIGNATURE_HEADER)
+    if not token:
+        log.warning("Got compressed request without signature")
+        raise SignatureUnwrappingError("Request is missing signature")
+
+    try:
+        unsafe_value = token.rsplit(".", 2)[0]
+        instance_id_str, _ = unsafe_value.split(":", 1)
+        instance_id = int(instance_id_str)
+    except ValueError:
+        log.warning("Malformed signature header", exc_info=True)
+        raise SignatureUnwrappingError("Invalid request")
+
+    instance = Instance.query.filter(Instance.id == instance_id).one_or_none()
+    if not instance:
+        log.warning(f"Failed to find instance with ID {instance_id}")
+        raise SignatureUnwrappingError("Unable to find given instance")
+
+    signer = TimestampSigner(instance.get_key(), salt=COMPRESSED_REQUEST_SALT)
+    try:
+        signed_value = signer.unsign(token, max_age=max_age_s).decode()
+    except Exception:
+        log.warning("Invalid request", exc_info=True)
+        raise SignatureUnwrappingError("Invalid request")
+    _, signed_digest = signed_value.split(":", 1)
+
+    body = _HashingReader(req.stream, _MAX_COMPRESSED_REQUEST_SIZE)
+    payload = bytearray()
+    try:
+        with zstandard.ZstdDecompressor().stream_reader(
+            body, read_size=_READ_CHUNK_SIZE, closefd=False
+        ) as reader:
+            while chunk := reader.read(_READ_CHUNK_SIZE):
+                payload += chunk
+                if len(payload) > _MAX_DECOMPRESSED_REQUEST_SIZE:
+                    raise SignatureUnwrappingError("Request is too large")
+        # Trailing data must be covered by the digest as well.
+        while body.read(_READ_CHUNK_SIZE):
+            pass
+    except zstandard.ZstdError:
+        log.warning("Failed to decompress request", exc_info=True)
+        raise SignatureUnwrappingError("Error during decoding")
+
+    if not hmac.compare_digest(body.digest.hexdigest(), signed_digest):
+        log.warning("Digest of compressed request does not match its signature")
+        raise SignatureUnwrappingError("Invalid request")
+
+    try:
+        content = json.loads(payload)
+    except ValueError:
+        log.warning("Failed to decode payload", exc_info=True)
+        raise SignatureUnwrappingError("Error during decoding")
+
+    if not isinstance(content, dict) or content.get("instance_id") != instance_id:
+        log.warning("Signed and embedded instance_id differ")
+        raise SignatureUnwrappingError("Invalid request")
+
+    return content
+
+
 @refbp.route("/api/instance/reset", methods=("GET", "POST"))
 @limiter.limit("3 per minute; 24 per day")
 def api_instance_reset():
@@ -136,7 +259,8 @@ def api_instance_reset():
 def api_instance_submit():
     """Record a submission with its per-task test results.
 
-    Body (signed)::
+    The body is either a signed JSON string or a compressed request (see
+    ``_unwrap_compressed_container_request``), both carrying::
 
         {
           "instance_id": int,
@@ -146,9 +270,16 @@ def api_instance_submit():
             ...
           ]
         }
+
+    Returns ``{"ticket": int, "message": str}`` for compressed requests, which
+    are polled via /api/instance/submit/status, and only the message otherwise.
     """
     try:
-        content: ty.Dict[str, ty.Any] = _unwrap_signed_container_request(request)
+        content: ty.Dict[str, ty.Any]
+        if request.mimetype == COMPRESSED_REQUEST_CONTENT_TYPE:
+            content = _unwrap_compressed_container_request(request)
+        else:
+            content = _unwrap_signed_container_request(request)
     except SignatureUnwrappingError as e:
         return error_response(e.user_error_message)
 
@@ -216,24 +347,71 @@ def api_instance_submit():
             "Submission is currently disabled, please try again later."
         )
 
-    mgr = InstanceManager(instance)
-
-    # Creating the submission stops the instance it was made from. If the
-    # subsequent commit fails, the user won't see any error feedback.
-    test_result_objs = []
-    for r in test_results:
-        o = SubmissionTestResult(
-            r.task_name, user_controlled_test_output, r.success, r.score
+    if submission_queue.pending_ticket(instance):
+        log.info(f"User tried to submit instance {instance} while a submission is queued")
+        return error_response(
+            "Unable to submit: A previous submission of this instance is still being processed."
         )
-        test_result_objs.append(o)
-    new_instance = mgr.create_submission(test_result_objs)
+
+    # The submission is created by the submission queue, the data is snapshotted
+    # once a worker processes the request.
+    payload = {
+        "output": user_controlled_test_output,
+        "test_results": [asdict(r) for r in test_results],
+        "resource_usage": parse_resource_usage(content.get("resource_usage")),
+    }
+    received_ns = int(g.before_request_ts * 1e9)
+    timings = parse_client_timings(request.headers.get(TIMINGS_HEADER), received_ns)
+    ticket = submission_queue.enqueue(instance, payload, timings)
+    timings["phases"]["handling"] = round(
+        (time.monotonic_ns() - received_ns) / 1e6, 3
+    )
 
     current_app.db.session.commit()
-    log.info(f"Created submission: {new_instance.submission}")
+    submission_queue.notify(current_app._get_current_object())
+    log.info(f"Queued submission: {ticket}")
 
-    return ok_response(
-        f"[+] Submission with ID {new_instance.id} successfully created!"
-    )
+    message = "[+] Your submission was accepted and is being processed..."
+    if request.mimetype != COMPRESSED_REQUEST_CONTENT_TYPE:
+        # Sent by a task.py of an image that predates the queue, it prints the
+        # response as is and does not poll the ticket.
+        return ok_response(message)
+    return ok_response({"ticket": ticket.id, "message": message})
+
+
+@refbp.route("/api/instance/submit/status", methods=("GET", "POST"))
+@limiter.limit("60 per minute")
+def api_instance_submit_status():
+    """Return the state of a queued submission.
+
+    Body (signed): ``{"instance_id": int, "ticket": int}``. Returns::
+
+        {"state": "PENDING" | "DONE" | "FAILED", "message": str}
+    """
+    try:
+        content = _unwrap_signed_container_request(request)
+    except SignatureUnwrappingError as e:
+        return error_response(e.user_error_message)
+
+    try:
+        instance_id = int(content["instance_id"])
+        ticket_id = int(content["ticket"])
+    except (KeyError, TypeError, ValueError):
+        log.warning("Invalid request", exc_info=True)
+        return error_response("Invalid request")
+
+    ticket = SubmissionTicket.get(ticket_id)
+    if not ticket or ticket.instance_id != instance_id:
+        log.warning(f"Invalid ticket {ticket_id} for instance_id={instance_id}")
+        return error_response("Invalid request")
+
+    if ticket.state == SubmissionTicketState.DONE:
+        message = f"[+] Submission with ID {ticket.submission.submitted_instance_id} successfully created!"
+    elif ticket.state == SubmissionTicketState.FAILED:
+        message = "[!] Failed to create the submission, please contact the staff."
+    else:
+        message = "[+] Your submission is still being processed..."
+    return ok_response({"state": ticket.state.value, "message": message})
 
 
 @refbp.route("/api/instance/info", methods=("GET", "POST"))
@@ -11,6 +11,7 @@ import re
 import arrow
 from flask import Flask, current_app, request
 from itsdangerous import Serializer
+from sqlalchemy import func
 
 from ref import db, limiter, refbp
 from ref.core import AnsiColorUtil as ansi
@@ -21,7 +22,7 @@ from ref.core import (
     utc_datetime_to_local_tz,
 )
 from ref.core.logging import get_logger
-from ref.model import Exercise, Instance, SystemSettingsManager, User
+from ref.model import Exercise, Instance, SshKeyChange, SystemSettingsManager, User
 
 from . import error_response, ok_response
 
@@ -471,10 +472,14 @@ def api_provision():
 @refbp.route("/api/getkeys", methods=("GET", "POST"))
 @limiter.exempt
 def api_getkeys():
-    """Return every registered pubkey, for the SSH proxy's authorized_keys.
-
-    Body: signed ``{"username": str}``. ``username`` is currently only
-    validated to be non-empty — we always return the full key set.
+    """Return the registered pubkeys, for the SSH proxy's authorized_keys.
+
+    Body: signed ``{"username": str, "since": int}``. ``username`` is currently
+    only validated to be non-empty. ``version`` in the response is the ID of
+    the latest ``SshKeyChange``. If ``since`` is a version returned earlier,
+    only the keys whose state changed since then are returned as ``added``
+    and ``removed``. Otherwise (or if these changes were already pruned), the
+    full key set is returned as ``keys``.
     """
     content, err = _verify_signed_body(request)
     if err is not None:
@@ -485,9 +490,36 @@ def api_getkeys():
         log.warning("Missing username attribute")
         return error_response("Invalid request")
 
-    students = User.all()
-    keys = [s.pub_key for s in students]
-    return ok_response({"keys": keys})
+    version = db.session.query(func.max(SshKeyChange.id)).scalar() or 0
+
+    since = content.get("since")
+    if type(since) is int and since <= version:
+        oldest = db.session.query(func.min(SshKeyChange.id)).scalar()
+        if since == version:
+            return ok_response({"version": version, "added": [], "removed": []})
+        if oldest is not None and oldest <= since + 1:
+            affected = {
+                k
+                for (k,) in db.session.query(SshKeyChange.pub_key)
+                .filter(SshKeyChange.id > since)
+                .distinct()
+            }
+            present = {
+                k
+                for (k,) in db.session.query(User.pub_key).filter(
+                    User.pub_key.in_(affected)
+                )
+            }
+            return ok_response(
+                {
+                    "version": version,
+                    "added": sorted(present),
+                    "removed": sorted(affected - present),
+                }
+            )
+
+    keys = [k for (k,) in db.session.query(User.pub_key)]
+    return ok_response({"keys": keys, "version": version})
 
 
 @refbp.route("/api/getuserinfo", methods=("GET", "POST"))
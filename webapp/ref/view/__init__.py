@@ -30,6 +30,8 @@ from .instances import instances_view_all as instances_view_all
 from .instances import instances_view_by_exercise as instances_view_by_exercise
 from .instances import instances_view_details as instances_view_details
 from .login import login as login
+from .regrade import api_regrade_status as api_regrade_status
+from .regrade import exercise_regrade as exercise_regrade
 from .student import student_default_routes as student_default_routes
 from .student import student_delete as student_delete
 from .student import student_view_all as student_view_all
@@ -39,4 +41,5 @@ from .submission import submission_reset as submission_reset
 from .submission import submissions_by_instance as submissions_by_instance
 from .submission import submissions_view_all as submissions_view_all
 from .system import system_gc as system_gc
+from .system import system_timings as system_timings
 from .system_settings import view_system_settings as view_system_settings
@@ -24,6 +24,7 @@ from ref.core import (
     extract_task_names_from_submission_tests,
     flash,
     InstanceManager,
+    InstancePool,
     validate_scoring_policy,
 )
 from ref.core.logging import get_logger
@@ -449,6 +450,10 @@ def exercise_toggle_default(exercise_id):
     db.session.add(exercise)
     db.session.commit()
 
+    # Create or remove the pooled containers of all versions.
+    for e in exercises_same_version + [exercise]:
+        InstancePool(e).fill()
+
     return redirect_to_next()
 
 
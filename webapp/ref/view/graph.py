@@ -3,7 +3,7 @@ from concurrent.futures import ThreadPoolExecutor
 from flask import render_template
 
 from ref import refbp
-from ref.core import DockerClient, admin_required
+from ref.core import DockerClient, admin_required, docker_inventory
 
 
 class Node:
@@ -22,9 +22,9 @@ class Link:
         self.target = target
 
 
-def _container_top(container):
+def _container_top(dc, container):
     # Create nodes and links for processes running in each container
-    processes = container.top()["Processes"]
+    processes = dc.client.api.top(container.id)["Processes"]
     nodes = []
     links = []
     for p in processes:
@@ -48,9 +48,10 @@ def graph():
     nodes.append(external_node)
 
     dc = DockerClient()
+    inventory = docker_inventory.get(dc.client)
 
-    # Create node for each container
-    containers = dc.containers()
+    # Create node for each running container
+    containers = [c for c in inventory.containers() if c.status == "running"]
 
     executor = ThreadPoolExecutor(max_workers=16)
     top_futures = []
@@ -61,10 +62,10 @@ def graph():
         nodes.append(node)
 
         # Create links and nodes for all processes running in the container
-        top_futures.append(executor.submit(_container_top, c))
+        top_futures.append(executor.submit(_container_top, dc, c))
 
     # Create node for each network
-    networks = dc.networks()
+    networks = inventory.networks()
     for network in networks:
         if network.name in ["host", "none"]:
             continue
@@ -74,7 +75,7 @@ def graph():
 
     # Create links between containers and networks.
     for network in networks:
-        for container_id in network.attrs["Containers"]:
+        for container_id in network.containers:
             if network.id in valid_ids and container_id in valid_ids:
                 link = Link(None, network.id, container_id)
                 links.append(link)
@@ -89,7 +90,7 @@ def graph():
                 link = Link(None, container_id, network.id)
                 nodes.append(node)
                 links.append(link)
-        if network.id in valid_ids and not network.attrs["Internal"]:
+        if network.id in valid_ids and not network.internal:
             link = Link(None, network.id, external_node.id)
             links.append(link)
 
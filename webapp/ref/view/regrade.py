@@ -0,0 +1,78 @@
+from flask import abort, jsonify, redirect, render_template, request, url_for
+from wtforms import BooleanField, Form, SelectField, SubmitField
+
+from ref import refbp
+from ref.core import admin_required, flash, regrade
+from ref.model import Exercise
+from ref.model.enums import ExerciseBuildStatus
+
+
+class RegradeForm(Form):
+    tests_from = SelectField("Tests of version", coerce=int)
+    apply = BooleanField(
+        "Replace the stored test results (otherwise, only the changes are shown)"
+    )
+    start = SubmitField("Start")
+    cancel = SubmitField("Cancel")
+
+
+def _get_exercise(exercise_id) -> Exercise:
+    exercise = Exercise.query.filter(Exercise.id == exercise_id).one_or_none()
+    if not exercise:
+        flash.error(f"Unknown exercise ID {exercise_id}")
+        abort(400)
+    return exercise
+
+
+@refbp.route("/admin/exercise/<int:exercise_id>/regrade", methods=("GET", "POST"))
+@admin_required
+def exercise_regrade(exercise_id):
+    """
+    Regrade all submissions of an exercise, see ref.core.regrade.
+    """
+    exercise = _get_exercise(exercise_id)
+    versions = [
+        e
+        for e in [exercise] + exercise.successors()
+        if e.build_job_status == ExerciseBuildStatus.FINISHED
+        and e.submission_test_enabled
+    ]
+
+    form = RegradeForm(request.form)
+    form.tests_from.choices = [(e.id, f"v{e.version}") for e in versions]
+    if not form.tests_from.data:
+        form.tests_from.data = exercise.id
+
+    job = regrade.get(exercise.id)
+    if form.cancel.data and job:
+        job.cancel()
+        flash.info("Regrading stops once the running tests are done")
+        return redirect(url_for("ref.exercise_regrade", exercise_id=exercise.id))
+
+    if form.start.data and form.validate():
+        tests_exercise = next(e for e in versions if e.id == form.tests_from.data)
+        try:
+            regrade.start(exercise, tests_exercise, bool(form.apply.data))
+        except regrade.RegradeError as e:
+            flash.error(str(e))
+        return redirect(url_for("ref.exercise_regrade", exercise_id=exercise.id))
+
+    return render_template(
+        "exercise_regrade.html",
+        exercise=exercise,
+        versions={e.id: e for e in versions},
+        form=form,
+        job=job,
+    )
+
+
+@refbp.route("/api/regrade-status/<int:exercise_id>")
+@admin_required
+def api_regrade_status(exercise_id):
+    """
+    Progress of the most recent regrade job of an exercise.
+    """
+    job = regrade.get(exercise_id)
+    if job is None:
+        return jsonify(None)
+    return jsonify(job.to_dict())
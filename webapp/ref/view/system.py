@@ -1,11 +1,18 @@
 from dataclasses import dataclass
-from concurrent.futures import ThreadPoolExecutor
 from flask import current_app, render_template
-from functools import partial
 from ref import refbp
-from ref.core import DockerClient, admin_required
+from ref.core import (
+    DockerClient,
+    InstanceManager,
+    admin_required,
+    docker_inventory,
+    flash,
+    pool,
+    regrade,
+)
+from ref.core.timing import aggregate
 from ref.core.util import redirect_to_next
-from ref.model import InstanceEntryService, InstanceService, Instance
+from ref.model import InstanceEntryService, InstanceService, Instance, Submission
 
 
 @dataclass
@@ -24,21 +31,17 @@ class DanglingContainer:
 def _get_dangling_networks():
     dangling_networks = []
 
-    d = DockerClient()
-    networks = d.networks(
-        filters={"name": current_app.config["DOCKER_RESSOURCE_PREFIX"]}
-    )
+    inventory = docker_inventory.get(DockerClient().client)
+    networks = inventory.networks(current_app.config["DOCKER_RESSOURCE_PREFIX"])
 
-    ssh_proxy_container = d.container(
+    ssh_proxy_container = inventory.container(
         current_app.config["SSH_REVERSE_PROXY_CONTAINER_NAME"]
     )
 
     for network in networks:
-        connected_containers = d.get_connected_container(network)
+        connected_containers = network.containers
 
-        if connected_containers and set(connected_containers) != set(
-            [ssh_proxy_container.id]
-        ):
+        if connected_containers and connected_containers != {ssh_proxy_container.id}:
             # Containers connected (besides the SSH proxy container), ignore it
             continue
 
@@ -48,77 +51,40 @@ def _get_dangling_networks():
     return dangling_networks
 
 
-def _is_in_db(container_id):
+def _container_ids_in_db():
     """
-    Check if the given container ID is contained in any DB record.
-    Returns:
-        True, if the container ID is found in the DB.
-        Else, False.
+    Returns the IDs of all containers that are referenced by any DB record.
     """
-    return (
-        InstanceService.query.filter(
-            InstanceService.container_id == container_id
-        ).one_or_none()
-        or InstanceEntryService.query.filter(
-            InstanceEntryService.container_id == container_id
-        ).one_or_none()
-    )
-
-
-def _is_connected_to_ssh_proxy(dc, ssh_proxy_container, container):
-    """
-    Check whether the container is connected to the SSH reverse proxy.
-    Returns:
-        True, if the container is connected to the SSH reverse proxy
-        Else, False.
-    """
-    if ssh_proxy_container == container:
-        return container, True
-
-    containers = dc.container_transitive_closure_get_containers(container)
-
-    return container, ssh_proxy_container.id in containers
+    db = current_app.db
+    ids = {id_ for (id_,) in db.session.query(InstanceService.container_id)}
+    ids |= {id_ for (id_,) in db.session.query(InstanceEntryService.container_id)}
+    return ids
 
 
 def _get_dangling_container():
     dangling_container = []
-    dc = DockerClient()
+    inventory = docker_inventory.get(DockerClient().client)
     # Get all container that have a name that contains the provided prefix
-    containers = dc.containers(
-        include_stopped=True,
-        sparse=True,
-        filters={"name": current_app.config["DOCKER_RESSOURCE_PREFIX"]},
-    )
-    ssh_proxy_container = dc.container(
+    containers = inventory.containers(current_app.config["DOCKER_RESSOURCE_PREFIX"])
+    ssh_proxy_container = inventory.container(
         current_app.config["SSH_REVERSE_PROXY_CONTAINER_NAME"]
     )
 
-    executor = ThreadPoolExecutor(max_workers=16)
-    is_connected_to_ssh_futures = set()
-
-    is_connected_to_ssh_proxy_fn = partial(
-        _is_connected_to_ssh_proxy, dc, ssh_proxy_container
-    )
+    # Containers that are connected to the SSH reverse proxy, including via
+    # intermediate containers.
+    connected_to_ssh_proxy = inventory.transitive_closure(ssh_proxy_container.id)
+    ids_in_db = _container_ids_in_db()
+    regrading = regrade.active_container_ids()
+    pooled = pool.container_ids()
 
     for container in containers:
-        if not _is_in_db(container.id):
-            container.reload()
-            dangling_container.append(
-                DanglingContainer(container.id, container.name, container.status)
-            )
-        is_connected_to_ssh_futures.add(
-            executor.submit(is_connected_to_ssh_proxy_fn, container)
-        )
-
-    for future in is_connected_to_ssh_futures:
-        c, is_connected = future.result()
-        if not is_connected:
+        if container.id in regrading or container.id in pooled:
+            continue
+        if container.id not in ids_in_db or container.id not in connected_to_ssh_proxy:
             dangling_container.append(
                 DanglingContainer(container.id, container.name, container.status)
             )
 
-    executor.shutdown()
-
     return dangling_container
 
 
@@ -146,9 +112,8 @@ def system_gc_delete_dangling_networks():
     d = DockerClient()
     dangling_networks = _get_dangling_networks()
     for network in dangling_networks:
-        network = d.network(network.id)
-        if network:
-            network.remove()
+        d.remove_network(network.id)
+    d.reconcile_subnets()
 
     return redirect_to_next()
 
@@ -164,11 +129,23 @@ def system_gc_delete_dangling_container():
     dangling_containers = _get_dangling_container()
     for c in dangling_containers:
         c = d.container(c.id)
-        c.remove(force=True)
+        if c:
+            c.remove(force=True)
 
     return redirect_to_next()
 
 
+@refbp.route("/system/gc/collect_snapshot_garbage")
+@admin_required
+def system_gc_collect_snapshot_garbage():
+    """
+    Delete all objects of the snapshot store that are not used by any snapshot.
+    """
+    dropped = InstanceManager._snapshot_store().collect_garbage()
+    flash.success(f"Deleted {dropped} unused snapshot object(s)")
+    return redirect_to_next()
+
+
 @refbp.route("/system/gc/delete_old_submissions")
 @admin_required
 def system_gc_delete_old_submission():
@@ -191,3 +168,29 @@ def system_gc():
         dangling_container=dangling_container,
         old_submissions=old_submissions,
     )
+
+
+# Number of most recent submissions the timings view aggregates.
+_TIMINGS_SUBMISSION_LIMIT = 1000
+
+
+@refbp.route("/system/timings")
+@admin_required
+def system_timings():
+    """
+    Histograms of the durations of the phases of `task submit`.
+    """
+    rows = (
+        Submission.query.with_entities(Submission.timings)
+        .filter(Submission.timings.isnot(None))
+        .order_by(Submission.id.desc())
+        .limit(_TIMINGS_SUBMISSION_LIMIT)
+        .all()
+    )
+    phases, tasks = aggregate(row.timings for row in rows)
+    return render_template(
+        "system_timings.html",
+        submission_cnt=len(rows),
+        phases=phases,
+        tasks=tasks,
+    )
@@ -11,9 +11,9 @@ from wtforms import (
 
 import pytz
 from ref import refbp
-from ref.core import admin_required
+from ref.core import InstancePool, admin_required
 from ref.core.logging import get_logger
-from ref.model import SystemSettingsManager
+from ref.model import Exercise, SystemSettingsManager
 
 
 LANDING_PAGE_CHOICES = [
@@ -78,6 +78,10 @@ class SshSettings(Form):
     ssh_allow_root_logins_for_admin = BooleanField(
         'Allow admins to login as root by prefixing the SSH username with "root@".'
     )
+    instance_pool_size = IntegerField(
+        "Number of containers started in advance for each default exercise (0 disables pooling).",
+        validators=[validators.NumberRange(0)],
+    )
     message_of_the_day = StringField("Message of the day")
     submit = SubmitField("Save")
 
@@ -173,11 +177,20 @@ def view_system_settings():
             SystemSettingsManager.SSH_MESSAGE_OF_THE_DAY,
             ssh_settings_form.message_of_the_day,
         ),
+        (
+            SystemSettingsManager.INSTANCE_POOL_SIZE,
+            ssh_settings_form.instance_pool_size,
+        ),
     ]
     process_setting_form(ssh_settings_form, ssh_settings_mapping)
 
     current_app.db.session.commit()
 
+    if ssh_settings_form.submit.data:
+        # Apply the new pool size.
+        for exercise in Exercise.query.filter(Exercise.is_default.is_(True)).all():
+            InstancePool(exercise).fill()
+
     return render_template(
         "system_settings.html",
         ssh_settings_form=ssh_settings_form,
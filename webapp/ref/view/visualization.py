@@ -9,7 +9,7 @@ from dataclasses import dataclass
 
 from ref.core.util import utc_datetime_to_local_tz
 from ref import refbp
-from ref.core import DockerClient, admin_required
+from ref.core import DockerClient, admin_required, docker_inventory
 from ref.model import Exercise, Submission
 from gviz_api import DataTable
 
@@ -32,10 +32,10 @@ class Link:
     target: str
 
 
-def _container_top(container):
+def _container_top(dc, container):
     # Create nodes and links for processes running in each container
     try:
-        processes = container.top()["Processes"]
+        processes = dc.client.api.top(container.id)["Processes"]
     except Exception:
         # When we query the container, it may already have vanished.
         # Any error happening here is not fatal, so we just ignore it.
@@ -64,9 +64,10 @@ def visualization_containers_and_networks_graph():
     nodes.append(external_node)
 
     dc = DockerClient()
+    inventory = docker_inventory.get(dc.client)
 
-    # Create node for each container
-    containers = dc.containers()
+    # Create node for each running container
+    containers = [c for c in inventory.containers() if c.status == "running"]
 
     executor = ThreadPoolExecutor(max_workers=16)
     top_futures = []
@@ -77,10 +78,10 @@ def visualization_containers_and_networks_graph():
         nodes.append(n)
 
         # Create links and nodes for all processes running in the container
-        top_futures.append(executor.submit(_container_top, c))
+        top_futures.append(executor.submit(_container_top, dc, c))
 
     # Create node for each network
-    networks = dc.networks()
+    networks = inventory.networks()
     for network in networks:
         if network.name in ["host", "none"]:
             continue
@@ -90,7 +91,7 @@ def visualization_containers_and_networks_graph():
 
     # Create links between containers and networks.
     for network in networks:
-        for container_id in network.attrs["Containers"]:
+        for container_id in network.containers:
             if network.id in valid_ids and container_id in valid_ids:
                 link = Link(None, network.id, container_id)
                 links.append(link)
@@ -105,7 +106,7 @@ def visualization_containers_and_networks_graph():
                 link = Link(None, container_id, network.id)
                 nodes.append(node)
                 links.append(link)
-        if network.id in valid_ids and not network.attrs["Internal"]:
+        if network.id in valid_ids and not network.internal:
             link = Link(None, network.id, external_node.id)
             links.append(link)
 